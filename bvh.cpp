@@ -0,0 +1,551 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "bvh.h"
+#include "frustum.h"
+#include "profiler.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+const int BVH_LEAF_SIZE = 4;
+const int BVH_BINS      = 16;
+const int BVH_TASK_SIZE = 65536;   // subtrees below this size are built by one thread
+const int BVH_STACK     = 128;
+const int BVH_MAX_DEPTH = 48;      // deeper nodes are median split, keeps traversal stacks bounded
+
+//! ============= build ===============
+struct BvhBounds
+{
+    float min[3];
+    float max[3];
+
+    void reset() {
+        for (int i = 0; i < 3; ++i) {
+            min[i] =  std::numeric_limits<float>::max();
+            max[i] = -std::numeric_limits<float>::max();
+        }
+    }
+    void grow(const QVector3D &p) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = qMin(min[i], p[i]);
+            max[i] = qMax(max[i], p[i]);
+        }
+    }
+    void grow(const BvhBounds &b) {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = qMin(min[i], b.min[i]);
+            max[i] = qMax(max[i], b.max[i]);
+        }
+    }
+    float area() const {
+        const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        if (dx < 0)
+            return 0;
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+// triangle bounds, partitioned in place so the build walks memory sequentially.
+struct BvhRef
+{
+    BvhBounds bounds;
+    int triangle;
+
+    float centroid(int axis) const { return (bounds.min[axis] + bounds.max[axis]) * 0.5f; }
+};
+
+struct BvhTask;
+
+struct BvhBuilder
+{
+    QVector<BvhRef> refs;
+
+    int  split(int first, int count, bool median);
+    int  buildNode(int first, int count, int depth, QVector<BvhNode> &nodes, QVector<BvhTask> *tasks);
+};
+
+struct BvhTask
+{
+    BvhBuilder *builder;
+    int first;
+    int count;
+    int depth;
+    QVector<BvhNode> nodes;
+};
+
+static void buildTask(BvhTask &task)
+{
+    task.builder->buildNode(task.first, task.count, task.depth, task.nodes, 0);
+}
+
+static bool refLess(int axis, const BvhRef &a, const BvhRef &b)
+{
+    return a.centroid(axis) < b.centroid(axis);
+}
+
+// binned SAH along the longest axis of the centroids, falls back to a median split.
+int BvhBuilder::split(int first, int count, bool median)
+{
+    BvhRef *begin = refs.data() + first;
+    BvhRef *end = begin + count;
+
+    float minimum[3], maximum[3];
+    for (int i = 0; i < 3; ++i) {
+        minimum[i] =  std::numeric_limits<float>::max();
+        maximum[i] = -std::numeric_limits<float>::max();
+    }
+    for (const BvhRef *it = begin; it != end; ++it) {
+        for (int i = 0; i < 3; ++i) {
+            minimum[i] = qMin(minimum[i], it->centroid(i));
+            maximum[i] = qMax(maximum[i], it->centroid(i));
+        }
+    }
+
+    int axis = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (maximum[i] - minimum[i] > maximum[axis] - minimum[axis])
+            axis = i;
+    }
+    const float extent = maximum[axis] - minimum[axis];
+
+    if (extent > 0 && !median) {
+        BvhBounds bins[BVH_BINS];
+        int binCounts[BVH_BINS];
+        for (int i = 0; i < BVH_BINS; ++i) {
+            bins[i].reset();
+            binCounts[i] = 0;
+        }
+
+        const float scale = BVH_BINS * (1 - 1e-5f) / extent;
+        for (const BvhRef *it = begin; it != end; ++it) {
+            const int bin = int((it->centroid(axis) - minimum[axis]) * scale);
+            bins[bin].grow(it->bounds);
+            ++binCounts[bin];
+        }
+
+        // sweep from the right to get the cost of every right side.
+        float rightArea[BVH_BINS];
+        int rightCount[BVH_BINS];
+        BvhBounds accumulated;
+        accumulated.reset();
+        int accumulatedCount = 0;
+        for (int i = BVH_BINS - 1; i > 0; --i) {
+            accumulated.grow(bins[i]);
+            accumulatedCount += binCounts[i];
+            rightArea[i] = accumulated.area();
+            rightCount[i] = accumulatedCount;
+        }
+
+        int bestBin = -1;
+        float bestCost = std::numeric_limits<float>::max();
+        accumulated.reset();
+        accumulatedCount = 0;
+        for (int i = 0; i < BVH_BINS - 1; ++i) {
+            accumulated.grow(bins[i]);
+            accumulatedCount += binCounts[i];
+            if (accumulatedCount == 0 || rightCount[i + 1] == 0)
+                continue;
+            const float cost = accumulated.area() * accumulatedCount + rightArea[i + 1] * rightCount[i + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestBin = i;
+            }
+        }
+
+        if (bestBin >= 0) {
+            BvhRef *middle = begin;
+            for (BvhRef *it = begin; it != end; ++it) {
+                if (int((it->centroid(axis) - minimum[axis]) * scale) <= bestBin)
+                    std::swap(*it, *middle++);
+            }
+            if (middle != begin && middle != end)
+                return int(middle - refs.data());
+        }
+    }
+
+    BvhRef *middle = begin + count / 2;
+    std::nth_element(begin, middle, end, std::bind(refLess, axis, std::placeholders::_1, std::placeholders::_2));
+    return int(middle - refs.data());
+}
+
+// Subtrees small enough for one thread become placeholders (count == 0) when tasks is given.
+int BvhBuilder::buildNode(int first, int count, int depth, QVector<BvhNode> &nodes, QVector<BvhTask> *tasks)
+{
+    const int index = nodes.size();
+    nodes.push_back(BvhNode());
+
+    BvhBounds bounds;
+    bounds.reset();
+    for (int i = first; i < first + count; ++i)
+        bounds.grow(refs.at(i).bounds);
+    for (int i = 0; i < 3; ++i) {
+        nodes[index].min[i] = bounds.min[i];
+        nodes[index].max[i] = bounds.max[i];
+    }
+
+    if (count <= BVH_LEAF_SIZE) {
+        nodes[index].offset = first;
+        nodes[index].count = count;
+        return index;
+    }
+
+    if (tasks && count <= BVH_TASK_SIZE) {
+        BvhTask task;
+        task.builder = this;
+        task.first = first;
+        task.count = count;
+        task.depth = depth;
+        nodes[index].offset = tasks->size();
+        nodes[index].count = 0;
+        tasks->push_back(task);
+        return index;
+    }
+
+    const int middle = split(first, count, depth >= BVH_MAX_DEPTH);
+    buildNode(first, middle - first, depth + 1, nodes, tasks);
+    const int right = buildNode(middle, first + count - middle, depth + 1, nodes, tasks);
+    nodes[index].offset = right;
+    nodes[index].count = -count;
+    return index;
+}
+
+// copies the top of the tree depth first and splices in the subtrees built by the tasks.
+static int spliceNode(const QVector<BvhNode> &top, int index, const QVector<BvhTask> &tasks, QVector<BvhNode> &nodes)
+{
+    const BvhNode &node = top.at(index);
+    const int base = nodes.size();
+
+    if (node.count == 0) {
+        const QVector<BvhNode> &subtree = tasks.at(node.offset).nodes;
+        for (int i = 0; i < subtree.size(); ++i) {
+            nodes.push_back(subtree.at(i));
+            if (subtree.at(i).count < 0)
+                nodes.last().offset += base;
+        }
+        return base;
+    }
+
+    nodes.push_back(node);
+    if (node.count < 0) {
+        spliceNode(top, index + 1, tasks, nodes);
+        const int right = spliceNode(top, node.offset, tasks, nodes);
+        nodes[base].offset = right;
+    }
+    return base;
+}
+
+//! ============= Bvh ===============
+Bvh::Bvh()
+    : m_vertices(0)
+    , m_indices(0)
+{
+
+}
+
+void Bvh::clear()
+{
+    m_nodes.clear();
+    m_vertices = 0;
+    m_indices = 0;
+}
+
+void Bvh::build(const QVector<QVector3D> &vertices, QVector<int> &indices)
+{
+    PROFILE_SCOPE("Bvh::build");
+    QElapsedTimer timer;
+    timer.start();
+
+    clear();
+    const int triangles = indices.size() / 3;
+    if (!triangles)
+        return;
+
+    BvhBuilder builder;
+    builder.refs.resize(triangles);
+    for (int i = 0; i < triangles; ++i) {
+        BvhRef &ref = builder.refs[i];
+        ref.bounds.reset();
+        ref.bounds.grow(vertices.at(indices.at(i * 3)));
+        ref.bounds.grow(vertices.at(indices.at(i * 3 + 1)));
+        ref.bounds.grow(vertices.at(indices.at(i * 3 + 2)));
+        ref.triangle = i;
+    }
+
+    // the top of the tree is split on this thread, the subtrees below it in parallel.
+    QVector<BvhNode> top;
+    QVector<BvhTask> tasks;
+    builder.buildNode(0, triangles, 0, top, &tasks);
+    QtConcurrent::blockingMap(tasks, buildTask);
+
+    m_nodes.reserve(triangles * 2 / BVH_LEAF_SIZE + 1);
+    spliceNode(top, 0, tasks, m_nodes);
+    m_nodes.squeeze();
+
+    // store the triangles in tree order
+    QVector<int> reordered(indices.size());
+    for (int i = 0; i < triangles; ++i) {
+        const int triangle = builder.refs.at(i).triangle;
+        reordered[i * 3]     = indices.at(triangle * 3);
+        reordered[i * 3 + 1] = indices.at(triangle * 3 + 1);
+        reordered[i * 3 + 2] = indices.at(triangle * 3 + 2);
+    }
+    indices.swap(reordered);
+
+    m_vertices = &vertices;
+    m_indices = &indices;
+
+    qDebug() << Q_FUNC_INFO << triangles << "triangles," << m_nodes.size() << "nodes in" << timer.elapsed() << "ms";
+}
+
+int Bvh::firstTriangle(int node) const
+{
+    while (m_nodes.at(node).count < 0)
+        ++node;
+    return m_nodes.at(node).offset;
+}
+
+//! ============= queries ===============
+static bool rayBox(const BvhNode &node, const QVector3D &origin, const float inverse[3], float maxDistance, float &entry)
+{
+    float tmin = 0, tmax = maxDistance;
+    for (int i = 0; i < 3; ++i) {
+        float t1 = (node.min[i] - origin[i]) * inverse[i];
+        float t2 = (node.max[i] - origin[i]) * inverse[i];
+        if (t1 > t2)
+            std::swap(t1, t2);
+        tmin = qMax(tmin, t1);
+        tmax = qMin(tmax, t2);
+    }
+    entry = tmin;
+    return tmin <= tmax;
+}
+
+// Moller-Trumbore
+static bool rayTriangle(const QVector3D &origin, const QVector3D &direction,
+                        const QVector3D &a, const QVector3D &b, const QVector3D &c, float &distance)
+{
+    const QVector3D e1 = b - a;
+    const QVector3D e2 = c - a;
+    const QVector3D p = QVector3D::crossProduct(direction, e2);
+    const float det = QVector3D::dotProduct(e1, p);
+    if (qAbs(det) < 1e-12f)
+        return false;
+
+    const float inverse = 1.f / det;
+    const QVector3D s = origin - a;
+    const float u = QVector3D::dotProduct(s, p) * inverse;
+    if (u < 0 || u > 1)
+        return false;
+
+    const QVector3D q = QVector3D::crossProduct(s, e1);
+    const float v = QVector3D::dotProduct(direction, q) * inverse;
+    if (v < 0 || u + v > 1)
+        return false;
+
+    distance = QVector3D::dotProduct(e2, q) * inverse;
+    return distance > 0;
+}
+
+bool Bvh::intersect(const QVector3D &origin, const QVector3D &direction, float &distance, int &triangle) const
+{
+    if (m_nodes.isEmpty())
+        return false;
+
+    float inverse[3];
+    for (int i = 0; i < 3; ++i)
+        inverse[i] = direction[i] != 0 ? 1.f / direction[i] : std::numeric_limits<float>::max();
+
+    distance = std::numeric_limits<float>::max();
+    triangle = -1;
+
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const BvhNode &node = m_nodes.at(stack[--top]);
+        float entry;
+        if (!rayBox(node, origin, inverse, distance, entry))
+            continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; ++i) {
+                float t;
+                if (rayTriangle(origin, direction,
+                                m_vertices->at(m_indices->at(i * 3)),
+                                m_vertices->at(m_indices->at(i * 3 + 1)),
+                                m_vertices->at(m_indices->at(i * 3 + 2)), t) && t < distance) {
+                    distance = t;
+                    triangle = i;
+                }
+            }
+        } else if (top + 2 <= BVH_STACK) {
+            const int index = &node - m_nodes.constData();
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+        }
+    }
+    return triangle >= 0;
+}
+
+// closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+static QVector3D closestPointOnTriangle(const QVector3D &p, const QVector3D &a, const QVector3D &b, const QVector3D &c)
+{
+    const QVector3D ab = b - a, ac = c - a, ap = p - a;
+    const float d1 = QVector3D::dotProduct(ab, ap), d2 = QVector3D::dotProduct(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+        return a;
+
+    const QVector3D bp = p - b;
+    const float d3 = QVector3D::dotProduct(ab, bp), d4 = QVector3D::dotProduct(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+        return b;
+
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + ab * (d1 / (d1 - d3));
+
+    const QVector3D cp = p - c;
+    const float d5 = QVector3D::dotProduct(ab, cp), d6 = QVector3D::dotProduct(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+        return c;
+
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + ac * (d2 / (d2 - d6));
+
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    const float denom = 1.f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+static float boxDistance2(const BvhNode &node, const QVector3D &p)
+{
+    float d2 = 0;
+    for (int i = 0; i < 3; ++i) {
+        const float d = qMax(qMax(node.min[i] - p[i], 0.f), p[i] - node.max[i]);
+        d2 += d * d;
+    }
+    return d2;
+}
+
+bool Bvh::nearestPoint(const QVector3D &point, QVector3D &nearest, int &triangle) const
+{
+    if (m_nodes.isEmpty())
+        return false;
+
+    float best = std::numeric_limits<float>::max();
+    triangle = -1;
+
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const int index = stack[--top];
+        const BvhNode &node = m_nodes.at(index);
+        if (boxDistance2(node, point) >= best)
+            continue;
+
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; ++i) {
+                const QVector3D q = closestPointOnTriangle(point,
+                                                           m_vertices->at(m_indices->at(i * 3)),
+                                                           m_vertices->at(m_indices->at(i * 3 + 1)),
+                                                           m_vertices->at(m_indices->at(i * 3 + 2)));
+                const float d2 = (q - point).lengthSquared();
+                if (d2 < best) {
+                    best = d2;
+                    nearest = q;
+                    triangle = i;
+                }
+            }
+        } else if (top + 2 <= BVH_STACK) {
+            // visit the closer child first
+            const int left = index + 1, right = node.offset;
+            if (boxDistance2(m_nodes.at(left), point) < boxDistance2(m_nodes.at(right), point)) {
+                stack[top++] = right;
+                stack[top++] = left;
+            } else {
+                stack[top++] = left;
+                stack[top++] = right;
+            }
+        }
+    }
+    return triangle >= 0;
+}
+
+void Bvh::cull(const QMatrix4x4 &viewProjection, int minChunk, QVector<QPair<int, int> > &ranges) const
+{
+    ranges.clear();
+    if (m_nodes.isEmpty())
+        return;
+
+    const Frustum frustum(viewProjection);
+
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const int index = stack[--top];
+        const BvhNode &node = m_nodes.at(index);
+
+        const Frustum::Result result = frustum.classify(node.min, node.max);
+        if (result == Frustum::Outside)
+            continue;
+        const bool inside = result == Frustum::Inside;
+
+        const int count = node.count > 0 ? node.count : -node.count;
+        if (node.count < 0 && !inside && count > minChunk && top + 2 <= BVH_STACK) {
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        // nodes are visited left to right, merge with the previous range when adjacent.
+        const int first = firstTriangle(index);
+        if (!ranges.isEmpty() && ranges.last().first + ranges.last().second == first)
+            ranges.last().second += count;
+        else
+            ranges.push_back(qMakePair(first, count));
+    }
+}
+
+void Bvh::chunks(int minChunk, QVector<QPair<int, int> > &ranges) const
+{
+    ranges.clear();
+    if (m_nodes.isEmpty())
+        return;
+
+    // the same descent as cull() with every node partly visible
+    int stack[BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const int index = stack[--top];
+        const BvhNode &node = m_nodes.at(index);
+        const int count = node.count > 0 ? node.count : -node.count;
+        if (node.count < 0 && count > minChunk && top + 2 <= BVH_STACK) {
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+            continue;
+        }
+        ranges.push_back(qMakePair(firstTriangle(index), count));
+    }
+}
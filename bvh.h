@@ -0,0 +1,64 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <QVector3D>
+#include <QVector>
+#include <QPair>
+#include <QMatrix4x4>
+
+// 32 bytes, nodes are stored depth first so the left child is always the next node.
+struct BvhNode
+{
+    float min[3];
+    float max[3];
+    int offset;   // leaf: first triangle, interior: index of the right child
+    int count;    // leaf: number of triangles, interior: -(number of triangles below)
+};
+
+//! Bounding volume hierarchy over an indexed triangle list (binned SAH build).
+//! build() reorders the triangles of the index list so that every node covers a
+//! contiguous range of triangles. The vertex and index lists must stay untouched
+//! while the tree is in use.
+class Bvh
+{
+public:
+    Bvh();
+
+    void build(const QVector<QVector3D> &vertices, QVector<int> &indices);
+    void clear();
+    bool isEmpty() const { return m_nodes.isEmpty(); }
+    int  nodeCount() const { return m_nodes.size(); }
+    int  bytes() const { return m_nodes.capacity() * sizeof(BvhNode); }
+
+    bool intersect(const QVector3D &origin, const QVector3D &direction, float &distance, int &triangle) const;
+    bool nearestPoint(const QVector3D &point, QVector3D &nearest, int &triangle) const;
+    // triangle ranges (first, count) inside the frustum of viewProjection. Subtrees with
+    // less than minChunk triangles are not split any further.
+    void cull(const QMatrix4x4 &viewProjection, int minChunk, QVector<QPair<int, int> > &ranges) const;
+    // the triangle ranges cull() never splits, each of its ranges is a run of them. The
+    // triangles may be reordered within one of these for drawing.
+    void chunks(int minChunk, QVector<QPair<int, int> > &ranges) const;
+
+private:
+    int firstTriangle(int node) const;
+
+    const QVector<QVector3D> *m_vertices;
+    const QVector<int> *m_indices;
+    QVector<BvhNode> m_nodes;
+};
+
+#endif // BVH_H
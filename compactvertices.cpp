@@ -0,0 +1,102 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "compactvertices.h"
+
+#include <QtOpenGL>
+#include <cmath>
+
+//! ============= CompactPositions ===============
+void CompactPositions::pack(const QVector<QVector3D> &positions, const QVector3D &min, const QVector3D &max)
+{
+    clear();
+    if (positions.isEmpty())
+        return;
+    const float extent = qMax(qMax(max.x() - min.x(), max.y() - min.y()), max.z() - min.z());
+    step = extent > 0 ? extent / 65535 : 1;
+    for (int i = 0; i < 3; ++i)
+        origin[i] = min[i] + 32768 * step;
+
+    data.resize(positions.size() * COMPACT_POSITION_STRIDE);
+    qint16 *values = (qint16 *)data.data();
+    for (int i = 0; i < positions.size(); ++i, values += 4) {
+        for (int j = 0; j < 3; ++j) {
+            const float value = qBound(-32768.f, std::floor((positions.at(i)[j] - origin[j]) / step + 0.5f), 32767.f);
+            values[j] = qint16(value);
+            maxError = qMax(maxError, std::fabs(origin[j] + value * step - positions.at(i)[j]));
+        }
+        values[3] = 0;
+    }
+}
+
+void CompactPositions::pack(const QVector<QVector3D> &positions)
+{
+    if (positions.isEmpty()) {
+        clear();
+        return;
+    }
+    QVector3D min = positions.first(), max = min;
+    for (int i = 1; i < positions.size(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            min[j] = qMin(min[j], positions.at(i)[j]);
+            max[j] = qMax(max[j], positions.at(i)[j]);
+        }
+    }
+    pack(positions, min, max);
+}
+
+void CompactPositions::clear()
+{
+    data.clear();
+    step = maxError = 0;
+}
+
+void CompactPositions::pushTransform() const
+{
+    glPushMatrix();
+    glTranslatef(origin[0], origin[1], origin[2]);
+    glScalef(step, step, step);
+}
+
+//! ============= Normals and indices ===============
+float packNormals(const QVector<QVector3D> &normals, QByteArray &packed)
+{
+    packed.resize(normals.size() * COMPACT_NORMAL_STRIDE);
+    qint8 *values = (qint8 *)packed.data();
+    float minCos = 1;
+    for (int i = 0; i < normals.size(); ++i, values += 4) {
+        const QVector3D &normal = normals.at(i);
+        for (int j = 0; j < 3; ++j)
+            values[j] = qint8(qBound(-127.f, std::floor(normal[j] * 127 + 0.5f), 127.f));
+        values[3] = 0;
+        const QVector3D decoded = QVector3D(values[0], values[1], values[2]).normalized();
+        if (!normal.isNull())
+            minCos = qMin(minCos, QVector3D::dotProduct(decoded, normal.normalized()));
+    }
+    return std::acos(qBound(-1.f, minCos, 1.f)) * 180 / float(M_PI);
+}
+
+bool packIndices(const QVector<int> &indices, QByteArray &packed)
+{
+    packed.clear();
+    for (int i = 0; i < indices.size(); ++i) {
+        if (indices.at(i) > 0xffff)
+            return false;
+    }
+    packed.resize(indices.size() * sizeof(quint16));
+    quint16 *values = (quint16 *)packed.data();
+    for (int i = 0; i < indices.size(); ++i)
+        values[i] = quint16(indices.at(i));
+    return true;
+}
@@ -0,0 +1,53 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef COMPACTVERTICES_H
+#define COMPACTVERTICES_H
+
+#include <QByteArray>
+#include <QVector3D>
+#include <QVector>
+
+// bytes per packed position (3 x 16 bit and padding) and normal (3 x 8 bit and padding),
+// against 12 for a QVector3D. Strides stay 4 byte aligned.
+const int COMPACT_POSITION_STRIDE = 8;
+const int COMPACT_NORMAL_STRIDE   = 4;
+
+//! Positions as 16 bit integers on a grid over a bounding box, drawn as GL_SHORT through
+//! a translation and scale on the modelview matrix. The grid step is the same on all axes
+//! so that the fixed function normal transform keeps the normals' directions.
+struct CompactPositions
+{
+    CompactPositions() : step(0), maxError(0) { origin[0] = origin[1] = origin[2] = 0; }
+
+    QByteArray data;
+    float origin[3];    // position = origin + value * step
+    float step;
+    float maxError;     // largest coordinate error, in the units of the positions
+
+    void pack(const QVector<QVector3D> &positions, const QVector3D &min, const QVector3D &max);
+    void pack(const QVector<QVector3D> &positions);   // over their own bounding box
+    void clear();
+    bool isEmpty() const { return data.isEmpty(); }
+    // pushes the modelview matrix and maps the grid onto the positions, glPopMatrix() after.
+    void pushTransform() const;
+};
+
+// Unit normals as signed bytes, drawn as GL_BYTE (with GL_NORMALIZE). Returns the largest
+// error in degrees.
+float packNormals(const QVector<QVector3D> &normals, QByteArray &packed);
+// 16 bit indices when all of them fit, packed stays empty otherwise.
+bool packIndices(const QVector<int> &indices, QByteArray &packed);
+
+#endif // COMPACTVERTICES_H
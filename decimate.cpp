@@ -0,0 +1,535 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "decimate.h"
+#include "loadprogress.h"
+
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+
+// weight of the planes that hold open borders in place, per squared edge length
+const double DECIMATE_BORDER_WEIGHT = 100;
+// grids alternate between passes, shifted by half a cell every other one
+const int DECIMATE_PASSES = 4;
+// a collapse may not turn a face by more than acos of this
+const float DECIMATE_MIN_FACE_COS = 0.2f;
+
+namespace {
+
+//! Symmetric 4x4 matrix summing the squared distances to a set of planes, weighted by area.
+struct Quadric
+{
+    Quadric() : weight(0) { std::fill(a, a + 10, 0.0); }
+
+    double a[10];    // a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+    double weight;
+
+    void addPlane(double x, double y, double z, double d, double w)
+    {
+        a[0] += w * x * x; a[1] += w * x * y; a[2] += w * x * z; a[3] += w * x * d;
+        a[4] += w * y * y; a[5] += w * y * z; a[6] += w * y * d;
+        a[7] += w * z * z; a[8] += w * z * d;
+        a[9] += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &other)
+    {
+        for (int i = 0; i < 10; ++i)
+            a[i] += other.a[i];
+        weight += other.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double error(const QVector3D &p) const
+    {
+        const double x = p.x(), y = p.y(), z = p.z();
+        const double e = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                       + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                       + a[7] * z * z + 2 * a[8] * z + a[9];
+        return weight > 0 ? qMax(e, 0.0) / weight : 0;
+    }
+
+    // the point of least error, false if the planes don't pin one down
+    bool minimum(QVector3D &p) const
+    {
+        const double det = a[0] * (a[4] * a[7] - a[5] * a[5]) - a[1] * (a[1] * a[7] - a[5] * a[2])
+                         + a[2] * (a[1] * a[5] - a[4] * a[2]);
+        if (std::fabs(det) <= 1e-9 * weight * weight * weight)
+            return false;
+        const double r0 = -a[3], r1 = -a[6], r2 = -a[8];
+        const double x = r0 * (a[4] * a[7] - a[5] * a[5]) - a[1] * (r1 * a[7] - a[5] * r2) + a[2] * (r1 * a[5] - a[4] * r2);
+        const double y = a[0] * (r1 * a[7] - a[5] * r2) - r0 * (a[1] * a[7] - a[5] * a[2]) + a[2] * (a[1] * r2 - r1 * a[2]);
+        const double z = a[0] * (a[4] * r2 - r1 * a[5]) - a[1] * (a[1] * r2 - r1 * a[2]) + r0 * (a[1] * a[5] - a[4] * a[2]);
+        p = QVector3D(x / det, y / det, z / det);
+        return true;
+    }
+};
+
+// edge of the heap, valid while neither end changed since
+struct Collapse
+{
+    float cost;
+    int keep;
+    int remove;
+    unsigned int keepStamp;
+    unsigned int removeStamp;
+    QVector3D target;
+    bool operator<(const Collapse &other) const { return cost > other.cost; }
+};
+
+struct CellEdge
+{
+    int a, b;       // a < b
+    int triangle;
+    bool operator<(const CellEdge &other) const { return a != other.a ? a < other.a : b < other.b; }
+};
+
+// triangles of one grid cell, see decimatePass()
+struct DecimateCell
+{
+    const int *triangles;   // of the mesh
+    int count;
+    int target;
+    double maxError2;
+    QVector3D *positions;   // moved in place, only the owner cell moves a vertex
+    int *corners;           // written back, removed triangles as -1
+    const int *owner;       // cell of each vertex, -1 where cells meet
+    int cell;
+    const LoadProgress *progress;
+};
+
+class CellSimplifier
+{
+public:
+    CellSimplifier(DecimateCell &cell)
+        : m_cell(cell)
+        , m_mark(0)
+    {
+        // the triangles work on vertices numbered 0.. within the cell
+        m_vertices.reserve(cell.count * 3);
+        for (int i = 0; i < cell.count; ++i)
+            for (int j = 0; j < 3; ++j)
+                m_vertices.push_back(cell.corners[cell.triangles[i] * 3 + j]);
+        std::sort(m_vertices.begin(), m_vertices.end());
+        m_vertices.erase(std::unique(m_vertices.begin(), m_vertices.end()), m_vertices.end());
+        m_corners.resize(cell.count * 3);
+        for (int i = 0; i < cell.count; ++i)
+            for (int j = 0; j < 3; ++j)
+                m_corners[i * 3 + j] = std::lower_bound(m_vertices.begin(), m_vertices.end(),
+                                                        cell.corners[cell.triangles[i] * 3 + j]) - m_vertices.begin();
+
+        const int vertices = m_vertices.size();
+        m_positions.resize(vertices);
+        m_locked.resize(vertices);
+        for (int i = 0; i < vertices; ++i) {
+            m_positions[i] = cell.positions[m_vertices[i]];
+            m_locked[i] = cell.owner[m_vertices[i]] != cell.cell;
+        }
+        m_removed.assign(vertices, 0);
+        m_stamps.assign(vertices, 0);
+        m_marks.assign(vertices, 0);
+        m_alive.assign(cell.count, 1);
+        m_quadrics.resize(vertices);
+        m_vertexTriangles.resize(vertices);
+
+        std::vector<CellEdge> edges;
+        edges.reserve(cell.count * 3);
+        for (int i = 0; i < cell.count; ++i) {
+            const int *corners = &m_corners[i * 3];
+            const QVector3D normal = faceNormal(i);
+            const float length = normal.length();
+            if (length > 0) {
+                const QVector3D unit = normal / length;
+                const double d = -QVector3D::dotProduct(unit, m_positions[corners[0]]);
+                for (int j = 0; j < 3; ++j)
+                    m_quadrics[corners[j]].addPlane(unit.x(), unit.y(), unit.z(), d, length * 0.5);
+            }
+            for (int j = 0; j < 3; ++j) {
+                m_vertexTriangles[corners[j]].push_back(i);
+                CellEdge edge = { qMin(corners[j], corners[(j + 1) % 3]), qMax(corners[j], corners[(j + 1) % 3]), i };
+                edges.push_back(edge);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for (size_t first = 0, last; first < edges.size(); first = last) {
+            last = first + 1;
+            while (last < edges.size() && !(edges[first] < edges[last]))
+                ++last;
+            const CellEdge &edge = edges[first];
+            if (last - first == 1)
+                addBorder(edge);
+            else if (last - first > 2)
+                m_locked[edge.a] = m_locked[edge.b] = 1;   // non-manifold, left alone
+        }
+        for (size_t i = 0; i < edges.size(); ++i)
+            if (i == 0 || edges[i - 1] < edges[i])
+                push(edges[i].a, edges[i].b);
+    }
+
+    void run()
+    {
+        int triangles = m_cell.count;
+        int polls = 0;
+        while (triangles > m_cell.target && !m_heap.empty()) {
+            if (++polls % LOAD_POLL_INTERVAL == 0 && m_cell.progress && m_cell.progress->isCanceled())
+                break;
+            const Collapse collapse = m_heap.top();
+            m_heap.pop();
+            if (m_removed[collapse.keep] || m_removed[collapse.remove]
+                    || m_stamps[collapse.keep] != collapse.keepStamp || m_stamps[collapse.remove] != collapse.removeStamp)
+                continue;
+            // the costs are current, all others are higher
+            if (collapse.cost > m_cell.maxError2)
+                break;
+            if (canCollapse(collapse))
+                triangles -= apply(collapse);
+        }
+        writeBack();
+    }
+
+private:
+    QVector3D faceNormal(int triangle) const
+    {
+        const int *corners = &m_corners[triangle * 3];
+        return QVector3D::crossProduct(m_positions[corners[1]] - m_positions[corners[0]],
+                                       m_positions[corners[2]] - m_positions[corners[0]]);
+    }
+
+    // a plane through the edge, perpendicular to its face, keeps the border from moving inwards
+    void addBorder(const CellEdge &edge)
+    {
+        const QVector3D normal = faceNormal(edge.triangle).normalized();
+        const QVector3D along = m_positions[edge.b] - m_positions[edge.a];
+        const QVector3D plane = QVector3D::crossProduct(along, normal).normalized();
+        if (plane.isNull())
+            return;
+        const double d = -QVector3D::dotProduct(plane, m_positions[edge.a]);
+        const double weight = DECIMATE_BORDER_WEIGHT * along.lengthSquared();
+        m_quadrics[edge.a].addPlane(plane.x(), plane.y(), plane.z(), d, weight);
+        m_quadrics[edge.b].addPlane(plane.x(), plane.y(), plane.z(), d, weight);
+    }
+
+    // edges to locked vertices stay, their other faces are out of sight of the cell
+    void push(int u, int v)
+    {
+        if (m_locked[u] || m_locked[v])
+            return;
+        Quadric quadric = m_quadrics[u];
+        quadric.add(m_quadrics[v]);
+
+        Collapse collapse;
+        collapse.keep = u;
+        collapse.remove = v;
+        collapse.keepStamp = m_stamps[u];
+        collapse.removeStamp = m_stamps[v];
+        const QVector3D middle = (m_positions[u] + m_positions[v]) * 0.5f;
+        const float length2 = (m_positions[u] - m_positions[v]).lengthSquared();
+        if (!quadric.minimum(collapse.target) || (collapse.target - middle).lengthSquared() > length2) {
+            // nearly flat, or the optimum lies far off the edge
+            collapse.target = middle;
+            if (quadric.error(m_positions[u]) < quadric.error(collapse.target))
+                collapse.target = m_positions[u];
+            if (quadric.error(m_positions[v]) < quadric.error(collapse.target))
+                collapse.target = m_positions[v];
+        }
+        collapse.cost = quadric.error(collapse.target);
+        m_heap.push(collapse);
+    }
+
+    // keeps the mesh manifold and its faces from folding over
+    bool canCollapse(const Collapse &collapse)
+    {
+        const int keep = collapse.keep, remove = collapse.remove;
+        const unsigned int mark = ++m_mark;
+        int shared = 0, common = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            const int vertex = pass == 0 ? remove : keep;
+            const int other = pass == 0 ? keep : remove;
+            const std::vector<int> &triangles = m_vertexTriangles[vertex];
+            for (size_t i = 0; i < triangles.size(); ++i) {
+                const int triangle = triangles[i];
+                if (!m_alive[triangle])
+                    continue;
+                const int *corners = &m_corners[triangle * 3];
+                if (corners[0] == other || corners[1] == other || corners[2] == other) {
+                    shared += pass == 0;
+                    continue;
+                }
+                const QVector3D before = faceNormal(triangle);
+                const QVector3D saved = m_positions[vertex];
+                m_positions[vertex] = collapse.target;
+                const QVector3D after = faceNormal(triangle);
+                m_positions[vertex] = saved;
+                if (QVector3D::dotProduct(before, after) < DECIMATE_MIN_FACE_COS * before.length() * after.length())
+                    return false;
+                // neighbors of remove are marked, those of keep counted once
+                for (int j = 0; j < 3; ++j) {
+                    const int neighbor = corners[j];
+                    if (neighbor == vertex)
+                        continue;
+                    if (pass == 0) {
+                        m_marks[neighbor] = mark;
+                    } else if (m_marks[neighbor] == mark) {
+                        m_marks[neighbor] = 0;
+                        ++common;
+                    }
+                }
+            }
+        }
+        // the ends may only share the tips of the faces on the edge, or the result pinches
+        return shared > 0 && common <= shared;
+    }
+
+    // returns the number of triangles removed
+    int apply(const Collapse &collapse)
+    {
+        const int keep = collapse.keep, remove = collapse.remove;
+        m_positions[keep] = collapse.target;
+        m_quadrics[keep].add(m_quadrics[remove]);
+        m_removed[remove] = 1;
+        ++m_stamps[keep];
+
+        int removed = 0;
+        std::vector<int> &keepTriangles = m_vertexTriangles[keep];
+        std::vector<int> &removeTriangles = m_vertexTriangles[remove];
+        for (size_t i = 0; i < removeTriangles.size(); ++i) {
+            const int triangle = removeTriangles[i];
+            if (!m_alive[triangle])
+                continue;
+            int *corners = &m_corners[triangle * 3];
+            if (corners[0] == keep || corners[1] == keep || corners[2] == keep) {
+                m_alive[triangle] = 0;
+                ++removed;
+                continue;
+            }
+            for (int j = 0; j < 3; ++j)
+                if (corners[j] == remove)
+                    corners[j] = keep;
+            keepTriangles.push_back(triangle);
+        }
+        std::vector<int>().swap(removeTriangles);
+
+        size_t alive = 0;
+        for (size_t i = 0; i < keepTriangles.size(); ++i)
+            if (m_alive[keepTriangles[i]])
+                keepTriangles[alive++] = keepTriangles[i];
+        keepTriangles.resize(alive);
+        const unsigned int mark = ++m_mark;
+        for (size_t i = 0; i < keepTriangles.size(); ++i) {
+            const int *corners = &m_corners[keepTriangles[i] * 3];
+            for (int j = 0; j < 3; ++j) {
+                if (corners[j] != keep && m_marks[corners[j]] != mark) {
+                    m_marks[corners[j]] = mark;
+                    push(keep, corners[j]);
+                }
+            }
+        }
+        return removed;
+    }
+
+    void writeBack()
+    {
+        for (int i = 0; i < m_cell.count; ++i) {
+            int *corners = m_cell.corners + m_cell.triangles[i] * 3;
+            for (int j = 0; j < 3; ++j)
+                corners[j] = m_alive[i] ? m_vertices[m_corners[i * 3 + j]] : -1;
+        }
+        for (size_t i = 0; i < m_vertices.size(); ++i)
+            if (!m_locked[i] && !m_removed[i])
+                m_cell.positions[m_vertices[i]] = m_positions[i];
+    }
+
+    DecimateCell &m_cell;
+    std::vector<int> m_vertices;         // local to mesh vertex
+    std::vector<int> m_corners;          // 3 local vertices per triangle
+    std::vector<QVector3D> m_positions;
+    std::vector<char> m_locked;          // shared with other cells or non-manifold
+    std::vector<char> m_removed;
+    std::vector<unsigned int> m_stamps;  // bumped when a vertex moves
+    std::vector<char> m_alive;
+    std::vector<Quadric> m_quadrics;
+    std::vector<std::vector<int> > m_vertexTriangles;
+    std::priority_queue<Collapse> m_heap;
+    std::vector<unsigned int> m_marks;   // scratch of canCollapse() and apply(), per vertex
+    unsigned int m_mark;
+};
+
+void simplifyCell(DecimateCell &cell)
+{
+    if (cell.progress && cell.progress->isCanceled())
+        return;
+    CellSimplifier(cell).run();
+}
+
+struct PositionLess
+{
+    const QVector3D *positions;
+    bool operator()(int a, int b) const
+    {
+        const QVector3D &p = positions[a], &q = positions[b];
+        if (p.x() != q.x())
+            return p.x() < q.x();
+        if (p.y() != q.y())
+            return p.y() < q.y();
+        return p.z() < q.z();
+    }
+};
+
+// one vertex per position, triangles that collapse on the way are dropped
+void weld(const QVector<QVector3D> &vertices, const QVector<int> &indices,
+          QVector<QVector3D> &positions, QVector<int> &corners)
+{
+    std::vector<int> order(vertices.size());
+    for (int i = 0; i < vertices.size(); ++i)
+        order[i] = i;
+    PositionLess less = { vertices.constData() };
+    std::sort(order.begin(), order.end(), less);
+    std::vector<int> welded(vertices.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i == 0 || less(order[i - 1], order[i]))
+            positions.push_back(vertices.at(order[i]));
+        welded[order[i]] = positions.size() - 1;
+    }
+    corners.reserve(indices.size());
+    for (int i = 0; i + 2 < indices.size(); i += 3) {
+        const int a = welded[indices.at(i)], b = welded[indices.at(i + 1)], c = welded[indices.at(i + 2)];
+        if (a != b && b != c && a != c)
+            corners << a << b << c;
+    }
+}
+
+// Simplifies the cells of a grid over the mesh in parallel, each towards its share of the
+// target. Triangles belong to the cell of their centroid, vertices of triangles in
+// several cells stay, seams tells if there were any. Returns false if canceled.
+bool decimatePass(QVector<QVector3D> &positions, QVector<int> &corners, int target, double maxError2,
+                  bool shifted, bool &seams, const LoadProgress *progress)
+{
+    const int triangles = corners.size() / 3;
+    const int cells = qBound(1, triangles / DECIMATE_CELL_TRIANGLES, DECIMATE_MAX_CELLS);
+    const int perAxis = qMax(1, int(std::floor(std::pow(double(cells), 1.0 / 3) + 1e-6)));
+    seams = perAxis > 1;
+    if (triangles <= target)
+        return true;
+    if (!seams)
+        shifted = false;
+
+    QVector3D min = positions.first(), max = min;
+    for (int i = 1; i < positions.size(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            min[j] = qMin(min[j], positions.at(i)[j]);
+            max[j] = qMax(max[j], positions.at(i)[j]);
+        }
+    }
+    const int axisCells = perAxis + (shifted ? 1 : 0);
+    const float offset = shifted ? 0.5f : 0;
+    float scale[3];
+    for (int j = 0; j < 3; ++j)
+        scale[j] = max[j] > min[j] ? perAxis / (max[j] - min[j]) : 0;
+
+    std::vector<int> triangleCells(triangles);
+    std::vector<int> cellStart(axisCells * axisCells * axisCells + 1, 0);
+    for (int i = 0; i < triangles; ++i) {
+        const QVector3D centroid = (positions.at(corners.at(i * 3)) + positions.at(corners.at(i * 3 + 1))
+                                    + positions.at(corners.at(i * 3 + 2))) / 3;
+        int cell = 0;
+        for (int j = 2; j >= 0; --j)
+            cell = cell * axisCells + qBound(0, int((centroid[j] - min[j]) * scale[j] + offset), axisCells - 1);
+        triangleCells[i] = cell;
+        ++cellStart[cell + 1];
+    }
+    for (size_t i = 1; i < cellStart.size(); ++i)
+        cellStart[i] += cellStart[i - 1];
+    std::vector<int> cellTriangles(triangles);
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < triangles; ++i)
+        cellTriangles[fill[triangleCells[i]]++] = i;
+
+    std::vector<int> owner(positions.size(), -2);
+    for (int i = 0; i < triangles; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            int &vertexOwner = owner[corners.at(i * 3 + j)];
+            vertexOwner = vertexOwner == -2 || vertexOwner == triangleCells[i] ? triangleCells[i] : -1;
+        }
+    }
+
+    QVector<DecimateCell> tasks;
+    for (size_t cell = 0; cell + 1 < cellStart.size(); ++cell) {
+        const int count = cellStart[cell + 1] - cellStart[cell];
+        if (count == 0)
+            continue;
+        DecimateCell task = { &cellTriangles[cellStart[cell]], count, int(qint64(count) * target / triangles),
+                              maxError2, positions.data(), corners.data(), &owner[0], int(cell), progress };
+        tasks.push_back(task);
+    }
+    QtConcurrent::blockingMap(tasks, simplifyCell);
+    if (progress && progress->isCanceled())
+        return false;
+
+    int kept = 0;
+    for (int i = 0; i < triangles; ++i) {
+        if (corners.at(i * 3) < 0)
+            continue;
+        for (int j = 0; j < 3; ++j)
+            corners[kept * 3 + j] = corners.at(i * 3 + j);
+        ++kept;
+    }
+    corners.resize(kept * 3);
+    return true;
+}
+
+} // namespace
+
+bool decimateMesh(const QVector<QVector3D> &vertices, const QVector<int> &indices, int targetTriangles,
+                  float maxError, QVector<QVector3D> &outVertices, QVector<int> &outIndices,
+                  const LoadProgress *progress)
+{
+    outVertices.clear();
+    outIndices.clear();
+    QVector<QVector3D> positions;
+    QVector<int> corners;
+    weld(vertices, indices, positions, corners);
+    if (corners.isEmpty())
+        return true;
+
+    const double maxError2 = maxError > 0 ? double(maxError) * maxError : std::numeric_limits<double>::max();
+    // the seams of one pass lie inside the cells of the next. Each pass measures the error
+    // from the mesh it starts with, so passes stop once there are no seams left.
+    for (int pass = 0; pass < DECIMATE_PASSES && corners.size() / 3 > targetTriangles; ++pass) {
+        const int before = corners.size();
+        bool seams;
+        if (!decimatePass(positions, corners, targetTriangles, maxError2, pass % 2 == 1, seams, progress))
+            return false;
+        if (!seams || corners.size() == before)
+            break;
+    }
+
+    // without the vertices that were collapsed away
+    QVector<int> remap(positions.size(), -1);
+    outIndices.reserve(corners.size());
+    for (int i = 0; i < corners.size(); ++i) {
+        int &vertex = remap[corners.at(i)];
+        if (vertex < 0) {
+            vertex = outVertices.size();
+            outVertices.push_back(positions.at(corners.at(i)));
+        }
+        outIndices.push_back(vertex);
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#include <QVector3D>
+#include <QVector>
+
+class LoadProgress;
+
+// the mesh is cut into at most this many grid cells that are simplified in parallel,
+// and a cell gets at least DECIMATE_CELL_TRIANGLES triangles
+const int DECIMATE_MAX_CELLS      = 64;
+const int DECIMATE_CELL_TRIANGLES = 16384;
+
+// Simplifies a triangle mesh by edge collapses in order of their quadric error (Garland and
+// Heckbert 1997) until at most targetTriangles are left or the next collapse would move the
+// merged faces by more than maxError (root mean square over their area, 0 for no bound),
+// whichever comes first. Coincident vertices are welded first, so unindexed meshes (STL)
+// simplify as well, and open borders are kept. The grid cells are simplified with the
+// vertices they share fixed, then again over a grid shifted by half a cell to simplify
+// those seams. Returns false if canceled.
+bool decimateMesh(const QVector<QVector3D> &vertices, const QVector<int> &indices, int targetTriangles,
+                  float maxError, QVector<QVector3D> &outVertices, QVector<int> &outIndices,
+                  const LoadProgress *progress = 0);
+
+#endif // DECIMATE_H
@@ -0,0 +1,377 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "decompressdevice.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QDebug>
+#include <cstring>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+//! ============= DecodeThread ===============
+class DecodeThread : public QThread
+{
+public:
+    explicit DecodeThread(DecompressDevice *device) : m_device(device) {}
+
+protected:
+    void run() { m_device->decode(); }
+
+private:
+    DecompressDevice *m_device;
+};
+
+//! ============= DecompressDevice ===============
+DecompressDevice::DecompressDevice(const QString &filePath, Format format)
+    : m_filePath(filePath)
+    , m_format(format)
+    , m_sourceSize(0)
+    , m_thread(0)
+    , m_blockPos(0)
+    , m_queued(0)
+    , m_sourcePos(0)
+    , m_finished(true)
+    , m_failed(false)
+    , m_stopping(false)
+{
+}
+
+DecompressDevice::~DecompressDevice()
+{
+    close();
+}
+
+DecompressDevice::Format DecompressDevice::detect(const QByteArray &magic)
+{
+    if (magic.size() >= 2 && (uchar)magic.at(0) == 0x1f && (uchar)magic.at(1) == 0x8b)
+        return Gzip;
+    if (magic.size() >= 4 && (uchar)magic.at(0) == 0x28 && (uchar)magic.at(1) == 0xb5
+            && (uchar)magic.at(2) == 0x2f && (uchar)magic.at(3) == 0xfd)
+        return Zstd;
+    return Plain;
+}
+
+bool DecompressDevice::isSupported(Format format)
+{
+#ifndef HAVE_ZSTD
+    if (format == Zstd)
+        return false;
+#endif
+    return format != Plain;
+}
+
+bool DecompressDevice::open(OpenMode mode)
+{
+    if (isOpen() || (mode & WriteOnly) || !isSupported(m_format))
+        return false;
+
+    m_sourceSize = QFileInfo(m_filePath).size();
+    m_blocks.clear();
+    m_blockPos = 0;
+    m_queued = 0;
+    m_sourcePos = 0;
+    m_finished = m_failed = m_stopping = false;
+    m_thread = new DecodeThread(this);
+    m_thread->start();
+    return QIODevice::open(mode);
+}
+
+void DecompressDevice::close()
+{
+    if (!isOpen())
+        return;
+    stop();
+    QIODevice::close();
+}
+
+// the reader is done, possibly early: the decoder leaves at its next block.
+void DecompressDevice::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_drained.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = 0;
+    m_blocks.clear();
+    m_queued = 0;
+}
+
+bool DecompressDevice::atEnd() const
+{
+    QMutexLocker locker(&m_mutex);
+    return !isOpen() || (m_finished && m_queued == 0 && QIODevice::bytesAvailable() == 0);
+}
+
+qint64 DecompressDevice::bytesAvailable() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queued + QIODevice::bytesAvailable();
+}
+
+qint64 DecompressDevice::sourcePos() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_sourcePos;
+}
+
+// blocks until the decoder has something, or is done.
+qint64 DecompressDevice::readData(char *data, qint64 maxSize)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_blocks.isEmpty() && !m_finished)
+        m_filled.wait(&m_mutex);
+
+    qint64 read = 0;
+    while (read < maxSize && !m_blocks.isEmpty()) {
+        const QByteArray &block = m_blocks.head();
+        const int count = qMin<qint64>(maxSize - read, block.size() - m_blockPos);
+        memcpy(data + read, block.constData() + m_blockPos, count);
+        read += count;
+        m_blockPos += count;
+        m_queued -= count;
+        if (m_blockPos == block.size()) {
+            m_blocks.dequeue();
+            m_blockPos = 0;
+            m_drained.wakeAll();
+        }
+    }
+    if (read == 0 && m_failed)
+        return -1;
+    return read;
+}
+
+qint64 DecompressDevice::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+bool DecompressDevice::push(const QByteArray &block)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_blocks.size() >= DECODE_QUEUE_SIZE && !m_stopping)
+        m_drained.wait(&m_mutex);
+    if (m_stopping)
+        return false;
+    m_blocks.enqueue(block);
+    m_queued += block.size();
+    m_filled.wakeAll();
+    return true;
+}
+
+QByteArray DecompressDevice::readSource(QIODevice &source)
+{
+    const QByteArray input = source.read(DECODE_BLOCK_SIZE);
+    QMutexLocker locker(&m_mutex);
+    m_sourcePos += input.size();
+    return input;
+}
+
+// runs on m_thread
+void DecompressDevice::decode()
+{
+    QFile source(m_filePath);
+    bool ok = source.open(QIODevice::ReadOnly);
+    if (ok)
+        ok = m_format == Gzip ? decodeGzip(source) : decodeZstd(source);
+
+    QMutexLocker locker(&m_mutex);
+    // a reader that closed early cut the decoding short, the file is not broken for that
+    if (m_stopping)
+        ok = true;
+    if (!ok)
+        qWarning() << Q_FUNC_INFO << "cannot decompress" << m_filePath;
+    m_finished = true;
+    m_failed = !ok;
+    if (!ok)    // failed() takes the lock before the reader gets to see it
+        setErrorString(source.isOpen() ? QString("%1 is corrupt or cut short").arg(m_filePath)
+                                       : source.errorString());
+    m_filled.wakeAll();
+}
+
+bool DecompressDevice::failed() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_failed;
+}
+
+// Output goes out in full blocks. New input is only read once the last call left room in
+// the block, until then the decoder may still hold output of the input it has.
+bool DecompressDevice::decodeGzip(QIODevice &source)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)   // + 32: gzip or zlib header
+        return false;
+
+    QByteArray input;
+    QByteArray output(DECODE_BLOCK_SIZE, Qt::Uninitialized);
+    int produced = 0;
+    bool full = false;
+    bool ended = false;   // the last member is complete, nothing was decoded since
+    bool between = false; // after a member, before the next one starts
+    bool ok = true;
+    for (;;) {
+        if (stream.avail_in == 0 && !full) {
+            input = readSource(source);
+            if (input.isEmpty())
+                break;
+            stream.next_in = (Bytef*)input.data();
+            stream.avail_in = input.size();
+        }
+        // anything but another member after one is padding or junk, gzip ignores it too
+        if (between && stream.avail_in > 0) {
+            if (stream.next_in[0] != 0x1f || (stream.avail_in > 1 && stream.next_in[1] != 0x8b))
+                break;
+            between = false;
+        }
+        stream.next_out = (Bytef*)output.data() + produced;
+        stream.avail_out = output.size() - produced;
+        const int result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) {
+            ok = false;
+            break;
+        }
+        // a member may end just as the block fills, the next call has nothing to decode then
+        ended = result == Z_STREAM_END || (ended && result == Z_BUF_ERROR);
+        produced = output.size() - stream.avail_out;
+        full = produced == output.size();
+        if (full) {
+            if (!push(output))
+                break;
+            produced = 0;
+        }
+        if (result == Z_STREAM_END) {
+            inflateReset(&stream);   // gzip members may follow each other
+            between = true;
+        }
+    }
+    inflateEnd(&stream);
+    if (produced > 0) {
+        output.resize(produced);
+        push(output);
+    }
+    return ok && ended;   // else the file is cut short
+}
+
+bool DecompressDevice::decodeZstd(QIODevice &source)
+{
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    if (!stream)
+        return false;
+    ZSTD_initDStream(stream);
+
+    QByteArray input;
+    QByteArray output(DECODE_BLOCK_SIZE, Qt::Uninitialized);
+    ZSTD_inBuffer in = { 0, 0, 0 };
+    ZSTD_outBuffer out = { output.data(), (size_t)output.size(), 0 };
+    bool full = false;
+    bool ended = false;   // a frame is complete, nothing was decoded since
+    bool ok = true;
+    for (;;) {
+        if (in.pos == in.size && !full) {
+            input = readSource(source);
+            if (input.isEmpty())
+                break;
+            in.src = input.constData();
+            in.size = input.size();
+            in.pos = 0;
+        }
+        const size_t inPos = in.pos;
+        const size_t outPos = out.pos;
+        const size_t result = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(result)) {
+            ok = false;
+            break;
+        }
+        // 0 once a frame is complete, a call without anything left to decode keeps that
+        ended = result == 0 || (ended && in.pos == inPos && out.pos == outPos);
+        full = out.pos == out.size;
+        if (full) {
+            if (!push(output))
+                break;
+            out.pos = 0;
+        }
+    }
+    ZSTD_freeDStream(stream);
+    if (out.pos > 0) {
+        output.resize(out.pos);
+        push(output);
+    }
+    return ok && ended;
+#else
+    Q_UNUSED(source);
+    return false;
+#endif
+}
+
+//! ============= Input files ===============
+QIODevice *openInput(const QString &filePath)
+{
+    QFile *file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return 0;
+    }
+    const DecompressDevice::Format format = DecompressDevice::detect(file->peek(4));
+    if (format == DecompressDevice::Plain)
+        return file;
+    delete file;
+
+    if (!DecompressDevice::isSupported(format)) {
+        qWarning() << Q_FUNC_INFO << filePath << "is zstd compressed, built without zstd";
+        return 0;
+    }
+    DecompressDevice *device = new DecompressDevice(filePath, format);
+    if (!device->open(QIODevice::ReadOnly)) {
+        delete device;
+        return 0;
+    }
+    return device;
+}
+
+qint64 inputSize(QIODevice *device)
+{
+    const DecompressDevice *decompress = dynamic_cast<DecompressDevice*>(device);
+    return decompress ? decompress->sourceSize() : device->size();
+}
+
+qint64 inputPos(QIODevice *device)
+{
+    const DecompressDevice *decompress = dynamic_cast<DecompressDevice*>(device);
+    return decompress ? decompress->sourcePos() : device->pos();
+}
+
+bool inputFailed(QIODevice *device)
+{
+    const DecompressDevice *decompress = dynamic_cast<DecompressDevice*>(device);
+    return decompress && decompress->failed();
+}
+
+QString uncompressedName(const QString &filePath)
+{
+    if (filePath.endsWith(".gz", Qt::CaseInsensitive))
+        return filePath.left(filePath.size() - 3);
+    if (filePath.endsWith(".zst", Qt::CaseInsensitive))
+        return filePath.left(filePath.size() - 4);
+    return filePath;
+}
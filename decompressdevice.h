@@ -0,0 +1,106 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef DECOMPRESSDEVICE_H
+#define DECOMPRESSDEVICE_H
+
+#include <QIODevice>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QWaitCondition>
+
+class DecodeThread;
+
+// decompressed bytes per queued block, and blocks the decoder may run ahead of the reader
+const int DECODE_BLOCK_SIZE  = 1 << 20;
+const int DECODE_QUEUE_SIZE  = 4;
+
+//! Reads a gzip or zstd compressed file as a plain sequential device. The file is
+//! decompressed on a thread of its own a few blocks ahead of the reader, so parsing and
+//! decompression overlap and nothing is written to disk. Use openInput() instead of
+//! creating one directly, it hands out a QFile for files that are not compressed.
+class DecompressDevice : public QIODevice
+{
+public:
+    enum Format
+    {
+        Plain,
+        Gzip,   // 1f 8b, concatenated members too, bytes after the last one are ignored
+        Zstd    // 28 b5 2f fd, only if built with HAVE_ZSTD
+    };
+
+    DecompressDevice(const QString &filePath, Format format);
+    ~DecompressDevice();
+
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const { return true; }
+    bool atEnd() const;
+    qint64 bytesAvailable() const;
+
+    // compressed bytes, for progress
+    qint64 sourceSize() const { return m_sourceSize; }
+    qint64 sourcePos() const;
+    // the file could not be decompressed to its end (corrupt or cut short), see errorString().
+    // atEnd() turns true anyway once the blocks decoded before are read.
+    bool failed() const;
+
+    // format by the first bytes of a file
+    static Format detect(const QByteArray &magic);
+    static bool isSupported(Format format);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    friend class DecodeThread;
+    void decode();
+    bool decodeGzip(QIODevice &source);
+    bool decodeZstd(QIODevice &source);
+    QByteArray readSource(QIODevice &source);
+    bool push(const QByteArray &block);   // false once the reader is gone
+    void stop();
+
+    QString m_filePath;
+    Format  m_format;
+    qint64  m_sourceSize;
+    DecodeThread *m_thread;
+
+    // shared with the decoder, under m_mutex
+    mutable QMutex m_mutex;
+    QWaitCondition m_filled;
+    QWaitCondition m_drained;
+    QQueue<QByteArray> m_blocks;
+    int    m_blockPos;      // read from the head block
+    qint64 m_queued;        // unread bytes of the blocks
+    qint64 m_sourcePos;
+    bool   m_finished;      // decoder is done, the queue is all there is
+    bool   m_failed;
+    bool   m_stopping;
+};
+
+// Opens filePath for reading: a DecompressDevice for compressed files, a QFile otherwise.
+// Returns 0 if it can't be opened, the caller owns the device.
+QIODevice *openInput(const QString &filePath);
+// progress of reading device, in bytes of the file on disk
+qint64 inputSize(QIODevice *device);
+qint64 inputPos(QIODevice *device);
+// true if device did not deliver all of the file, to check once atEnd()
+bool inputFailed(QIODevice *device);
+// filePath without a .gz or .zst suffix, to tell the contents by
+QString uncompressedName(const QString &filePath);
+
+#endif // DECOMPRESSDEVICE_H
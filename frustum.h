@@ -0,0 +1,60 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QVector4D>
+#include <QMatrix4x4>
+
+//! View frustum planes (Gribb-Hartmann), normals point inside.
+struct Frustum
+{
+    enum Result { Outside, Intersecting, Inside };
+
+    QVector4D planes[6];
+
+    Frustum() {}
+    explicit Frustum(const QMatrix4x4 &viewProjection) { set(viewProjection); }
+
+    void set(const QMatrix4x4 &viewProjection)
+    {
+        const QVector4D row3 = viewProjection.row(3);
+        for (int i = 0; i < 3; ++i) {
+            planes[i * 2]     = row3 + viewProjection.row(i);
+            planes[i * 2 + 1] = row3 - viewProjection.row(i);
+        }
+    }
+
+    Result classify(const float min[3], const float max[3]) const
+    {
+        Result result = Inside;
+        for (int i = 0; i < 6; ++i) {
+            const QVector4D &plane = planes[i];
+            float positive = plane.w(), negative = plane.w();
+            for (int j = 0; j < 3; ++j) {
+                positive += plane[j] * (plane[j] > 0 ? max[j] : min[j]);
+                negative += plane[j] * (plane[j] > 0 ? min[j] : max[j]);
+            }
+            if (positive < 0)
+                return Outside;
+            if (negative < 0)
+                result = Intersecting;
+        }
+        return result;
+    }
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,97 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "arc.h"
+#include <cmath>
+
+static const float ARC_PI = 3.14159265358979f;
+
+// same construction as the firmware (Marlin) uses for the R form.
+bool arcCenterFromRadius(const QVector3D &start, const QVector3D &end, float radius, bool clockwise, QVector3D &center)
+{
+    const float dx = end.x() - start.x();
+    const float dy = end.y() - start.y();
+    const float d  = sqrt(dx * dx + dy * dy);
+    if (d == 0 || radius == 0)
+        return false;
+
+    float h2 = radius * radius - d * d * 0.25f;
+    if (h2 < 0)     // radius too small for the chord, treat it as a half circle.
+        h2 = 0;
+    const float h = sqrt(h2);
+    const float e = (clockwise ^ (radius < 0)) ? -1.f : 1.f;
+
+    center = QVector3D((start.x() + end.x()) * 0.5f + e * h * (-dy / d),
+                       (start.y() + end.y()) * 0.5f + e * h * ( dx / d),
+                       start.z());
+    return true;
+}
+
+// radius, start angle and sweep of the arc, returns the number of chords
+static int arcShape(const QVector3D &start, const QVector3D &end, const QVector3D &center, bool clockwise,
+                    float chordError, float &radius, float &startAngle, float &sweep)
+{
+    const float sx = start.x() - center.x();
+    const float sy = start.y() - center.y();
+    const float ex = end.x() - center.x();
+    const float ey = end.y() - center.y();
+    radius = sqrt(sx * sx + sy * sy);
+
+    startAngle = atan2(sy, sx);
+    const float endAngle = atan2(ey, ex);
+    sweep = clockwise ? (startAngle - endAngle) : (endAngle - startAngle);
+    if (sweep < 0)
+        sweep += 2 * ARC_PI;
+    // start == end means a full circle.
+    if (sweep < 1e-6f && start.x() == end.x() && start.y() == end.y())
+        sweep = 2 * ARC_PI;
+
+    int segments = 1;
+    if (radius > chordError) {
+        // sagitta = r * (1 - cos(theta / 2)) <= chordError
+        const float theta = 2 * acos(1 - chordError / radius);
+        segments = (int)ceil(sweep / theta);
+        if (segments < 1)
+            segments = 1;
+        if (segments > ARC_MAX_SEGMENTS)
+            segments = ARC_MAX_SEGMENTS;
+    }
+    return segments;
+}
+
+int arcSegments(const QVector3D &start, const QVector3D &end, const QVector3D &center,
+                bool clockwise, float chordError)
+{
+    float radius, startAngle, sweep;
+    return arcShape(start, end, center, clockwise, chordError, radius, startAngle, sweep);
+}
+
+int tessellateArc(const QVector3D &start, const QVector3D &end, const QVector3D &center,
+                  bool clockwise, QVector<QVector3D> &points, float chordError)
+{
+    float radius, startAngle, sweep;
+    const int segments = arcShape(start, end, center, clockwise, chordError, radius, startAngle, sweep);
+
+    const float direction = clockwise ? -1.f : 1.f;
+    for (int i = 1; i < segments; ++i) {
+        const float t = float(i) / segments;
+        const float angle = startAngle + direction * sweep * t;
+        points.push_back(QVector3D(center.x() + radius * cos(angle),
+                                   center.y() + radius * sin(angle),
+                                   start.z() + (end.z() - start.z()) * t));
+    }
+    points.push_back(end);
+
+    return segments;
+}
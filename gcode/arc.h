@@ -0,0 +1,40 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef ARC_H
+#define ARC_H
+
+#include <QVector3D>
+#include <QVector>
+
+// Maximum distance (mm) between an arc and the chords used to approximate it.
+const float ARC_CHORD_ERROR = 0.01f;
+// Upper bound of segments for a single arc, keeps huge radii from exploding.
+const int   ARC_MAX_SEGMENTS = 512;
+
+//! Computes the center of an arc given in R form (G2/G3 X Y R).
+//! A negative radius selects the arc larger than 180 degrees.
+bool arcCenterFromRadius(const QVector3D &start, const QVector3D &end, float radius, bool clockwise, QVector3D &center);
+
+//! Appends the points of an arc from start to end around center (x/y plane, z is interpolated linearly).
+//! The start point is not appended, the end point always is. The number of chords is chosen
+//! so that the sagitta of each chord stays below chordError.
+int tessellateArc(const QVector3D &start, const QVector3D &end, const QVector3D &center,
+                  bool clockwise, QVector<QVector3D> &points, float chordError = ARC_CHORD_ERROR);
+
+//! Number of chords tessellateArc() makes of the arc, without making them.
+int arcSegments(const QVector3D &start, const QVector3D &end, const QVector3D &center,
+                bool clockwise, float chordError = ARC_CHORD_ERROR);
+
+#endif // ARC_H
@@ -0,0 +1,309 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "bgcode.h"
+
+#include <QIODevice>
+#include <QtConcurrent/QtConcurrent>
+#include <QDebug>
+#include <cstring>
+#include <zlib.h>
+
+static const char BGCODE_MAGIC[] = "GCDE";
+static const int  BGCODE_FILE_HEADER = 10;          // magic, version, checksum type
+static const quint32 BGCODE_MAX_BLOCK = 1 << 30;    // anything larger is a broken file
+
+static quint32 littleEndian(const QByteArray &bytes, int at, int size)
+{
+    quint32 value = 0;
+    for (int i = size - 1; i >= 0; --i)
+        value = (value << 8) | (uchar)bytes.at(at + i);
+    return value;
+}
+
+//! ============= Decoding ===============
+static bool inflateBlock(const QByteArray &data, QByteArray &out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)   // + 32: zlib or gzip header
+        return false;
+    stream.next_in = (Bytef*)data.constData();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)out.data();
+    stream.avail_out = out.size();
+    const int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return result == Z_STREAM_END && stream.avail_out == 0;
+}
+
+// LZSS with a window of 2^windowBits and backrefs of up to 2^lookaheadBits bytes. Bits go
+// MSB first: 1 and a literal byte, or 0, the distance - 1 and the length - 1.
+static bool heatshrinkBlock(const QByteArray &data, int windowBits, int lookaheadBits, QByteArray &out)
+{
+    const uchar *in = (const uchar*)data.constData();
+    const qint64 inBits = qint64(data.size()) * 8;
+    qint64 bit = 0;
+    int size = 0;
+    while (size < out.size()) {
+        if (bit + 9 > inBits)
+            break;   // the rest of the last byte is padding
+        if (in[bit >> 3] & (0x80 >> (bit & 7))) {
+            ++bit;
+            int value = 0;
+            for (int i = 0; i < 8; ++i, ++bit)
+                value = (value << 1) | ((in[bit >> 3] >> (7 - (bit & 7))) & 1);
+            out[size++] = char(value);
+        } else {
+            ++bit;
+            if (bit + windowBits + lookaheadBits > inBits)
+                break;
+            int distance = 0, count = 0;
+            for (int i = 0; i < windowBits; ++i, ++bit)
+                distance = (distance << 1) | ((in[bit >> 3] >> (7 - (bit & 7))) & 1);
+            for (int i = 0; i < lookaheadBits; ++i, ++bit)
+                count = (count << 1) | ((in[bit >> 3] >> (7 - (bit & 7))) & 1);
+            ++distance;
+            ++count;
+            if (count > out.size() - size)
+                return false;
+            // the window starts out zeroed, overlapping copies repeat the pattern
+            for (int i = 0; i < count; ++i, ++size)
+                out[size] = size >= distance ? out.at(size - distance) : 0;
+        }
+    }
+    return size == out.size();
+}
+
+// MeatPack packs two of the common G-code characters into a byte, 0b1111 means a full byte
+// follows instead. 0xff 0xff and a command byte switch packing and the no-spaces mode, in
+// which 'E' takes the place of the space. Spaces are put back in front of the parameters,
+// the parser splits words at them.
+class MeatPackDecoder
+{
+public:
+    enum Command { EnablePacking = 251, DisablePacking = 250, ResetAll = 249, EnableNoSpaces = 247,
+                   DisableNoSpaces = 246 };
+
+    MeatPackDecoder()
+        : m_packing(false), m_noSpaces(false), m_comment(false), m_fullBytes(0), m_pending(0) {}
+
+    QByteArray decode(const QByteArray &packed)
+    {
+        m_text.reserve(packed.size() * 2);
+        int signalBytes = 0;   // 0xff in a row
+        bool command = false;
+        for (int i = 0; i < packed.size(); ++i) {
+            const uchar byte = packed.at(i);
+            if (command) {
+                runCommand(byte);
+                command = false;
+            } else if (byte == 0xff && ++signalBytes == 2) {
+                command = true;
+                signalBytes = 0;
+            } else if (byte != 0xff) {
+                if (signalBytes) {   // a single 0xff was data after all
+                    receive(0xff);
+                    signalBytes = 0;
+                }
+                receive(byte);
+            }
+        }
+        return m_text;
+    }
+
+private:
+    void runCommand(uchar command)
+    {
+        switch (command) {
+        case EnablePacking:   m_packing = true;   break;
+        case DisablePacking:  m_packing = false;  break;
+        case ResetAll:        m_packing = m_noSpaces = false; break;
+        case EnableNoSpaces:  m_noSpaces = true;  break;
+        case DisableNoSpaces: m_noSpaces = false; break;
+        default: break;
+        }
+    }
+
+    char character(int code) const
+    {
+        static const char CODES[] = "0123456789. \nGX";
+        return code == 11 && m_noSpaces ? 'E' : CODES[code];
+    }
+
+    void receive(uchar byte)
+    {
+        if (!m_packing) {
+            put(byte);
+        } else if (m_fullBytes > 0) {
+            put(byte);
+            if (m_pending) {
+                put(m_pending);
+                m_pending = 0;
+            }
+            --m_fullBytes;
+        } else if ((byte & 0xf) == 0xf) {
+            ++m_fullBytes;
+            if ((byte >> 4) == 0xf)
+                ++m_fullBytes;
+            else
+                m_pending = character(byte >> 4);
+        } else {
+            const char first = character(byte & 0xf);
+            put(first);
+            if (first != '\n') {   // a line end is never packed with the next line
+                if ((byte >> 4) == 0xf)
+                    ++m_fullBytes;
+                else
+                    put(character(byte >> 4));
+            }
+        }
+    }
+
+    void put(char c)
+    {
+        if (c == '\n') {
+            m_comment = false;
+        } else if (c == ';') {
+            m_comment = true;
+        } else if (m_noSpaces && !m_comment && c >= 'A' && c <= 'Z' && !m_text.isEmpty()
+                   && !m_text.endsWith(' ') && !m_text.endsWith('\n')) {
+            m_text.append(' ');
+        }
+        m_text.append(c);
+    }
+
+    QByteArray m_text;
+    bool m_packing;
+    bool m_noSpaces;
+    bool m_comment;
+    int  m_fullBytes;   // unpacked bytes still to come
+    char m_pending;     // second character of a byte, after the full one before it
+};
+
+static void decodeBlock(BGCodeBlock &block)
+{
+    block.valid = false;
+    if (block.hasChecksum) {
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, (const Bytef*)block.header.constData(), block.header.size());
+        crc = crc32(crc, (const Bytef*)block.data.constData(), block.data.size());
+        if (crc != block.checksum)
+            return;
+    }
+
+    QByteArray raw;
+    if (block.compression == BGCodeBlock::NoCompression) {
+        raw = block.data;
+    } else {
+        raw = QByteArray(block.size, Qt::Uninitialized);
+        const bool ok = block.compression == BGCodeBlock::Deflate ? inflateBlock(block.data, raw)
+                      : heatshrinkBlock(block.data, block.compression == BGCodeBlock::Heatshrink11 ? 11 : 12, 4, raw);
+        if (!ok)
+            return;
+    }
+    block.data.clear();
+    block.text = block.encoding == BGCodeBlock::NoEncoding ? raw : MeatPackDecoder().decode(raw);
+    block.valid = true;
+}
+
+//! ============= BGCodeReader ===============
+BGCodeReader::BGCodeReader(QIODevice *device)
+    : m_device(device)
+    , m_checksumType(0)
+    , m_error(false)
+{
+}
+
+bool BGCodeReader::isBinaryGCode(QIODevice &device)
+{
+    return device.peek(4) == BGCODE_MAGIC;
+}
+
+bool BGCodeReader::readHeader()
+{
+    const QByteArray header = m_device->read(BGCODE_FILE_HEADER);
+    if (header.size() < BGCODE_FILE_HEADER || header.left(4) != BGCODE_MAGIC) {
+        m_error = true;
+        return false;
+    }
+    m_checksumType = littleEndian(header, 8, 2);   // 0 none, 1 CRC32
+    if (m_checksumType > 1) {
+        qWarning() << Q_FUNC_INFO << "unknown checksum type" << m_checksumType;
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+// false at the end of the file, or on a broken block (m_error)
+bool BGCodeReader::readBlock(BGCodeBlock &block)
+{
+    block.header = m_device->read(8);
+    if (block.header.isEmpty())
+        return false;
+    if (block.header.size() == 8) {
+        block.type = littleEndian(block.header, 0, 2);
+        block.compression = littleEndian(block.header, 2, 2);
+        block.size = littleEndian(block.header, 4, 4);
+        quint32 stored = block.size;
+        if (block.compression != BGCodeBlock::NoCompression) {
+            const QByteArray compressed = m_device->read(4);
+            block.header.append(compressed);
+            stored = compressed.size() == 4 ? littleEndian(compressed, 0, 4) : 0;
+        }
+        const int parameters = block.type == BGCodeBlock::Thumbnail ? 6 : 2;
+        const QByteArray parameterBytes = m_device->read(parameters);
+        block.header.append(parameterBytes);
+        block.encoding = block.type == BGCodeBlock::GCode && parameterBytes.size() == parameters
+                ? littleEndian(parameterBytes, 0, 2) : BGCodeBlock::NoEncoding;
+
+        if (block.type <= BGCodeBlock::Thumbnail && block.compression <= BGCodeBlock::Heatshrink12
+                && block.encoding <= BGCodeBlock::MeatPackComments && parameterBytes.size() == parameters
+                && block.size < BGCODE_MAX_BLOCK && stored < BGCODE_MAX_BLOCK) {
+            block.data = m_device->read(stored);
+            block.hasChecksum = m_checksumType == 1;
+            const QByteArray checksum = m_device->read(block.hasChecksum ? 4 : 0);
+            if (block.data.size() == int(stored) && checksum.size() == (block.hasChecksum ? 4 : 0)) {
+                block.checksum = block.hasChecksum ? littleEndian(checksum, 0, 4) : 0;
+                return true;
+            }
+        }
+    }
+    qWarning() << Q_FUNC_INFO << "broken block";
+    m_error = true;
+    return false;
+}
+
+bool BGCodeReader::readGCode(QVector<QByteArray> &texts, int maxBlocks)
+{
+    texts.clear();
+    QVector<BGCodeBlock> blocks;
+    BGCodeBlock block;
+    while (!m_error && blocks.size() < maxBlocks && readBlock(block)) {
+        if (block.type == BGCodeBlock::GCode)
+            blocks.append(block);
+    }
+
+    QtConcurrent::blockingMap(blocks, decodeBlock);
+    for (int i = 0; i < blocks.size(); ++i) {
+        if (!blocks.at(i).valid) {
+            qWarning() << Q_FUNC_INFO << "cannot decode a G-code block";
+            m_error = true;
+            break;
+        }
+        texts.append(blocks.at(i).text);
+    }
+    return !texts.isEmpty();
+}
@@ -0,0 +1,71 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BGCODE_H
+#define BGCODE_H
+
+#include <QByteArray>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// G-code blocks read ahead and decoded at once, across the thread pool
+const int BGCODE_BATCH_BLOCKS = 64;
+
+// one block of a binary G-code file
+struct BGCodeBlock
+{
+    enum Type { FileMetadata, GCode, SlicerMetadata, PrinterMetadata, PrintMetadata, Thumbnail };
+    enum Compression { NoCompression, Deflate, Heatshrink11, Heatshrink12 };
+    enum Encoding { NoEncoding, MeatPack, MeatPackComments };
+
+    int type;
+    int compression;
+    int encoding;           // of GCode blocks
+    quint32 size;           // uncompressed
+    QByteArray header;      // block header and parameters, covered by the checksum
+    QByteArray data;        // as stored
+    quint32 checksum;
+    bool hasChecksum;
+    QByteArray text;        // decoded G-code
+    bool valid;
+};
+
+//! Reads the binary G-code format (.bgcode, as written by PrusaSlicer): a file header,
+//! then blocks of metadata, thumbnails and G-code, each block compressed (deflate or
+//! heatshrink) on its own and G-code also MeatPack encoded. The blocks are read one
+//! after the other, so any device will do, and decoded in parallel batches.
+class BGCodeReader
+{
+public:
+    explicit BGCodeReader(QIODevice *device);
+
+    static bool isBinaryGCode(QIODevice &device);   // by the magic, nothing is read
+
+    bool readHeader();
+    // decoded text of the next (up to) maxBlocks G-code blocks, false at the end
+    bool readGCode(QVector<QByteArray> &texts, int maxBlocks);
+    bool hasError() const { return m_error; }
+
+private:
+    bool readBlock(BGCodeBlock &block);
+
+    QIODevice *m_device;
+    int  m_checksumType;
+    bool m_error;
+};
+
+#endif // BGCODE_H
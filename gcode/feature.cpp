@@ -0,0 +1,98 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "feature.h"
+#include <cctype>
+
+struct FeatureInfo
+{
+    const char *name;
+    float color[3];
+};
+
+static const FeatureInfo FEATURES[FeatureCount] = {
+    { "Unknown",           { 0.11f, 0.15f, 0.5f  } },
+    { "Outer wall",        { 1.0f,  0.5f,  0.0f  } },
+    { "Inner wall",        { 1.0f,  0.8f,  0.2f  } },
+    { "Top / bottom",      { 0.58f, 0.2f,  0.75f } },
+    { "Infill",            { 0.69f, 0.19f, 0.16f } },
+    { "Bridge",            { 0.3f,  0.5f,  0.73f } },
+    { "Support",           { 0.2f,  0.7f,  0.2f  } },
+    { "Support interface", { 0.5f,  0.9f,  0.5f  } },
+    { "Skirt / brim",      { 0.0f,  0.53f, 0.43f } },
+    { "Prime tower",       { 0.6f,  0.6f,  0.6f  } },
+    { "Other",             { 0.35f, 0.35f, 0.35f } },
+};
+
+struct FeatureType
+{
+    const char *type;   // lower case
+    GCodeFeature feature;
+};
+
+static const FeatureType FEATURE_TYPES[] = {
+    // Cura
+    { "wall-outer",                 FeatureOuterWall },
+    { "wall-inner",                 FeatureInnerWall },
+    { "skin",                       FeatureSkin },
+    { "fill",                       FeatureInfill },
+    { "support",                    FeatureSupport },
+    { "support-infill",             FeatureSupport },
+    { "support-interface",          FeatureSupportInterface },
+    { "skirt",                      FeatureSkirt },
+    { "prime-tower",                FeaturePrimeTower },
+    // PrusaSlicer / Slic3r / SuperSlicer
+    { "external perimeter",         FeatureOuterWall },
+    { "overhang perimeter",         FeatureOuterWall },
+    { "perimeter",                  FeatureInnerWall },
+    { "internal infill",            FeatureInfill },
+    { "solid infill",               FeatureSkin },
+    { "top solid infill",           FeatureSkin },
+    { "ironing",                    FeatureSkin },
+    { "bridge infill",              FeatureBridge },
+    { "internal bridge infill",     FeatureBridge },
+    { "gap fill",                   FeatureInnerWall },
+    { "skirt/brim",                 FeatureSkirt },
+    { "skirt",                      FeatureSkirt },
+    { "brim",                       FeatureSkirt },
+    { "support material",           FeatureSupport },
+    { "support material interface", FeatureSupportInterface },
+    { "wipe tower",                 FeaturePrimeTower },
+};
+
+GCodeFeature featureFromType(const std::string &type)
+{
+    std::string key;
+    for (size_t i = 0; i < type.size(); ++i)
+        key += (char)tolower((unsigned char)type[i]);
+    while (!key.empty() && isspace((unsigned char)key[key.size() - 1]))
+        key.erase(key.size() - 1);
+
+    for (size_t i = 0; i < sizeof(FEATURE_TYPES) / sizeof(*FEATURE_TYPES); ++i) {
+        if (key == FEATURE_TYPES[i].type)
+            return FEATURE_TYPES[i].feature;
+    }
+    return FeatureOther;
+}
+
+const char *featureName(int feature)
+{
+    return FEATURES[feature].name;
+}
+
+const float *featureColor(int feature)
+{
+    return FEATURES[feature].color;
+}
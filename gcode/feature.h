@@ -0,0 +1,44 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef FEATURE_H
+#define FEATURE_H
+
+#include <string>
+
+//! What an extrusion prints, from the ;TYPE: annotations of the slicer.
+//! Stored in one byte per move, see GCodeLine::feature.
+enum GCodeFeature
+{
+    FeatureNone,        // no annotation, drawn in the model color
+    FeatureOuterWall,
+    FeatureInnerWall,
+    FeatureSkin,        // solid top and bottom layers
+    FeatureInfill,
+    FeatureBridge,
+    FeatureSupport,
+    FeatureSupportInterface,
+    FeatureSkirt,       // skirt and brim
+    FeaturePrimeTower,
+    FeatureOther,
+    FeatureCount
+};
+
+//! Maps the text after ;TYPE: (Cura, PrusaSlicer/Slic3r, SuperSlicer) to a feature.
+GCodeFeature featureFromType(const std::string &type);
+const char *featureName(int feature);
+const float *featureColor(int feature);   // rgb
+
+#endif // FEATURE_H
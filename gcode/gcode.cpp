@@ -19,19 +19,54 @@ along with BoostComPort.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "gcode.h"
-#include <fstream>
+#include "arc.h"
+#include "simplify.h"
+#include "frustum.h"
+#include "loadprogress.h"
+#include "parsenumber.h"
+#include "decompressdevice.h"
+#include "bgcode.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <QString>
+#include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
 #include <QtOpenGL>
 
 #define gPushTriangleToList(v1, v2, v3) m_tubeVertices.push_back(v1);\
                                      m_tubeVertices.push_back(v2);\
                                      m_tubeVertices.push_back(v3);
 
-#define VectorOutput(m, v) qDebug() << QString(QString(m) + "x(%1), y(%2), z(%3)").arg(v.x()).arg(v.y()).arg(v.z());
+// deviation (mm) allowed by each level of detail, from fine to coarse. Level 0 only drops
+// collinear points and is used for the complete layers when zoomed in.
+static const float LOD_TOLERANCES[] = { 0.f, 0.05f, 0.2f, 0.8f, 3.2f };
 
 GCode::GCode()
+    : showLayers(0)
+    , m_firstLayer(0)
+    , m_arcUse(0)
+    , m_lodTolerance(0)
+    , m_tiles(1)
+    , m_tileX(0)
+    , m_tileY(0)
+    , m_tileSize(CHUNK_TILE_SIZE)
+    , m_tubeColorStamp(-1)
+    , m_colorMode(ColorByFeature)
+    , m_colorMin(0)
+    , m_colorMax(1)
+    , m_colorStamp(0)
+    , m_moveColorStamp(-1)
+    , m_compactNormalError(0)
+    , m_occupancyQuery(-1)
+    , m_tubesSkipped(false)
 {
+    for (int i = 0; i < FeatureCount; ++i) {
+        m_featureVisible[i] = true;
+        m_featureMoves[i] = 0;
+    }
 	
 }
 
@@ -42,20 +77,70 @@ GCode::~GCode()
 
 void GCode::draw(bool linesOnly, bool showMotion)
 {
-    if (linesOnly) {
+    PROFILE_SCOPE("GCode::draw");
+    if (linesOnly || m_tubesSkipped) {
         glPushMatrix();
         float oldx = 0, oldy = 0, oldz = 0;
-        glBegin(GL_LINES);
         float minusX = maxX * 0.5;
         float minusY = maxY * 0.5;
-        for(unsigned int i = 0; i < showLayers/*codeLines.size()*/; i++) {
+        const int firstLayer = qMin(m_firstLayer, layerCount());
+        unsigned int firstLine = firstLayer < m_layerFirstLine.size() ? m_layerFirstLine.at(firstLayer) : 0;
+        unsigned int lastLine = qMin<unsigned int>(showLayers, codeLines.size());
+        const bool heatmap = m_colorMode != ColorByFeature;
+        if (heatmap)
+            updateMoveColors();
+
+        // complete layers come from the (simplified) paths of the visible chunks,
+        // only the partially shown layer is drawn move by move.
+        const int level = lodLevel();
+        if (level >= 0 && lastLine > firstLine) {
+            const int layer = std::upper_bound(m_layerFirstLine.begin(), m_layerFirstLine.end(), lastLine)
+                              - m_layerFirstLine.begin() - 1;
+
+            GCodeLineSet &lines = m_lodLevels[level];
+            glEnableClientState(GL_VERTEX_ARRAY);
+            if (heatmap) {
+                updateSetColors(lines);
+                glEnableClientState(GL_COLOR_ARRAY);
+                glColorPointer(4, GL_UNSIGNED_BYTE, 0, lines.colors.constData());
+            }
+            for (int feature = 0; feature < FeatureCount; ++feature) {
+                if (!m_featureVisible[feature])
+                    continue;
+                if (!heatmap)
+                    glColor3fv(featureColor(feature));
+                drawLines(lines, level, m_chunks, feature, firstLayer, layer);
+            }
+            if (heatmap)
+                glDisableClientState(GL_COLOR_ARRAY);
+            if (showMotion) {
+                glColor3f(0.91, 0.24, 0.1);
+                drawLines(m_travel, travelSlot(), m_travelChunks, 0, firstLayer, layer);
+            }
+            glDisableClientState(GL_VERTEX_ARRAY);
+
+            firstLine = qMax(firstLine, m_layerFirstLine.at(layer));
+        }
+        if (firstLine > 0 && firstLine < lastLine) {
+            oldx = codeLines[firstLine-1].x - minusX;
+            oldy = codeLines[firstLine-1].y - minusY;
+            oldz = codeLines[firstLine-1].z;
+        }
+
+        glBegin(GL_LINES);
+        for(unsigned int i = firstLine; i < lastLine/*codeLines.size()*/; i++) {
 
-            if(codeLines[i].command == "G1") { // draw a line
+            if(!codeLines[i].isArc) { // draw a line
 
                 if(codeLines[i].hasE && codeLines[i].hasXYZ) {
-                    glColor3f(0.11, 0.15, 0.5);
-                    glVertex3f(oldx, oldz, oldy);
-                    glVertex3f((codeLines[i].x-minusX), codeLines[i].z, codeLines[i].y-minusY);
+                    if (m_featureVisible[codeLines[i].feature]) {
+                        if (heatmap)
+                            glColor4ubv((const GLubyte *)&m_moveColors.at(i));
+                        else
+                            glColor3fv(featureColor(codeLines[i].feature));
+                        glVertex3f(oldx, oldz, oldy);
+                        glVertex3f((codeLines[i].x-minusX), codeLines[i].z, codeLines[i].y-minusY);
+                    }
                     oldx = codeLines[i].x - minusX;
                     oldy = codeLines[i].y - minusY;
                     oldz = codeLines[i].z;
@@ -69,6 +154,28 @@ void GCode::draw(bool linesOnly, bool showMotion)
                     oldy = codeLines[i].y - minusY;
                     oldz = codeLines[i].z;
                 }
+            } else if (codeLines[i].isArc && codeLines[i].hasXYZ) { // draw the chords of an arc
+                if (codeLines[i].hasE ? m_featureVisible[codeLines[i].feature] : showMotion) {
+                    if (codeLines[i].hasE && heatmap)
+                        glColor4ubv((const GLubyte *)&m_moveColors.at(i));
+                    else if (codeLines[i].hasE)
+                        glColor3fv(featureColor(codeLines[i].feature));
+                    else
+                        glColor3f(0.91, 0.24, 0.1);
+
+                    int count;
+                    const QVector3D *points = arcPoints(i, count);
+                    for (int j = 0; j < count; ++j) {
+                        glVertex3f(oldx, oldz, oldy);
+                        glVertex3f(points[j].x()-minusX, points[j].z(), points[j].y()-minusY);
+                        oldx = points[j].x() - minusX;
+                        oldy = points[j].y() - minusY;
+                        oldz = points[j].z();
+                    }
+                }
+                oldx = codeLines[i].x - minusX;
+                oldy = codeLines[i].y - minusY;
+                oldz = codeLines[i].z;
             }
         }
 
@@ -84,10 +191,60 @@ void GCode::draw(bool linesOnly, bool showMotion)
         glEnableClientState(GL_VERTEX_ARRAY);
         glEnableClientState(GL_NORMAL_ARRAY);
 
-        glVertexPointer(3, GL_FLOAT, 0, (float *)m_tubeVertices.data());
-        glNormalPointer(GL_FLOAT, 0, (float *)m_tubeNormals.data());
-        glDrawElements(GL_TRIANGLES, m_tubeIndices.size(), GL_UNSIGNED_INT, m_tubeIndices.data());
+        const bool compact = !m_compactTube.isEmpty();
+        if (compact) {
+            m_compactTube.pushTransform();
+            glEnable(GL_NORMALIZE);
+            glVertexPointer(3, GL_SHORT, COMPACT_POSITION_STRIDE,
+                            m_buffers.bind(tubeSlot(), GL_ARRAY_BUFFER, m_compactTube.data.constData()));
+            glNormalPointer(GL_BYTE, COMPACT_NORMAL_STRIDE,
+                            m_buffers.bind(tubeSlot() + 1, GL_ARRAY_BUFFER, m_compactTubeNormals.constData()));
+        } else {
+            glVertexPointer(3, GL_FLOAT, 0, m_buffers.bind(tubeSlot(), GL_ARRAY_BUFFER, m_tubeVertices.constData()));
+            glNormalPointer(GL_FLOAT, 0, m_buffers.bind(tubeSlot() + 1, GL_ARRAY_BUFFER, m_tubeNormals.constData()));
+        }
+        m_buffers.unbind();
+        const bool shortIndices = !m_compactTubeIndices.isEmpty();
+        const GLenum indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        const int indexSize = shortIndices ? sizeof(quint16) : sizeof(int);
+        const char *indices = (const char *)m_buffers.bind(tubeSlot() + 2, GL_ELEMENT_ARRAY_BUFFER,
+                shortIndices ? (const void *)m_compactTubeIndices.constData() : (const void *)m_tubeIndices.constData());
+        const bool heatmap = m_colorMode != ColorByFeature;
+        if (heatmap) {
+            if (m_tubeColorStamp != m_colorStamp) {
+                updateMoveColors();
+                m_tubeColors.resize(m_tubeVertices.size());
+                for (int i = 0; i < m_tubeMoves.size(); ++i) {
+                    const unsigned int color = m_moveColors.at(m_tubeMoves.at(i));
+                    m_tubeColors[i * 3] = m_tubeColors[i * 3 + 1] = m_tubeColors[i * 3 + 2] = color;
+                }
+                m_tubeColorStamp = m_colorStamp;
+            }
+            glEnableClientState(GL_COLOR_ARRAY);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, m_tubeColors.constData());
+        }
+        // tubes are only cut at layer boundaries, a partially shown layer is drawn whole
+        int firstLayer, lastLayer;
+        shownLayers(firstLayer, lastLayer);
+        QVector<QPair<int, int> > ranges;
+        for (int feature = 0; feature < FeatureCount && !m_tubeOffsets.isEmpty(); ++feature) {
+            if (!m_featureVisible[feature])
+                continue;
+            // tubes without annotation keep the model color
+            if (feature != FeatureNone && !heatmap)
+                glColor3fv(featureColor(feature));
+            visibleRanges(m_tubeOffsets.constData() + feature * chunkSlots(), m_chunks, firstLayer, lastLayer + 1, ranges);
+            for (int i = 0; i < ranges.size(); ++i)
+                glDrawElements(GL_TRIANGLES, ranges.at(i).second, indexType, indices + ranges.at(i).first * indexSize);
+        }
+        m_buffers.unbind();
+        if (compact) {
+            glDisable(GL_NORMALIZE);
+            glPopMatrix();
+        }
 
+        if (heatmap)
+            glDisableClientState(GL_COLOR_ARRAY);
         glDisableClientState(GL_NORMAL_ARRAY);
         glDisableClientState(GL_VERTEX_ARRAY);
 
@@ -97,11 +254,90 @@ void GCode::draw(bool linesOnly, bool showMotion)
         glDisable(GL_LIGHT0);
         glDisable(GL_LIGHTING);
     }
+    drawReference();
+    drawDiff();
+    if (m_occupancyQuery >= 0 && m_occupancyCells.layers.size() == layerCount() + 1) {
+        int firstLayer, lastLayer;
+        shownLayers(firstLayer, lastLayer);
+        if (firstLayer <= lastLayer) {
+            static const float colors[OccupancyQueryCount][3] = { { 1.0, 0.55, 0.1 }, { 0.9, 0.2, 0.8 }, { 0.2, 0.45, 1.0 } };
+            glColor3fv(colors[m_occupancyQuery]);
+            glEnableClientState(GL_VERTEX_ARRAY);
+            drawCells(m_occupancyCells, firstLayer, lastLayer);
+            glDisableClientState(GL_VERTEX_ARRAY);
+        }
+    }
+}
+
+// lines of the file, the device is rewound afterwards.
+// Lines GCode::addLine() will keep: G0/G1 with X, Y or Z and G2/G3 with a center (I, J or R).
+// Comments, other commands, retracts and feedrate changes take no code line.
+static size_t countMoves(QIODevice &file)
+{
+    enum { LineStart, Command, Number, Words, Skip } state = LineStart;
+    static const int BLOCK_SIZE = 1 << 20;
+    vector<char> block(BLOCK_SIZE);
+    size_t moves = 0;
+    bool arc = false;
+    qint64 count;
+    while ((count = file.read(&block[0], BLOCK_SIZE)) > 0) {
+        for (qint64 i = 0; i < count; ++i) {
+            const char c = block[i];
+            if (c == '\n') {
+                state = LineStart;
+                continue;
+            }
+            switch (state) {
+            case LineStart:
+                if (c == 'G')
+                    state = Command;
+                else if (c != ' ' && c != '\t')
+                    state = Skip;
+                break;
+            case Command:
+                arc = c == '2' || c == '3';
+                state = arc || c == '1' || c == '0' ? Number : Skip;
+                break;
+            case Number:   // G1 but not G10 or G11
+                state = c == ' ' || c == '\t' ? Words : Skip;
+                break;
+            case Words:
+                if (c == ';') {
+                    state = Skip;
+                } else if (arc ? (c == 'I' || c == 'J' || c == 'R') : (c == 'X' || c == 'Y' || c == 'Z')) {
+                    ++moves;
+                    state = Skip;
+                }
+                break;
+            case Skip:
+                break;
+            }
+        }
+    }
+    file.seek(0);
+    return moves;
+}
+
+// Returns -1 when the file can't be read or progress got canceled, nothing is kept then.
+int GCode::open(string fileName, LoadProgress *progress, qint64 memoryLimit, bool parseOnly)
+{
+    // compressed files are decompressed on the fly, see openInput()
+    QScopedPointer<QIODevice> inFile(openInput(QString::fromStdString(fileName)));
+    if (!inFile)
+        return -1;
+    return open(*inFile, fileName, progress, memoryLimit, parseOnly);
 }
 
-int GCode::open(string fileName)
+int GCode::open(QIODevice &file, string fileName, LoadProgress *progress, qint64 memoryLimit, bool parseOnly)
 {
+    PROFILE_SCOPE("GCode::open");
     currentLayer = 0;
+    currentFeature = FeatureNone;
+    lastF = lastE = 0;
+    relativeE = false;
+    for (int i = 0; i < FeatureCount; ++i)
+        m_featureMoves[i] = 0;
+    lastX = lastY = 0;
     lastZ = 0;
     minX =  1000000.0;
     minY =  1000000.0;
@@ -109,131 +345,259 @@ int GCode::open(string fileName)
     maxX = -1000000.0;
     maxY = -1000000.0;
     maxZ = -1000000.0;
-    ifstream inFile(fileName.c_str(), ios::binary);
-    while(!inFile.eof())
-    {
-        char lineBuffer[1000];
-        inFile.getline(lineBuffer, 1000);
-        string line = lineBuffer;
-        addLine(line);
+    m_fileName = fileName;
+    if (progress)
+        progress->setPhase(LoadProgress::Reading, inputSize(&file));
+    const bool read = BGCodeReader::isBinaryGCode(file) ? readBinary(file, progress)
+                                                        : readText(file, progress);
+    if (read && inputFailed(&file))
+        qWarning() << Q_FUNC_INFO << file.errorString();
+    if (!read || inputFailed(&file)) {
+        clear();
+        return -1;
     }
-//    refreshMinMax();
-    recomputeAll();
+    buildLayerIndex();
+    if (parseOnly)
+        return 0;
+    setupChunks();
+    recomputeAll(progress, memoryLimit);
+    if (!(progress && progress->isCanceled()))
+        buildLod(progress);
+    // the tubes and lines hold the chords now, what draws arcs later caches its layers again
+    clearArcCache();
+    if (progress && progress->isCanceled()) {
+        clear();
+        return -1;
+    }
+
+    // new data, the heatmap range follows it
+    ++m_colorStamp;
+    if (m_colorMode != ColorByFeature)
+        dataRange(m_colorMode, m_colorMin, m_colorMax);
 
 	return 0;
 }
 
+// false when progress got canceled
+bool GCode::readText(QIODevice &file, LoadProgress *progress)
+{
+    PROFILE_SCOPE("GCode::readText");
+    // count first, codeLines is allocated once instead of growing (and copying) as it fills.
+    // That takes a second pass, only worth it if the file needs no decompressing.
+    if (!file.isSequential())
+        codeLines.reserve(codeLines.size() + countMoves(file));
+    // read a block at a time, the lines are parsed where they are
+    static const int BLOCK_SIZE = 1 << 20;
+    QByteArray rest;       // a line continued in the next block
+    int lineNumber = 0;
+    long long offset = 0;  // of rest
+    while (!file.atEnd()) {
+        const QByteArray block = file.read(BLOCK_SIZE);
+        if (block.isEmpty())   // a read error, the caller checks the device
+            break;
+        const QByteArray text = rest + block;
+        int start = 0;
+        for (int end; (end = text.indexOf('\n', start)) >= 0; start = end + 1) {
+            addLine(text.constData() + start, text.constData() + end, offset + start, ++lineNumber);
+            if (progress && lineNumber % LOAD_POLL_INTERVAL == 0) {
+                progress->step(inputPos(&file));
+                if (progress->isCanceled())
+                    return false;
+            }
+        }
+        rest = text.mid(start);
+        offset += start;
+    }
+    if (!rest.isEmpty())
+        addLine(rest.constData(), rest.constData() + rest.size(), offset, ++lineNumber);
+    return true;
+}
+
+// Binary G-code, decoded in parallel batches of blocks. Offsets are into the decoded text.
+// False when progress got canceled or the file is broken, a part of a toolpath is not kept.
+bool GCode::readBinary(QIODevice &file, LoadProgress *progress)
+{
+    PROFILE_SCOPE("GCode::readBinary");
+    BGCodeReader reader(&file);
+    if (!reader.readHeader())
+        return false;
+
+    QVector<QByteArray> texts;
+    QByteArray rest;       // a line continued in the next block
+    int lineNumber = 0;
+    long long offset = 0;
+    while (reader.readGCode(texts, BGCODE_BATCH_BLOCKS)) {
+        for (int i = 0; i < texts.size(); ++i) {
+            const QByteArray text = rest + texts.at(i);
+            int start = 0;
+            for (int end; (end = text.indexOf('\n', start)) >= 0; start = end + 1) {
+                addLine(text.constData() + start, text.constData() + end, offset + start, ++lineNumber);
+                if (progress && lineNumber % LOAD_POLL_INTERVAL == 0) {
+                    progress->step(inputPos(&file));
+                    if (progress->isCanceled())
+                        return false;
+                }
+            }
+            rest = text.mid(start);
+            offset += start;
+        }
+    }
+    if (reader.hasError())   // a checksum or block that did not decode, the reader said which
+        return false;
+    if (!rest.isEmpty())
+        addLine(rest.constData(), rest.constData() + rest.size(), offset, ++lineNumber);
+    return true;
+}
+
 void GCode::clear()
 {
 	codeLines.clear();
+    m_layerFirstLine.clear();
+    m_arcLayers.clear();
+    m_arcCached.clear();
+    m_lodLevels.clear();
+    m_travel.vertices.clear();
+    m_travel.offsets.clear();
+    m_chunks.clear();
+    m_travelChunks.clear();
+    m_firstLayer = 0;
+    m_tubeVertices.clear();
+    m_tubeNormals.clear();
+    m_tubeIndices.clear();
+    m_prevFacet.clear();
+    m_tubeOffsets.clear();
+    m_tubeMoves.clear();
+    m_tubeColors.clear();
+    m_moveColors.clear();
+    for (int i = 0; i < ColorModeCount; ++i)
+        m_moveScalars[i] = GCodeScalars();
+    ++m_colorStamp;
+    m_pickGrids.clear();
+    m_buffers.clear();
+    setCompactVertices(false);
+    clearReference();
+    clearDiff();
+    m_occupancy.clear();
+    m_occupancyCells = GCodeCells();
+    m_occupancyQuery = -1;
+    m_tubesSkipped = false;
 }
 
-int GCode::addLine(string line)
+// true if the word [begin, end) is command, e.g. "G1" (and not "G10")
+static inline bool isCommand(const char *begin, const char *end, const char *command)
 {
-	GCodeLine codeLine;
-    codeLine.originalLine = line;
-    string clearedLine = line;
-	// search for comments and remove them
-	size_t pos;
-    if((pos = clearedLine.find(";")) != string::npos)
-        clearedLine = clearedLine.substr(0, pos);
-	
-	// remove leading whitespaces
-    while(clearedLine.length() && (clearedLine[0] == ' ' || clearedLine[0] == '\t'))
-        clearedLine = clearedLine.substr(1, clearedLine.length()-1);
-	
-	// remove whitespaces at the end
-    while(clearedLine.length() && (clearedLine[clearedLine.length()-1] == ' ' || clearedLine[clearedLine.length()-1] == '\t'))
-        clearedLine = clearedLine.substr(0, clearedLine.length()-1);
-	
-	// replace tabs with spaces
-	replace(clearedLine, "\t", " ");
-	
-	// remove double spaces
-    while(clearedLine.find("  ") != string::npos)
-		replace(clearedLine, "  ", " ");
-	
-//    qDebug() << "=============== new Line =============";
-    qDebug() << QString::fromUtf8(clearedLine.c_str());
-    if(clearedLine.length() <= 1) { // nothing to execute
-        codeLine.interprete = false;
-        codeLine.command = "";
-    } else {
-        // start parsing...
-        codeLine.interprete = true;
-		
-        // separate line to words.
-		vector<string> words;
-		explode(words, clearedLine, " ");
-
-        if(words.size() != 0) {
-            codeLine.hasE = codeLine.hasXYZ = false;
-            codeLine.command = words[0];
-            codeLine.x = codeLine.y = codeLine.z = codeLine.e = codeLine.f = 0.f;
-//            qDebug() << "command : " << QString::fromUtf8(words[0].c_str());
-            // iterator words, e.g. 'G1' 'X89' 'Y40'
-            for(unsigned int i = 1; i < words.size(); ++i) { // get each parameter
-
-                if(words[i].length() == 0)
-					continue;
-
-                string strValue = words[i].substr(1, words[i].length()-1);
-                parseLine(codeLine, words[i][0], strValue);
-			}
-
-//            qDebug() << QString("[%1] X(%2), Y(%3), Z(%4), E(%5), F(%6), hasE(%7), hasXYZ(%8)")
-//                        .arg(currentLayer)
-//                        .arg(codeLine.x).arg(codeLine.y).arg(codeLine.z)
-//                        .arg(codeLine.e).arg(codeLine.f).arg(codeLine.hasE)
-//                        .arg(codeLine.hasXYZ);
-
-            if(codeLine.command == "G1" && codeLine.hasE && codeLine.hasXYZ) {
-                if(codeLine.x < minX)
-                    minX = codeLine.x;
-                if(codeLine.x > maxX)
-                    maxX = codeLine.x;
-                if(codeLine.y < minY)
-                    minY = codeLine.y;
-                if(codeLine.y > maxY)
-                    maxY = codeLine.y;
-                if(codeLine.z < minZ)
-                    minZ = codeLine.z;
-                if(codeLine.z > maxZ)
-                    maxZ = codeLine.z;
-
-//                qDebug() << QString("minX(%1), maxX(%2), minY(%3), maxY(%4), minZ(%5), maxZ(%6)")
-//                            .arg(minX).arg(maxX).arg(minY).arg(maxY).arg(minZ).arg(maxZ) ;
-            }
+    const size_t length = strlen(command);
+    return size_t(end - begin) == length && memcmp(begin, command, length) == 0;
+}
 
-            codeLine.layer = currentLayer;
-		}
-	}
+// Tokenized in place: the command, then words of a letter and a number, e.g. 'G1' 'X89' 'Y40'.
+int GCode::addLine(const char *begin, const char *end, long long offset, int lineNumber)
+{
+    // search for comments and remove them
+    const char *comment = static_cast<const char *>(memchr(begin, ';', end - begin));
+    if (comment) {
+        // slicer annotation of the following moves, e.g. ;TYPE:WALL-OUTER
+        if (end - comment >= 6 && memcmp(comment, ";TYPE:", 6) == 0)
+            currentFeature = featureFromType(string(comment + 6, end));
+        end = comment;
+    }
 
-    codeLine.clearedLine = clearedLine;
-    if(codeLine.command == "G1" && codeLine.hasXYZ) {
+    const char *command = skipSpaces(begin, end);
+    const char *commandEnd = skipWord(command, end);
+    if (command == end)   // nothing to execute
+        return 0;
+
+    GCodeLine codeLine;
+    codeLine.offset = offset;
+    codeLine.lineNumber = lineNumber;
+    codeLine.hasE = codeLine.hasXYZ = false;
+    codeLine.x = codeLine.y = codeLine.z = codeLine.e = codeLine.de = 0.f;
+    codeLine.f = lastF;
+    codeLine.i = codeLine.j = 0.f;
+    codeLine.hasR = false;
+    // G0 travels are kept as moves without E, an arc after one starts where it ended.
+    const bool linear = isCommand(command, commandEnd, "G1") || isCommand(command, commandEnd, "G0");
+    codeLine.clockwise = isCommand(command, commandEnd, "G2");
+    codeLine.isArc = codeLine.clockwise || isCommand(command, commandEnd, "G3");
+    // omitted axes keep the current position, e.g. 'G1 X10' or 'G2 I10', a full circle.
+    codeLine.x = lastX;
+    codeLine.y = lastY;
+    codeLine.z = lastZ;
+    int words = 0;
+    for (const char *at = skipSpaces(commandEnd, end); at != end; ++words) {
+        const char *wordEnd = skipWord(at, end);
+        float value;
+        parseFloat(at + 1, wordEnd, value);
+        parseLine(codeLine, *at, value);
+        at = skipSpaces(wordEnd, end);
+    }
+
+    if (codeLine.isArc) {
+        if (codeLine.hasR || codeLine.i != 0 || codeLine.j != 0)
+            codeLine.hasXYZ = true;
+        else // no center given, firmware would reject it. draw it as a straight move.
+            codeLine.isArc = false;
+    }
+
+    if((linear || codeLine.isArc) && codeLine.hasE && codeLine.hasXYZ) {
+        if(codeLine.x < minX)
+            minX = codeLine.x;
+        if(codeLine.x > maxX)
+            maxX = codeLine.x;
+        if(codeLine.y < minY)
+            minY = codeLine.y;
+        if(codeLine.y > maxY)
+            maxY = codeLine.y;
+        if(codeLine.z < minZ)
+            minZ = codeLine.z;
+        if(codeLine.z > maxZ)
+            maxZ = codeLine.z;
+    }
+
+    codeLine.layer = currentLayer;
+    codeLine.feature = currentFeature;
+
+    // extrusion mode and E resets, the filament fed per move is needed for the flow.
+    if (isCommand(command, commandEnd, "M82")) {
+        relativeE = false;
+    } else if (isCommand(command, commandEnd, "M83")) {
+        relativeE = true;
+    } else if (isCommand(command, commandEnd, "G92")) {
+        if (codeLine.hasE || words == 0)
+            lastE = codeLine.e;
+    } else if (codeLine.hasE) {
+        codeLine.de = relativeE ? codeLine.e : codeLine.e - lastE;
+        lastE = relativeE ? lastE + codeLine.e : codeLine.e;
+    }
+
+    if((linear || codeLine.isArc) && codeLine.hasXYZ) {
+        if (codeLine.hasE)
+            ++m_featureMoves[codeLine.feature];
         codeLines.push_back(codeLine);
     }
 
 	return 0;
 }
 
-void GCode::parseLine(GCodeLine &gcodeLine, char command, string value)
+void GCode::parseLine(GCodeLine &gcodeLine, char command, float fValue)
 {
-    float fValue = atof(value.c_str());
     switch(command) {
     case 'X':
         gcodeLine.hasXYZ = true;
         gcodeLine.x = fValue;
         gcodeLine.z = lastZ;
+        lastX = fValue;
         break;
     case 'Y':
         gcodeLine.hasXYZ = true;
         gcodeLine.y = fValue;
         gcodeLine.z = lastZ;
+        lastY = fValue;
         break;
     case 'Z':
 //        qDebug() << QString(">> newZ(%1) vs. lastZ(%2) << ").arg(fValue).arg(lastZ);
 
+        gcodeLine.z = fValue;
         if (fValue != lastZ) {
             lastZ = fValue;
             currentLayer++;
@@ -245,144 +609,32 @@ void GCode::parseLine(GCodeLine &gcodeLine, char command, string value)
         break;
     case 'F':
         gcodeLine.f = fValue;
+        lastF = fValue;
+        break;
+    case 'I':
+        gcodeLine.i = fValue;
+        break;
+    case 'J':
+        gcodeLine.j = fValue;
+        break;
+    case 'R':
+        gcodeLine.hasR = true;
+        gcodeLine.i = fValue;
         break;
     }
 }
 
-void GCode::refreshMinMax()
-{
-    qDebug() << "============== iterator ===============";
-    float oldx = 0, oldy = 0, oldz = 0;    
-    float minusX = maxX * 0.5;
-    float minusY = maxY * 0.5;
-    for(unsigned int i = 0; i < codeLines.size(); i++) {
-
-        if(codeLines[i].command == "G1") { // draw a line
-            qDebug() << QString::fromUtf8(codeLines[i].clearedLine.c_str());
-            if(codeLines[i].hasE && codeLines[i].hasXYZ) {
-                qDebug() << QString("[1] oldx(%1), oldy(%2), oldz(%3)").arg(oldx).arg(oldy).arg(oldz);
-                qDebug() << QString("[1] x(%1), y(%2), z(%3)").arg(codeLines[i].x-minusX).arg(codeLines[i].y-minusY).arg(codeLines[i].z);
-                oldx = codeLines[i].x - minusX;
-                oldy = codeLines[i].y - minusY;
-                oldz = codeLines[i].z;
-
-            } else if(codeLines[i].hasXYZ) {
-
-                oldx = codeLines[i].x - minusX;
-                oldy = codeLines[i].y - minusY;
-                oldz = codeLines[i].z;
-                qDebug() << QString("[2] x(%1), y(%2), z(%3)").arg(oldx).arg(oldy).arg(oldz);
-            }
-        }
-    }
-    qDebug() << "============== end ===============";
-
-    /*
-    for(unsigned int i = 0; i < codeLines.size(); i++) {
-
-        if(codeLines[i].command == "G1") { // draw a line
-
-            if(codeLines[i].hasE && codeLines[i].hasXYZ) {
-                qDebug() << QString::fromUtf8((codeLines[i].clearedLine).c_str());
-                qDebug() << QString("x(%1), y(%2), z(%3)").arg(codeLines[i].x).arg(codeLines[i].y).arg(codeLines[i].z);
-            }
-        }
-    }
-
-    minX =  1000000.0;
-    minY =  1000000.0;
-    minZ =  1000000.0;
-    maxX = -1000000.0;
-    maxY = -1000000.0;
-    maxZ = -1000000.0;
-    float x = 20, y = 20, z = 5;
-    for(unsigned int i = 0; i < codeLines.size(); i++)
-	{
-        bool hasE = false;
-        bool hasXYZ = false;
-        for(unsigned int j = 0; j<codeLines[i].parameters.size(); j++)
-		{
-			switch(codeLines[i].parameters[j].name)
-			{
-			case 'X':
-                x = codeLines[i].parameters[j].value;
-                hasXYZ = true;
-				break;
-			case 'Y':
-                y = codeLines[i].parameters[j].value;
-                hasXYZ = true;
-				break;
-			case 'Z':
-                z = codeLines[i].parameters[j].value;
-                hasXYZ = true;
-				break;
-			case 'E':
-                hasE = true;
-				break;
-			}
-		}
-        if(codeLines[i].command == "G1" && hasE && hasXYZ) {
-            if(x < minX)
-                minX = x;
-            if(x > maxX)
-                maxX = x;
-            if(y < minY)
-                minY = y;
-            if(y > maxY)
-                maxY = y;
-            if(z < minZ)
-                minZ = z;
-            if(z > maxZ)
-                maxZ = z;
-		}
-	}
-    */
-	//cout<<"Min: "<<minX<<"/"<<minY<<"/"<<minZ<<endl;
-	//cout<<"Max: "<<maxX<<"/"<<maxY<<"/"<<maxZ<<endl;
-}
-
-void GCode::replace(string& replace, string from, string to)
-{
-	size_t pos;
-    while((pos = replace.find(from)) != string::npos)
-		replace.replace(pos, from.length(), to);
-}
-
-void GCode::explode(vector<string> &res, string &list, string expression)
-{
-    if(list.length() < 1)
-		return;
-
-    size_t posStart = 0, posEnd;
-	while(1)
-	{
-        // separate by space
-        posEnd = list.find(expression, posStart);
-        if(posEnd == string::npos)
-			break;
-        string line = list.substr(posStart, posEnd - posStart);
-//        qDebug() << Q_FUNC_INFO << QString::fromUtf8(line.c_str());
-
-        if(line.length() > 0)
-			res.push_back(line);
-        posStart = posEnd + expression.length();
-	}
-    string line = list.substr(posStart, posEnd-posStart);
-    if(line.length() > 0)
-		res.push_back(line);
-}
-
 vector<GCodeLine>& GCode::getCodeLines()
 {
 	return codeLines;
 }
 
-float GCode::getMinX() { if(minX != minX) return 0; else return minX; }
-float GCode::getMinY() { if(minY != minY) return 0; else return minY; }
-float GCode::getMinZ() { if(minZ != minZ) return 0; else return minZ; }
-float GCode::getMaxX() { if(maxX != maxX) return 0; else return maxX; }
-float GCode::getMaxY() { if(maxY != maxY) return 0; else return maxY; }
-float GCode::getMaxZ() { if(maxZ != maxZ) return 0; else return maxZ; }
+float GCode::getMinX() const { if(minX != minX) return 0; else return minX; }
+float GCode::getMinY() const { if(minY != minY) return 0; else return minY; }
+float GCode::getMinZ() const { if(minZ != minZ) return 0; else return minZ; }
+float GCode::getMaxX() const { if(maxX != maxX) return 0; else return maxX; }
+float GCode::getMaxY() const { if(maxY != maxY) return 0; else return maxY; }
+float GCode::getMaxZ() const { if(maxZ != maxZ) return 0; else return maxZ; }
 
 bool GCode::isOpen() const
 {
@@ -393,39 +645,25 @@ bool GCode::isOpen() const
 // calc perpendicular = http://math.stackexchange.com/questions/995659/given-two-points-find-another-point-a-perpendicular-distance-away-from-the-midp
 //http://stackoverflow.com/questions/7586063/how-to-calculate-the-angle-between-a-line-and-the-horizontal-axis
 
-void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveRearFacet = false, float radius = 0.27)
+void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveRearFacet = false, float radius = TUBE_RADIUS)
 {
-    qDebug() << "#####################";
-    VectorOutput("==> ", p1);
-    VectorOutput("==> ", p2);
-    VectorOutput("==> ", p3);
-    qDebug() << "#####################";
-
     float ratio = radius / sqrt( pow(p1.z() - p2.z(), 2) + pow(p2.x() - p1.x(), 2));
     QVector3D p1p2VertVector((p1.z() - p2.z()) * ratio, p1.y(), (p2.x() - p1.x()) * ratio);
     float shortRadius = (radius * 0.75);
 
     if (saveRearFacet) {
-        qDebug() << "--------↓↓↓ saveRearFacet ↓↓↓-------";
         QVector3D s1(p2.x() + p1p2VertVector.x(), p2.y(), p2.z() + p1p2VertVector.z());
         QVector3D s2(p2.x() - p1p2VertVector.x(), p2.y(), p2.z() - p1p2VertVector.z());
         QVector3D p3Vert1(p2.x(), p2.y() + shortRadius, p2.z());
         QVector3D p3Vert2(p2.x(), p2.y() - shortRadius, p2.z());
 
         //Save rhombus facet of p1
-        VectorOutput("[1-p1]", s1);
-        VectorOutput("[1-p2]", p3Vert1);
-        VectorOutput("[1-p3]", s2);
         gPushTriangleToList(s1, p3Vert1, s2);
 
-        VectorOutput("[2-p1]", s1);
-        VectorOutput("[2-p2]", s2);
-        VectorOutput("[2-p3]", p3Vert2);
         gPushTriangleToList(s1, s2, p3Vert2);
 
         //Save triangles of the 1st tube.
         // 0 - f1, 1 - f2, 2 - p1Vert1, 3 - p1Vert2
-        qDebug() << "m_prevFacet.size => " << m_prevFacet.size();
         if (m_prevFacet.size() == 0) {
             QVector3D f1(p1.x() + p1p2VertVector.x(), p1.y(), p1.z() + p1p2VertVector.z());
             QVector3D f2(p1.x() - p1p2VertVector.x(), p1.y(), p1.z() - p1p2VertVector.z());
@@ -451,9 +689,7 @@ void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveR
             gPushTriangleToList(m_prevFacet.at(1), s2               , p3Vert2);
             gPushTriangleToList(m_prevFacet.at(1), p3Vert2          , m_prevFacet.at(3));
         }
-        qDebug() << "--------↑↑↑ saveRearFacet ↑↑↑-------";
     } else {
-        qDebug() << "--------↓↓↓ calc half-angle vector ↓↓↓-------";
         // calculcate half-angle vector.
         QVector3D d1Vector = p1 - p2;
         QVector3D d2Vector = p3 - p2;
@@ -484,15 +720,12 @@ void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveR
         float kValueDirection = d1Vector.x() * d2Vector.z() - d2Vector.x() * d1Vector.z();
         QVector3D k1, k2;
         if (kValueDirection > 0) {
-            qDebug() << "kValue is greater than 0!";
             k1 = QVector3D(p2.x() - d3Radius * d3Vector.x(), p2.y(), p2.z() - d3Radius * d3Vector.z());
             k2 = QVector3D(p2.x() + d3Radius * d3Vector.x(), p2.y(), p2.z() + d3Radius * d3Vector.z());
         } else if (kValueDirection < 0) {
-            qDebug() << "kValue is less than 0!";
             k1 = QVector3D(p2.x() + d3Radius * d3Vector.x(), p2.y(), p2.z() + d3Radius * d3Vector.z());
             k2 = QVector3D(p2.x() - d3Radius * d3Vector.x(), p2.y(), p2.z() - d3Radius * d3Vector.z());
         } else {
-            qDebug() << "kValue equals to 0!";
             //This could be parallel.
             k1 = QVector3D(p2.x() + p1p2VertVector.x(), p2.y(), p2.z() + p1p2VertVector.z());
             k2 = QVector3D(p2.x() - p1p2VertVector.x(), p2.y(), p2.z() - p1p2VertVector.z());
@@ -523,7 +756,6 @@ void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveR
 
         // draw 1st tube
         if (!m_prevFacet.size()) {
-            qDebug() << "###>> No previous facet!";
 
             //Save rhombus facet of p1 if m_prevFacet
             gPushTriangleToList(f1, p1Vert1, f2);
@@ -539,7 +771,6 @@ void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveR
             gPushTriangleToList(f2, p2Vert2, p1Vert2);
 
         } else {
-            qDebug() << "###>> Got previous facet!";
             //Save triangles of the 1st tube.
             // 0 - f1, 1 - f2, 2 - p1Vert1, 3 - p1Vert2
             gPushTriangleToList(m_prevFacet.at(0), k1               , p2Vert1);
@@ -558,23 +789,88 @@ void GCode::generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveR
         m_prevFacet.push_back(k2);
         m_prevFacet.push_back(p2Vert1);
         m_prevFacet.push_back(p2Vert2);
-        qDebug() << "--------↑↑↑ calc half-angle vector ↑↑↑-------";
     }
 }
 
 
-void GCode::recomputeAll()
+void GCode::recomputeAll(LoadProgress *progress, qint64 memoryLimit)
 {
-    qDebug() << Q_FUNC_INFO;
+    PROFILE_SCOPE("GCode::recomputeAll");
     float oldx = 0, oldy = 0, oldz = 0;
     float minusX = maxX * 0.5;
     float minusY = maxY * 0.5;
-    qDebug() << "codeLines size => " << codeLines.size();
-    qDebug() << "minusX => " << minusX << " / minusY => " << minusY;
+    QVector<int> triangleSlots, triangleLines;
+
+    // count first, so the tube arrays are allocated once: every tube is 8 triangles,
+    // plus 2 for each cap at the ends of a run of extrusions.
+    int tubes = 0, runs = 0;
+    bool extruding = false;
+    for (unsigned int i = 0; i < codeLines.size(); i++) {
+        const GCodeLine &line = codeLines[i];
+        if (line.hasE && line.hasXYZ) {
+            int count = 1;
+            if (line.isArc)
+                count = arcSegmentCount(i);
+            tubes += count;
+            if (!extruding)
+                ++runs;
+            extruding = true;
+        } else if (line.hasXYZ) {
+            extruding = false;
+        }
+    }
+    const int triangles = tubes * 8 + runs * 4;
+    // per triangle: vertices, normals, indices, heatmap colors, the move and (while sorting) the slot
+    const qint64 tubeBytes = qint64(triangles) * (3 * (2 * sizeof(QVector3D) + 2 * sizeof(int)) + 2 * sizeof(int));
+    if (memoryLimit > 0) {
+        MemoryUsage usage;
+        memoryUsage(usage);
+        if (totalBytes(usage) + tubeBytes > memoryLimit) {
+            qWarning() << Q_FUNC_INFO << "no tubes, they would take" << tubeBytes << "more bytes than the limit of"
+                       << memoryLimit << "allows";
+            m_tubesSkipped = true;
+            return;
+        }
+    }
+    m_tubeVertices.reserve(triangles * 3);
+    triangleSlots.reserve(triangles);
+    triangleLines.reserve(triangles);
+
+    if (progress)
+        progress->setPhase(LoadProgress::Tessellating, codeLines.size());
     for(unsigned int i = 0; i < codeLines.size(); i++) {
+        if (progress && i % LOAD_POLL_INTERVAL == 0) {
+            progress->step(i);
+            if (progress->isCanceled())
+                return;
+        }
+        const int tubeStart = m_tubeVertices.size();
 
-        if(codeLines[i].command == "G1") { // draw a line
-            qDebug() << QString::fromUtf8(codeLines[i].clearedLine.c_str());
+        if(codeLines[i].isArc && codeLines[i].hasE) { // one tube per chord
+            int count;
+            const QVector3D *points = arcPoints(i, count);
+            for (int j = 0; j < count; ++j) {
+                QVector3D a(oldx, oldz, oldy);
+                QVector3D b(points[j].x()-minusX, points[j].z(), points[j].y()-minusY);
+                QVector3D c;
+                bool lastChord = false;
+                if (j + 1 < count) {
+                    c = QVector3D(points[j+1].x()-minusX, points[j+1].z(), points[j+1].y()-minusY);
+                } else if (i + 1 < codeLines.size()) {
+                    c = firstPoint(i + 1, minusX, minusY);
+                    lastChord = !codeLines[i+1].hasE;
+                } else {
+                    lastChord = true;
+                }
+                generateTube(a, b, c, lastChord);
+                oldx = b.x();
+                oldy = b.z();
+                oldz = b.y();
+            }
+            oldx = codeLines[i].x - minusX;
+            oldy = codeLines[i].y - minusY;
+            oldz = codeLines[i].z;
+        } else { // draw a line
             if(codeLines[i].hasE && codeLines[i].hasXYZ) {
 
 //                qDebug() << QString("[1] oldx(%1), oldy(%2), oldz(%3)").arg(oldx).arg(oldy).arg(oldz);
@@ -587,7 +883,7 @@ void GCode::recomputeAll()
 //                    qDebug() << "↓↓ Within size ↓↓";
                     GCodeLine nextLine = codeLines[nextIndex];
                     if (nextLine.hasXYZ) {
-                        QVector3D c(nextLine.x-minusX, nextLine.z, nextLine.y-minusY);
+                        QVector3D c = firstPoint(nextIndex, minusX, minusY);
                         if (!nextLine.hasE) { //new position
                             generateTube(a, b, c, true);
                         } else {
@@ -616,16 +912,39 @@ void GCode::recomputeAll()
 //                qDebug() << QString("[2] x(%1), y(%2), z(%3)").arg(oldx).arg(oldy).arg(oldz);
             }
         }
+
+        // the tube triangles of this move belong to the chunk of its end point.
+        if (m_tubeVertices.size() > tubeStart) {
+            const QVector3D end(codeLines[i].x - minusX, codeLines[i].z, codeLines[i].y - minusY);
+            const int slot = chunkSlot(codeLines[i].layer, tileOf(end));
+            for (int j = tubeStart; j < m_tubeVertices.size(); j += 3) {
+                triangleSlots.push_back(codeLines[i].feature * chunkSlots() + slot);
+                triangleLines.push_back(i);
+                for (int k = 0; k < 3; ++k)
+                    growChunk(m_chunks, slot, m_tubeVertices.at(j + k));
+            }
+        }
     }
-    qDebug() << "~~~~~~~~~~~~~~~~~~~~~~\n";
-    m_tubeIndices.resize(m_tubeVertices.size());
     m_tubeNormals.resize(m_tubeVertices.size());
-    for (int i=0; i<m_tubeVertices.size(); i++) {
-        m_tubeIndices[i] = i;
+
+    // index the triangles feature by feature and chunk by chunk (counting sort),
+    // so each of them is one range.
+    m_tubeIndices.resize(m_tubeVertices.size());
+    m_tubeOffsets.fill(0, FeatureCount * chunkSlots() + 1);
+    for (int i = 0; i < triangleSlots.size(); ++i)
+        m_tubeOffsets[triangleSlots.at(i) + 1] += 3;
+    for (int i = 1; i < m_tubeOffsets.size(); ++i)
+        m_tubeOffsets[i] += m_tubeOffsets[i - 1];
+    QVector<int> cursor = m_tubeOffsets;
+    for (int i = 0; i < triangleSlots.size(); ++i) {
+        int &at = cursor[triangleSlots.at(i)];
+        for (int k = 0; k < 3; ++k)
+            m_tubeIndices[at + k] = i * 3 + k;
+        at += 3;
     }
+    m_tubeMoves = triangleLines;
 
     //calculate normals of each face
-    qDebug() << "index size => " << m_tubeIndices.size();
     for (int i = 0; i < m_tubeIndices.size(); i += 3) {
         const QVector3D a = m_tubeVertices.at(m_tubeIndices.at(i));
         const QVector3D b = m_tubeVertices.at(m_tubeIndices.at(i+1));
@@ -636,9 +955,1067 @@ void GCode::recomputeAll()
         for (int j = 0; j < 3; ++j)
             m_tubeNormals[m_tubeIndices.at(i + j)] += normal;
     }
+    qDebug() << Q_FUNC_INFO << codeLines.size() << "lines," << m_tubeIndices.size() / 3 << "tube triangles";
+}
+
+// start of the move at index in scene coordinates, the first chord for arcs.
+QVector3D GCode::firstPoint(unsigned int index, float minusX, float minusY)
+{
+    const GCodeLine &line = codeLines[index];
+    if (line.isArc) {
+        int count;
+        const QVector3D *points = arcPoints(index, count);
+        if (count)
+            return QVector3D(points[0].x()-minusX, points[0].z(), points[0].y()-minusY);
+    }
+    return QVector3D(line.x-minusX, line.z, line.y-minusY);
+}
+
+void GCode::buildLayerIndex()
+{
+    PROFILE_SCOPE("GCode::buildLayerIndex");
+    int layers = codeLines.size() ? codeLines.back().layer + 1 : 0;
+    m_layerFirstLine.resize(layers + 1);
+    unsigned int line = 0;
+    for (int layer = 0; layer <= layers; ++layer) {
+        while (line < codeLines.size() && codeLines[line].layer < layer)
+            ++line;
+        m_layerFirstLine[layer] = line;
+    }
+
+    m_arcLayers.clear();
+    m_arcLayers.resize(layers);
+    m_arcCached.clear();
+    m_pickGrids.clear();
+    m_pickGrids.resize(layers);
+}
+
+// end points and center of the arc at index, false if an R form arc has no center (a line then)
+bool GCode::arcGeometry(unsigned int index, QVector3D &start, QVector3D &end, QVector3D &center) const
+{
+    const GCodeLine &line = codeLines[index];
+    start = QVector3D(0, 0, line.z);
+    if (index > 0)
+        start = QVector3D(codeLines[index-1].x, codeLines[index-1].y, codeLines[index-1].z);
+    end = QVector3D(line.x, line.y, line.z);
+    center = QVector3D(start.x() + line.i, start.y() + line.j, start.z());
+    return !line.hasR || arcCenterFromRadius(start, end, line.i, line.clockwise, center);
+}
+
+// chords of the arc at index, counted from its sagitta without caching its layer
+int GCode::arcSegmentCount(unsigned int index) const
+{
+    QVector3D start, end, center;
+    if (!arcGeometry(index, start, end, center))
+        return 1;
+    return arcSegments(start, end, center, codeLines[index].clockwise);
+}
+
+// Arcs are tessellated a whole layer at a time, the first time any arc of it is needed.
+// At most ARC_CACHE_LAYERS layers are kept, so points of an earlier arcPoints() call may be gone.
+void GCode::cacheArcLayer(int layer)
+{
+    PROFILE_SCOPE("GCode::cacheArcLayer");
+    if (m_arcCached.size() >= ARC_CACHE_LAYERS) {
+        int oldest = 0;
+        for (int i = 1; i < m_arcCached.size(); ++i) {
+            if (m_arcLayers.at(m_arcCached.at(i)).used < m_arcLayers.at(m_arcCached.at(oldest)).used)
+                oldest = i;
+        }
+        GCodeArcLayer &evicted = m_arcLayers[m_arcCached.at(oldest)];
+        evicted.cached = false;
+        evicted.offsets = QVector<int>();
+        evicted.points = QVector<QVector3D>();
+        m_arcCached.remove(oldest);
+    }
+
+    GCodeArcLayer &arcLayer = m_arcLayers[layer];
+    const unsigned int first = m_layerFirstLine[layer];
+    const unsigned int last  = m_layerFirstLine[layer + 1];
+
+    arcLayer.points.clear();
+    arcLayer.offsets.resize(last - first + 1);
+    for (unsigned int i = first; i < last; ++i) {
+        arcLayer.offsets[i - first] = arcLayer.points.size();
+
+        const GCodeLine &line = codeLines[i];
+        if (!line.isArc)
+            continue;
+
+        QVector3D start, end, center;
+        if (!arcGeometry(i, start, end, center)) {
+            arcLayer.points.push_back(end);
+            continue;
+        }
+        tessellateArc(start, end, center, line.clockwise, arcLayer.points);
+    }
+    arcLayer.offsets[last - first] = arcLayer.points.size();
+    arcLayer.points.squeeze();
+    arcLayer.cached = true;
+    m_arcCached.push_back(layer);
+}
+
+// Returns the chord end points of the arc at index, the start point is the previous move.
+const QVector3D *GCode::arcPoints(unsigned int index, int &count)
+{
+    count = 0;
+    const int layer = codeLines[index].layer;
+    if (layer < 0 || layer >= m_arcLayers.size())
+        return 0;
+
+    if (!m_arcLayers[layer].cached)
+        cacheArcLayer(layer);
+
+    GCodeArcLayer &arcLayer = m_arcLayers[layer];
+    arcLayer.used = ++m_arcUse;
+    const int k = index - m_layerFirstLine[layer];
+    count = arcLayer.offsets[k + 1] - arcLayer.offsets[k];
+    return arcLayer.points.constData() + arcLayer.offsets[k];
+}
+
+void GCode::arcChords(unsigned int index, QVector<QVector3D> &points) const
+{
+    QVector3D start, end, center;
+    if (arcGeometry(index, start, end, center))
+        tessellateArc(start, end, center, codeLines[index].clockwise, points);
+    else
+        points.push_back(end);
+}
+
+// extrusion run being collected by GCode::buildLod() and the lines made from it so far
+struct GCodeLodRun
+{
+    QVector<QVector3D> points;   // scene coordinates
+    QVector<int> moves;          // code line of each point
+    QVector<QVector3D> simplified;
+    QVector<int> kept;
+    QVector<QVector<QVector3D> > pairs;   // per level, in file order
+    QVector<QVector<int> > lineSlots;
+    QVector<QVector<int> > pairMoves;
+};
+
+// Simplified copies of the extrusion paths, one per entry of LOD_TOLERANCES.
+// Runs of extrusions never cross a layer so that each layer can be drawn on its own.
+void GCode::buildLod(LoadProgress *progress)
+{
+    PROFILE_SCOPE("GCode::buildLod");
+    const int levels = sizeof(LOD_TOLERANCES) / sizeof(*LOD_TOLERANCES);
+    const int layers = m_layerFirstLine.size() - 1;
+    float minusX = maxX * 0.5;
+    float minusY = maxY * 0.5;
+
+    m_lodLevels.clear();
+    m_lodLevels.resize(levels);
+    for (int level = 0; level < levels; ++level)
+        m_lodLevels[level].tolerance = LOD_TOLERANCES[level];
+    m_travel.tolerance = 0;
+
+    GCodeLodRun run;
+    run.pairs.resize(levels);
+    run.lineSlots.resize(levels);
+    run.pairMoves.resize(levels);
+    QVector<QVector3D> travelPairs;
+    QVector<int> travelSlots;
+
+    QVector3D old(0, 0, 0);
+    int feature = FeatureNone;
+    if (progress)
+        progress->setPhase(LoadProgress::Simplifying, layers);
+    for (int layer = 0; layer < layers; ++layer) {
+        if (progress) {
+            progress->step(layer);
+            if (progress->isCanceled())
+                return;
+        }
+        for (unsigned int i = m_layerFirstLine[layer]; i < m_layerFirstLine[layer + 1]; ++i) {
+            const GCodeLine &line = codeLines[i];
+            const QVector3D end(line.x - minusX, line.z, line.y - minusY);
+            if (line.hasE) {
+                // runs don't cross features either
+                if (line.feature != feature)
+                    appendLodRun(layer, feature, run);
+                feature = line.feature;
+                if (run.points.isEmpty()) {
+                    run.points << old;
+                    run.moves << i;
+                }
+                if (line.isArc) {
+                    int count;
+                    const QVector3D *points = arcPoints(i, count);
+                    for (int j = 0; j < count; ++j) {
+                        run.points << QVector3D(points[j].x() - minusX, points[j].z(), points[j].y() - minusY);
+                        run.moves << i;
+                    }
+                } else {
+                    run.points << end;
+                    run.moves << i;
+                }
+            } else {
+                appendLodRun(layer, feature, run);
+                travelPairs << old << end;
+                travelSlots << chunkSlot(layer, tileOf(end));
+            }
+            old = end;
+        }
+        appendLodRun(layer, feature, run);
+    }
+
+    for (int level = 0; level < levels; ++level) {
+        sortLines(run.pairs.at(level), run.lineSlots.at(level), run.pairMoves.at(level), m_lodLevels[level], m_chunks, FeatureCount);
+        run.pairs[level].clear();
+        run.lineSlots[level].clear();
+        run.pairMoves[level].clear();
+    }
+    sortLines(travelPairs, travelSlots, QVector<int>(), m_travel, m_travelChunks, 1);
+}
+
+void GCode::appendLodRun(int layer, int feature, GCodeLodRun &run)
+{
+    if (run.points.size() < 2) {
+        run.points.clear();
+        run.moves.clear();
+        return;
+    }
+
+    for (int level = 0; level < m_lodLevels.size(); ++level) {
+        run.simplified.clear();
+        run.kept.clear();
+        simplifyPolyline(run.points.constData(), run.points.size(), m_lodLevels.at(level).tolerance,
+                         run.simplified, &run.kept);
+
+        // a simplified line is colored like the move it ends with
+        for (int i = 1; i < run.simplified.size(); ++i) {
+            run.pairs[level] << run.simplified.at(i - 1) << run.simplified.at(i);
+            run.lineSlots[level] << feature * chunkSlots() + chunkSlot(layer, tileOf(run.simplified.at(i)));
+            run.pairMoves[level] << run.moves.at(run.kept.at(i));
+        }
+    }
+    run.points.clear();
+    run.moves.clear();
+}
+
+// coarsest level whose error is still below the current tolerance, -1 if there are none.
+int GCode::lodLevel() const
+{
+    int level = -1;
+    for (int i = 0; i < m_lodLevels.size(); ++i) {
+        if (m_lodLevels.at(i).tolerance <= m_lodTolerance)
+            level = i;
+    }
+    return level;
+}
+
+// XY tiles over the extrusions, CHUNK_TILE_SIZE wide unless there would be too many.
+void GCode::setupChunks()
+{
+    const int layers = m_layerFirstLine.size() - 1;
+    const float minusX = maxX * 0.5;
+    const float minusY = maxY * 0.5;
+    const float extent = qMax(maxX - minX, maxY - minY);
+
+    m_tiles = 1;
+    m_tileX = minX - minusX;
+    m_tileY = minY - minusY;
+    m_tileSize = CHUNK_TILE_SIZE;
+    if (extent > 0) {
+        m_tiles = qBound(1, (int)ceil(extent / CHUNK_TILE_SIZE), CHUNK_MAX_TILES);
+        m_tileSize = extent / m_tiles;
+    }
+
+    const int bands = (layers + CHUNK_LAYERS - 1) / CHUNK_LAYERS;
+    GCodeChunk empty;
+    for (int i = 0; i < 3; ++i) {
+        empty.min[i] =  std::numeric_limits<float>::max();
+        empty.max[i] = -std::numeric_limits<float>::max();
+    }
+    empty.visible = true;
+    m_chunks.fill(empty, bands * m_tiles * m_tiles);
+    m_travelChunks = m_chunks;
+}
+
+// tile of a point in scene coordinates, points outside the extrusions go to the border tiles.
+int GCode::tileOf(const QVector3D &point) const
+{
+    const int column = qBound(0, (int)floor((point.x() - m_tileX) / m_tileSize), m_tiles - 1);
+    const int row    = qBound(0, (int)floor((point.z() - m_tileY) / m_tileSize), m_tiles - 1);
+    return row * m_tiles + column;
+}
+
+void GCode::growChunk(QVector<GCodeChunk> &chunks, int slot, const QVector3D &point)
+{
+    GCodeChunk &chunk = chunks[slot / CHUNK_LAYERS];
+    for (int i = 0; i < 3; ++i) {
+        chunk.min[i] = qMin(chunk.min[i], point[i]);
+        chunk.max[i] = qMax(chunk.max[i], point[i]);
+    }
+}
+
+// moves the line pairs into set slot by slot (counting sort), the slots are
+// feature * chunkSlots() + chunkSlot() for features sections.
+void GCode::sortLines(const QVector<QVector3D> &pairs, const QVector<int> &lineSlots, const QVector<int> &moves,
+                      GCodeLineSet &set, QVector<GCodeChunk> &chunks, int features)
+{
+    set.offsets.fill(0, features * chunkSlots() + 1);
+    for (int i = 0; i < lineSlots.size(); ++i)
+        set.offsets[lineSlots.at(i) + 1] += 2;
+    for (int i = 1; i < set.offsets.size(); ++i)
+        set.offsets[i] += set.offsets[i - 1];
+
+    set.vertices.resize(pairs.size());
+    set.vertices.squeeze();
+    set.moves.resize(moves.size());
+    set.moves.squeeze();
+    set.colors.clear();
+    set.colorStamp = -1;
+    QVector<int> cursor = set.offsets;
+    for (int i = 0; i < lineSlots.size(); ++i) {
+        const int slot = lineSlots.at(i);
+        int &at = cursor[slot];
+        set.vertices[at]     = pairs.at(i * 2);
+        set.vertices[at + 1] = pairs.at(i * 2 + 1);
+        if (!moves.isEmpty())
+            set.moves[at / 2] = moves.at(i);
+        growChunk(chunks, slot % chunkSlots(), pairs.at(i * 2));
+        growChunk(chunks, slot % chunkSlots(), pairs.at(i * 2 + 1));
+        at += 2;
+    }
+}
+
+// Marks the chunks that intersect the view frustum, the next draw() skips the others.
+void GCode::setViewProjection(const QMatrix4x4 &viewProjection)
+{
+    PROFILE_SCOPE("GCode::setViewProjection");
+    const Frustum frustum(viewProjection);
+    for (int i = 0; i < m_chunks.size(); ++i) {
+        GCodeChunk &chunk = m_chunks[i];
+        chunk.visible = chunk.min[0] <= chunk.max[0]
+                        && frustum.classify(chunk.min, chunk.max) != Frustum::Outside;
+        GCodeChunk &travel = m_travelChunks[i];
+        travel.visible = travel.min[0] <= travel.max[0]
+                         && frustum.classify(travel.min, travel.max) != Frustum::Outside;
+    }
+}
+
+void GCode::gpuArrays(QVector<GpuArray> &arrays, int firstSlot) const
+{
+    GpuArray array;
+    array.target = GL_ARRAY_BUFFER;
+    for (int slot = 0; slot < tubeSlot() + 3; ++slot) {
+        if (m_buffers.id(slot))
+            continue;
+        if (slot < m_compactLines.size() && !m_compactLines.at(slot).isEmpty())
+            array.packed = m_compactLines.at(slot).data;
+        else if (slot < m_lodLevels.size())
+            array.vertices = m_lodLevels.at(slot).vertices;
+        else if (slot == travelSlot())
+            array.vertices = m_travel.vertices;
+        else if (slot == tubeSlot() && !m_compactTube.isEmpty())
+            array.packed = m_compactTube.data;
+        else if (slot == tubeSlot())
+            array.vertices = m_tubeVertices;
+        else if (slot == tubeSlot() + 1 && !m_compactTubeNormals.isEmpty())
+            array.packed = m_compactTubeNormals;
+        else if (slot == tubeSlot() + 1)
+            array.vertices = m_tubeNormals;
+        else {
+            array.target = GL_ELEMENT_ARRAY_BUFFER;
+            array.vertices.clear();
+            if (!m_compactTubeIndices.isEmpty())
+                array.packed = m_compactTubeIndices;
+            else
+                array.indices = m_tubeIndices;
+        }
+        if (array.bytes() > 0) {
+            array.slot = firstSlot + slot;
+            arrays.push_back(array);
+        }
+        array.vertices.clear();
+        array.packed.clear();
+    }
+}
+
+void GCode::setCompactVertices(bool compact)
+{
+    m_compactLines.clear();
+    m_compactTube.clear();
+    m_compactTubeNormals.clear();
+    m_compactTubeIndices.clear();
+    m_compactNormalError = 0;
+    if (compact) {
+        m_compactLines.resize(travelSlot() + 1);
+        for (int slot = 0; slot < m_lodLevels.size(); ++slot)
+            m_compactLines[slot].pack(m_lodLevels.at(slot).vertices);
+        m_compactLines[travelSlot()].pack(m_travel.vertices);
+        m_compactTube.pack(m_tubeVertices);
+        m_compactNormalError = packNormals(m_tubeNormals, m_compactTubeNormals);
+        packIndices(m_tubeIndices, m_compactTubeIndices);
+    }
+    // the buffers hold the other layout
+    m_buffers.clear();
+}
+
+float GCode::compactPositionError() const
+{
+    float error = m_compactTube.maxError;
+    for (int i = 0; i < m_compactLines.size(); ++i)
+        error = qMax(error, m_compactLines.at(i).maxError);
+    return error;
+}
+
+void GCode::layerHeights(QVector<float> &heights) const
+{
+    heights.fill(-1, layerCount());
+    for (size_t i = 0; i < codeLines.size(); ++i) {
+        const GCodeLine &line = codeLines[i];
+        if (line.hasE && line.hasXYZ && line.de > 0 && heights.at(line.layer) < 0)
+            heights[line.layer] = line.z;
+    }
+}
+
+void GCode::setReference(const QVector<QVector<SliceContour> > &layers, const QVector2D &offset)
+{
+    clearReference();
+    if (layers.size() != layerCount())
+        return;
+    QVector<float> heights;
+    layerHeights(heights);
+    const float minusX = maxX * 0.5;
+    const float minusY = maxY * 0.5;
+    m_referenceLayers.reserve(layers.size() + 1);
+    for (int layer = 0; layer < layers.size(); ++layer) {
+        m_referenceLayers.push_back(m_referenceOutlines.size());
+        const QVector<SliceContour> &contours = layers.at(layer);
+        for (int i = 0; i < contours.size() && heights.at(layer) >= 0; ++i) {
+            const GCodeOutline outline = { m_referencePoints.size(), contours.at(i).points.size(), contours.at(i).closed };
+            for (int j = 0; j < outline.count; ++j) {
+                const QVector2D &point = contours.at(i).points.at(j);
+                m_referencePoints.push_back(QVector3D(point.x() + offset.x() - minusX, heights.at(layer),
+                                                      point.y() + offset.y() - minusY));
+            }
+            if (outline.count > 1)
+                m_referenceOutlines.push_back(outline);
+        }
+    }
+    m_referenceLayers.push_back(m_referenceOutlines.size());
+    qDebug() << Q_FUNC_INFO << m_referenceOutlines.size() << "outlines" << m_referencePoints.size() << "points";
+}
+
+void GCode::clearReference()
+{
+    m_referencePoints.clear();
+    m_referenceOutlines.clear();
+    m_referenceLayers.clear();
+}
+
+static qint64 lineSetBytes(const GCodeLineSet &set)
+{
+    return containerBytes(set.vertices) + containerBytes(set.offsets) + containerBytes(set.moves)
+           + containerBytes(set.colors);
+}
+
+void GCode::memoryUsage(MemoryUsage &usage) const
+{
+    addMemory(usage, "code lines", containerBytes(codeLines));
+    addMemory(usage, "layer index", containerBytes(m_layerFirstLine) + containerBytes(m_chunks)
+                                    + containerBytes(m_travelChunks));
+    qint64 arcs = containerBytes(m_arcLayers);
+    for (int i = 0; i < m_arcLayers.size(); ++i)
+        arcs += containerBytes(m_arcLayers.at(i).offsets) + containerBytes(m_arcLayers.at(i).points);
+    addMemory(usage, "arc cache", arcs);
+    addMemory(usage, "tube mesh", containerBytes(m_tubeVertices) + containerBytes(m_tubeNormals)
+                                  + containerBytes(m_tubeIndices) + containerBytes(m_tubeOffsets)
+                                  + containerBytes(m_tubeMoves) + containerBytes(m_prevFacet));
+    qint64 paths = lineSetBytes(m_travel);
+    for (int i = 0; i < m_lodLevels.size(); ++i)
+        paths += lineSetBytes(m_lodLevels.at(i));
+    addMemory(usage, "toolpath lines", paths);
+    qint64 heatmap = containerBytes(m_moveColors) + containerBytes(m_tubeColors);
+    for (int i = 0; i < ColorModeCount; ++i)
+        heatmap += containerBytes(m_moveScalars[i].values);
+    addMemory(usage, "heatmap colors", heatmap);
+    qint64 compact = containerBytes(m_compactTube.data) + containerBytes(m_compactTubeNormals)
+                     + containerBytes(m_compactTubeIndices);
+    for (int i = 0; i < m_compactLines.size(); ++i)
+        compact += containerBytes(m_compactLines.at(i).data);
+    addMemory(usage, "compact copies", compact);
+    qint64 pick = 0;
+    for (int i = 0; i < m_pickGrids.size(); ++i)
+        pick += m_pickGrids.at(i).bytes();
+    addMemory(usage, "pick grids", pick);
+    addMemory(usage, "analysis", containerBytes(m_referencePoints) + containerBytes(m_referenceOutlines)
+                                 + containerBytes(m_diffAdded.vertices) + containerBytes(m_diffRemoved.vertices)
+                                 + m_occupancy.bytes() + containerBytes(m_occupancyCells.vertices));
+}
+
+// layers with code lines shown, lastLayer < firstLayer if none
+void GCode::shownLayers(int &firstLayer, int &lastLayer) const
+{
+    // the layers starting before the last shown line, setLayerRange() ends on a layer start
+    const unsigned int lastLine = qMin<unsigned int>(showLayers, codeLines.size());
+    lastLayer = qMin<int>(std::lower_bound(m_layerFirstLine.begin(), m_layerFirstLine.end(), lastLine)
+                          - m_layerFirstLine.begin() - 1, layerCount() - 1);
+    firstLayer = qMin(m_firstLayer, layerCount());
+}
+
+// outlines of the shown layers, few enough to come from client memory.
+void GCode::drawReference()
+{
+    if (m_referenceOutlines.isEmpty() || m_referenceLayers.size() != layerCount() + 1)
+        return;
+    int firstLayer, lastLayer;
+    shownLayers(firstLayer, lastLayer);
+    if (lastLayer < firstLayer)
+        return;
+
+    glColor3f(0.1, 0.85, 0.95);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, m_referencePoints.constData());
+    for (int i = m_referenceLayers.at(firstLayer); i < m_referenceLayers.at(lastLayer + 1); ++i) {
+        const GCodeOutline &outline = m_referenceOutlines.at(i);
+        glDrawArrays(outline.closed ? GL_LINE_LOOP : GL_LINE_STRIP, outline.first, outline.count);
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void GCode::setDiff(const QVector<GCodeLayerDiff> &layers)
+{
+    clearDiff();
+    const int count = layerCount();
+    QVector<int> diffOf(count, -1);
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers.at(i).layer >= 0 && layers.at(i).layer < count)
+            diffOf[layers.at(i).layer] = i;
+    }
+    const float minusX = maxX * 0.5;
+    const float minusY = maxY * 0.5;
+    m_diffAdded.layers.reserve(count + 1);
+    m_diffRemoved.layers.reserve(count + 1);
+    for (int layer = 0; layer < count; ++layer) {
+        m_diffAdded.layers.push_back(m_diffAdded.vertices.size());
+        m_diffRemoved.layers.push_back(m_diffRemoved.vertices.size());
+        if (diffOf.at(layer) < 0)
+            continue;
+        const GCodeLayerDiff &diff = layers.at(diffOf.at(layer));
+        const float half = diff.cellSize * 0.5f;
+        const float height = diff.z + 0.05f;   // over the lines of the layer
+        for (int side = 0; side < 2; ++side) {
+            const QVector<QVector2D> &centers = side ? diff.removedCells : diff.addedCells;
+            QVector<QVector3D> &vertices = side ? m_diffRemoved.vertices : m_diffAdded.vertices;
+            for (int i = 0; i < centers.size(); ++i) {
+                const float x = centers.at(i).x() - minusX, z = centers.at(i).y() - minusY;
+                vertices.push_back(QVector3D(x - half, height, z - half));
+                vertices.push_back(QVector3D(x - half, height, z + half));
+                vertices.push_back(QVector3D(x + half, height, z + half));
+                vertices.push_back(QVector3D(x + half, height, z - half));
+            }
+        }
+    }
+    m_diffAdded.layers.push_back(m_diffAdded.vertices.size());
+    m_diffRemoved.layers.push_back(m_diffRemoved.vertices.size());
+    qDebug() << Q_FUNC_INFO << m_diffAdded.vertices.size() / 4 << "added" << m_diffRemoved.vertices.size() / 4 << "removed cells";
+}
+
+void GCode::clearDiff()
+{
+    m_diffAdded = GCodeCells();
+    m_diffRemoved = GCodeCells();
+}
+
+// cells of the shown layers, from client memory like the reference outlines.
+void GCode::drawDiff()
+{
+    if (m_diffAdded.layers.size() != layerCount() + 1)
+        return;
+    int firstLayer, lastLayer;
+    shownLayers(firstLayer, lastLayer);
+    if (lastLayer < firstLayer)
+        return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glColor3f(0.2, 0.85, 0.25);
+    drawCells(m_diffAdded, firstLayer, lastLayer);
+    glColor3f(0.95, 0.2, 0.2);
+    drawCells(m_diffRemoved, firstLayer, lastLayer);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void GCode::drawCells(const GCodeCells &cells, int firstLayer, int lastLayer)
+{
+    const int first = cells.layers.at(firstLayer);
+    const int count = cells.layers.at(lastLayer + 1) - first;
+    if (count == 0)
+        return;
+    glVertexPointer(3, GL_FLOAT, 0, cells.vertices.constData());
+    glDrawArrays(GL_QUADS, first, count);
+}
+
+// Extrusions as chords, layer after layer. A run ends with any move that does not extrude.
+void GCode::occupancySegments(QVector<OccupancySegment> &segments, QVector<int> &layerFirst)
+{
+    segments.clear();
+    layerFirst.fill(0, layerCount() + 1);
+    int run = 0;
+    float position = 0;
+    float x = 0, y = 0;
+    for (unsigned int i = 0; i < codeLines.size(); ++i) {
+        const GCodeLine &line = codeLines[i];
+        const bool extrusion = line.hasE && line.hasXYZ && line.de > 0 && line.layer >= 0 && line.layer < layerCount();
+        if (extrusion && i > 0) {   // the first move starts nowhere known
+            int count = 1;
+            const QVector3D end(line.x, line.y, line.z);
+            const QVector3D *points = line.isArc ? arcPoints(i, count) : &end;
+            for (int j = 0; j < count; ++j) {
+                const OccupancySegment segment = { x, y, points[j].x(), points[j].y(), run, position };
+                segments.push_back(segment);
+                position += QVector2D(points[j].x() - x, points[j].y() - y).length();
+                x = points[j].x();
+                y = points[j].y();
+            }
+            layerFirst[line.layer + 1] += count;
+        } else if (line.hasXYZ && (line.x != x || line.y != y)) {
+            ++run;
+            position = 0;
+        }
+        x = line.x;
+        y = line.y;
+    }
+    for (int layer = 0; layer < layerCount(); ++layer)
+        layerFirst[layer + 1] += layerFirst.at(layer);
+}
+
+void GCode::buildOccupancy(float cellSize)
+{
+    PROFILE_SCOPE("GCode::buildOccupancy");
+    QElapsedTimer timer;
+    timer.start();
+    QVector<OccupancySegment> segments;
+    QVector<int> layerFirst;
+    occupancySegments(segments, layerFirst);
+    m_occupancy.build(segments, layerFirst, TUBE_RADIUS * 2, cellSize);
+    qDebug() << Q_FUNC_INFO << layerCount() << "layers in" << timer.elapsed() << "ms,"
+             << m_occupancy.bytes() / 1024 << "KB";
+}
+
+// one layer of GCode::setOccupancyOverlay()
+struct GCodeOccupancyTask
+{
+    const Occupancy *occupancy;
+    int query;
+    int layer;
+    OccupancyMap cells;
+};
+
+static void queryOccupancy(GCodeOccupancyTask &task)
+{
+    task.occupancy->query(task.query, task.layer, task.cells);
+}
+
+int GCode::setOccupancyOverlay(int query)
+{
+    m_occupancyCells = GCodeCells();
+    m_occupancyQuery = query >= 0 && query < OccupancyQueryCount ? query : -1;
+    if (m_occupancyQuery < 0 || layerCount() == 0)
+        return 0;
+    if (m_occupancy.layerCount() != layerCount())
+        buildOccupancy();
+
+    QVector<GCodeOccupancyTask> tasks(layerCount());
+    for (int layer = 0; layer < tasks.size(); ++layer) {
+        tasks[layer].occupancy = &m_occupancy;
+        tasks[layer].query = m_occupancyQuery;
+        tasks[layer].layer = layer;
+    }
+    QtConcurrent::blockingMap(tasks, queryOccupancy);
+
+    // a quad per run of cells along a row
+    QVector<float> heights;
+    layerHeights(heights);
+    const float minusX = maxX * 0.5;
+    const float minusY = maxY * 0.5;
+    const float half = m_occupancy.cellSize() * 0.5f;
+    int cells = 0;
+    m_occupancyCells.layers.reserve(layerCount() + 1);
+    for (int layer = 0; layer < tasks.size(); ++layer) {
+        m_occupancyCells.layers.push_back(m_occupancyCells.vertices.size());
+        const OccupancyMap &map = tasks.at(layer).cells;
+        cells += map.count();
+        const float height = heights.at(layer) + 0.05f;
+        for (int y = map.top(); y < map.top() + map.height() && heights.at(layer) >= 0; ++y) {
+            for (int x = map.left(); x < map.left() + map.width(); ++x) {
+                if (!map.test(x, y))
+                    continue;
+                const int first = x;
+                while (map.test(x + 1, y))
+                    ++x;
+                const QVector2D from = m_occupancy.cellCenter(first, y), to = m_occupancy.cellCenter(x, y);
+                m_occupancyCells.vertices.push_back(QVector3D(from.x() - half - minusX, height, from.y() - half - minusY));
+                m_occupancyCells.vertices.push_back(QVector3D(from.x() - half - minusX, height, from.y() + half - minusY));
+                m_occupancyCells.vertices.push_back(QVector3D(to.x() + half - minusX, height, to.y() + half - minusY));
+                m_occupancyCells.vertices.push_back(QVector3D(to.x() + half - minusX, height, to.y() - half - minusY));
+            }
+        }
+    }
+    m_occupancyCells.layers.push_back(m_occupancyCells.vertices.size());
+    qDebug() << Q_FUNC_INFO << query << cells << "cells" << m_occupancyCells.vertices.size() / 4 << "quads";
+    return cells;
+}
+
+// (first, count) ranges of the visible chunks restricted to the layers firstLayer up to
+// (not including) lastLayer, neighbouring ranges are merged.
+void GCode::visibleRanges(const int *offsets, const QVector<GCodeChunk> &chunks, int firstLayer,
+                          int lastLayer, QVector<QPair<int, int> > &ranges) const
+{
+    ranges.clear();
+    if (firstLayer < 0 || firstLayer >= lastLayer)
+        return;
+
+    const int tiles = m_tiles * m_tiles;
+    for (int band = firstLayer / CHUNK_LAYERS; band * CHUNK_LAYERS < lastLayer; ++band) {
+        const int from = qMax(firstLayer - band * CHUNK_LAYERS, 0);
+        const int to   = qMin(lastLayer - band * CHUNK_LAYERS, CHUNK_LAYERS);
+        for (int tile = 0; tile < tiles; ++tile) {
+            const int chunk = band * tiles + tile;
+            if (!chunks.at(chunk).visible)
+                continue;
+
+            const int first = offsets[chunk * CHUNK_LAYERS + from];
+            const int last  = offsets[chunk * CHUNK_LAYERS + to];
+            if (first == last)
+                continue;
+            if (!ranges.isEmpty() && ranges.last().first + ranges.last().second == first)
+                ranges.last().second += last - first;
+            else
+                ranges.push_back(qMakePair(first, last - first));
+        }
+    }
+}
+
+void GCode::drawLines(const GCodeLineSet &set, int slot, const QVector<GCodeChunk> &chunks, int feature,
+                      int firstLayer, int lastLayer)
+{
+    if (set.offsets.isEmpty())
+        return;
+    QVector<QPair<int, int> > ranges;
+    visibleRanges(set.offsets.constData() + feature * chunkSlots(), chunks, firstLayer, lastLayer, ranges);
+    const CompactPositions *compact = slot < m_compactLines.size() && !m_compactLines.at(slot).isEmpty()
+            ? &m_compactLines.at(slot) : 0;
+    if (compact) {
+        compact->pushTransform();
+        glVertexPointer(3, GL_SHORT, COMPACT_POSITION_STRIDE,
+                        m_buffers.bind(slot, GL_ARRAY_BUFFER, compact->data.constData()));
+    } else {
+        glVertexPointer(3, GL_FLOAT, 0, m_buffers.bind(slot, GL_ARRAY_BUFFER, set.vertices.constData()));
+    }
+    m_buffers.unbind();
+    for (int i = 0; i < ranges.size(); ++i)
+        glDrawArrays(GL_LINES, ranges.at(i).first, ranges.at(i).second);
+    if (compact)
+        glPopMatrix();
+}
+
+void GCode::buildPickGrid(int layer)
+{
+    SegmentGrid &grid = m_pickGrids[layer];
+    grid.clear();
+    for (unsigned int i = m_layerFirstLine[layer]; i < m_layerFirstLine[layer + 1]; ++i) {
+        const GCodeLine &line = codeLines[i];
+        if (!line.hasE || i == 0 || !m_featureVisible[line.feature])
+            continue;
+
+        float x = codeLines[i-1].x, y = codeLines[i-1].y;
+        if (line.isArc) {
+            int count;
+            const QVector3D *points = arcPoints(i, count);
+            for (int j = 0; j < count; ++j) {
+                grid.addSegment(x, y, points[j].x(), points[j].y(), i);
+                x = points[j].x();
+                y = points[j].y();
+            }
+        } else {
+            grid.addSegment(x, y, line.x, line.y, i);
+        }
+    }
+    grid.build();
+}
+
+// Index of the shown extrusion closest to a ray in scene coordinates, -1 if none is within
+// maxDistance. Layers are tried from the top, each at the height of its moves.
+int GCode::pickMove(const QVector3D &origin, const QVector3D &direction, float maxDistance)
+{
+    const unsigned int lastLine = qMin<unsigned int>(showLayers, codeLines.size());
+    if (!lastLine || direction.y() == 0)
+        return -1;
+
+    const float minusX = maxX * 0.5;
+    const float minusY = maxY * 0.5;
+    for (int layer = codeLines[lastLine - 1].layer; layer >= m_firstLayer; --layer) {
+        const unsigned int first = m_layerFirstLine[layer];
+        if (first == m_layerFirstLine[layer + 1])
+            continue;
+
+        // scene y is the g-code z
+        const float t = (codeLines[first].z - origin.y()) / direction.y();
+        if (t < 0)
+            continue;
+
+        if (!m_pickGrids.at(layer).isBuilt())
+            buildPickGrid(layer);
+
+        const QVector3D hit = origin + direction * t;
+        float distance;
+        const int index = m_pickGrids.at(layer).nearest(hit.x() + minusX, hit.z() + minusY, maxDistance, lastLine, distance);
+        if (index >= 0)
+            return index;
+    }
+    return -1;
+}
+
+// reads the original text of a move back from the file. Offsets are into the decompressed
+// text, a compressed file is decompressed again up to there.
+string GCode::sourceLine(unsigned int index) const
+{
+    if (index >= codeLines.size() || codeLines[index].offset < 0)
+        return string();
+
+    QScopedPointer<QIODevice> inFile(openInput(QString::fromStdString(m_fileName)));
+    if (!inFile)
+        return string();
+    const long long offset = codeLines[index].offset;
+    if (BGCodeReader::isBinaryGCode(*inFile)) {
+        // decoded block by block up to the one holding the line
+        BGCodeReader reader(inFile.data());
+        QVector<QByteArray> texts;
+        QByteArray text;
+        long long start = 0;   // offset of text
+        if (!reader.readHeader())
+            return string();
+        while (reader.readGCode(texts, 1)) {
+            text += texts.first();
+            if (start + text.size() <= offset) {
+                start += text.size();
+                text.clear();
+            } else if (text.indexOf('\n', offset - start) >= 0) {
+                break;
+            }
+        }
+        if (start + text.size() <= offset)
+            return string();
+        text = text.mid(offset - start);
+        if (text.indexOf('\n') >= 0)
+            text.truncate(text.indexOf('\n'));
+        while (text.endsWith('\r'))
+            text.chop(1);
+        return string(text.constData(), text.size());
+    }
+    if (!inFile->isSequential()) {
+        inFile->seek(offset);
+    } else {
+        static const int BLOCK_SIZE = 1 << 20;
+        vector<char> block(BLOCK_SIZE);
+        for (long long skipped = 0; skipped < offset; ) {
+            const qint64 count = inFile->read(&block[0], qMin<long long>(BLOCK_SIZE, offset - skipped));
+            if (count <= 0)
+                return string();
+            skipped += count;
+        }
+    }
+    QByteArray line = inFile->readLine();
+    while (line.endsWith('\n') || line.endsWith('\r'))
+        line.chop(1);
+    return string(line.constData(), line.size());
+}
+
+void GCode::clearArcCache()
+{
+    for (int i = 0; i < m_arcCached.size(); ++i) {
+        GCodeArcLayer &arcLayer = m_arcLayers[m_arcCached.at(i)];
+        arcLayer.cached = false;
+        arcLayer.offsets = QVector<int>();
+        arcLayer.points = QVector<QVector3D>();
+    }
+    m_arcCached.clear();
 }
 
 void GCode::setGCodeLayers(int layers) {
     qDebug() << Q_FUNC_INFO << layers;
     showLayers = layers;
 }
+
+//! ============= Heatmap ===============
+// blue - cyan - green - yellow - red
+static const float HEATMAP_STOPS[][3] = {
+    { 0.f, 0.f, 1.f }, { 0.f, 1.f, 1.f }, { 0.f, 1.f, 0.f }, { 1.f, 1.f, 0.f }, { 1.f, 0.f, 0.f }
+};
+const int HEATMAP_SIZE = 256;
+
+// Switches between feature colors and the heatmaps, the range is reset to the data.
+void GCode::setColorMode(int mode)
+{
+    if (mode == m_colorMode)
+        return;
+    m_colorMode = mode;
+    if (mode != ColorByFeature)
+        dataRange(mode, m_colorMin, m_colorMax);
+    ++m_colorStamp;
+}
+
+void GCode::setColorRange(float min, float max)
+{
+    if (min == m_colorMin && max == m_colorMax)
+        return;
+    m_colorMin = min;
+    m_colorMax = max;
+    ++m_colorStamp;
+}
+
+// smallest and largest value of mode over the extrusions
+void GCode::dataRange(int mode, float &min, float &max)
+{
+    min = max = 0;
+    if (mode == ColorByFeature)
+        return;
+
+    const GCodeScalars &scalars = moveScalars(mode);
+    min = scalars.min;
+    max = scalars.max;
+}
+
+// Value of mode for each code line, extrusions only. Made once per mode and kept, so a new
+// range only maps them again.
+const GCodeScalars &GCode::moveScalars(int mode)
+{
+    GCodeScalars &scalars = m_moveScalars[mode];
+    if (scalars.valid)
+        return scalars;
+    scalars.valid = true;
+    QVector<float> &values = scalars.values;
+    values.fill(0, codeLines.size());
+    scalars.min = scalars.max = 0;
+    if (codeLines.empty() || mode == ColorByFeature)
+        return scalars;
+
+    // duration of every move (travel too), needed for the flow and the layer times
+    QVector<float> time(codeLines.size());
+    float x = 0, y = 0, z = 0;
+    for (unsigned int i = 0; i < codeLines.size(); ++i) {
+        const GCodeLine &line = codeLines[i];
+        float length = 0;
+        if (line.isArc) {
+            int count;
+            const QVector3D *points = arcPoints(i, count);
+            for (int j = 0; j < count; ++j) {
+                length += (points[j] - QVector3D(x, y, z)).length();
+                x = points[j].x();
+                y = points[j].y();
+                z = points[j].z();
+            }
+        } else {
+            length = QVector3D(line.x - x, line.y - y, line.z - z).length();
+        }
+        time[i] = line.f > 0 ? length * 60 / line.f : 0;
+        x = line.x;
+        y = line.y;
+        z = line.z;
+    }
+
+    if (mode == ColorBySpeed) {
+        for (unsigned int i = 0; i < codeLines.size(); ++i)
+            values[i] = codeLines[i].f / 60;
+    } else if (mode == ColorByFlow) {
+        const float area = 3.14159265f * FILAMENT_DIAMETER * FILAMENT_DIAMETER / 4;
+        for (unsigned int i = 0; i < codeLines.size(); ++i)
+            values[i] = time.at(i) > 0 ? codeLines[i].de * area / time.at(i) : 0;
+    } else if (mode == ColorByLayerTime) {
+        for (int layer = 0; layer + 1 < m_layerFirstLine.size(); ++layer) {
+            float layerTime = 0;
+            for (unsigned int i = m_layerFirstLine[layer]; i < m_layerFirstLine[layer + 1]; ++i)
+                layerTime += time.at(i);
+            for (unsigned int i = m_layerFirstLine[layer]; i < m_layerFirstLine[layer + 1]; ++i)
+                values[i] = layerTime;
+        }
+    }
+
+    bool first = true;
+    for (unsigned int i = 0; i < codeLines.size(); ++i) {
+        if (!codeLines[i].hasE)
+            continue;
+        if (first || values.at(i) < scalars.min)
+            scalars.min = values.at(i);
+        if (first || values.at(i) > scalars.max)
+            scalars.max = values.at(i);
+        first = false;
+    }
+    return scalars;
+}
+
+// RGBA of every code line for the current mode and range. The values are gathered once per
+// mode, the mapping itself is a branch free loop over plain arrays the compiler vectorizes.
+void GCode::updateMoveColors()
+{
+    if (m_moveColorStamp == m_colorStamp)
+        return;
+
+    unsigned int lut[HEATMAP_SIZE];
+    const int stops = sizeof(HEATMAP_STOPS) / sizeof(*HEATMAP_STOPS);
+    for (int i = 0; i < HEATMAP_SIZE; ++i) {
+        const float t = float(i) / (HEATMAP_SIZE - 1) * (stops - 1);
+        const int stop = qMin(int(t), stops - 2);
+        const float f = t - stop;
+        unsigned char *rgba = reinterpret_cast<unsigned char *>(&lut[i]);
+        for (int c = 0; c < 3; ++c)
+            rgba[c] = (unsigned char)(255 * (HEATMAP_STOPS[stop][c] * (1 - f) + HEATMAP_STOPS[stop + 1][c] * f));
+        rgba[3] = 255;
+    }
+
+    const QVector<float> &values = moveScalars(m_colorMode).values;
+
+    const int count = values.size();
+    QVector<int> bins(count);
+    const float *value = values.constData();
+    int *bin = bins.data();
+    const float offset = m_colorMin;
+    const float scale = m_colorMax > m_colorMin ? (HEATMAP_SIZE - 1) / (m_colorMax - m_colorMin) : 0;
+    for (int i = 0; i < count; ++i) {
+        float t = (value[i] - offset) * scale;
+        t = t < 0 ? 0 : t;
+        t = t > HEATMAP_SIZE - 1 ? HEATMAP_SIZE - 1 : t;
+        bin[i] = int(t);
+    }
+
+    m_moveColors.resize(count);
+    unsigned int *color = m_moveColors.data();
+    for (int i = 0; i < count; ++i)
+        color[i] = lut[bin[i]];
+    m_moveColorStamp = m_colorStamp;
+}
+
+void GCode::updateSetColors(GCodeLineSet &set)
+{
+    if (set.colorStamp == m_colorStamp)
+        return;
+    updateMoveColors();
+
+    set.colors.resize(set.vertices.size());
+    for (int i = 0; i < set.moves.size(); ++i)
+        set.colors[i * 2] = set.colors[i * 2 + 1] = m_moveColors.at(set.moves.at(i));
+    set.colorStamp = m_colorStamp;
+}
+
+// Hidden features are neither drawn nor picked.
+void GCode::setFeatureVisible(int feature, bool visible)
+{
+    if (m_featureVisible[feature] == visible)
+        return;
+    m_featureVisible[feature] = visible;
+    for (int i = 0; i < m_pickGrids.size(); ++i)
+        m_pickGrids[i].clear();
+}
+
+// Shows the layers first to last (inclusive), the layers slider only moves the end.
+void GCode::setLayerRange(int first, int last)
+{
+    const int layers = layerCount();
+    last = qBound(0, last, layers - 1);
+    m_firstLayer = qBound(0, first, last);
+    showLayers = layers ? m_layerFirstLine.at(last + 1) : 0;
+}
@@ -26,8 +26,19 @@ along with BoostComPort.  If not, see <http://www.gnu.org/licenses/>.
 #include <limits>
 #include <QVector3D>
 #include <QVector>
+#include <QPair>
+#include <QMatrix4x4>
 #include <cmath>
 
+#include "segmentgrid.h"
+#include "feature.h"
+#include "gpubuffers.h"
+#include "compactvertices.h"
+#include "meshslicer.h"
+#include "gcodediff.h"
+#include "occupancy.h"
+#include "memoryusage.h"
+
 using namespace std;
 
 struct GCodeParameter
@@ -38,68 +49,302 @@ struct GCodeParameter
 
 struct GCodeLine
 {
-	string originalLine;  // the original line from the file
-	string clearedLine;    // the cleared line, no comments, no needed whitespaces, etc. 
-	string command;
-    bool interprete;   // if this line is interpreteable (not just an empty or comment line)
+	long long offset;      // where the original line starts in the file, see GCode::sourceLine()
+	int lineNumber;        // 1-based line of the file
 //	vector<GCodeParameter> parameters;
+    // only moves are kept, G0/G1 or (isArc) G2/G3, the text is re-read by GCode::sourceLine()
     bool hasE;
     bool hasXYZ;
     bool visible;
+    bool isArc;        // G2 / G3
+    bool clockwise;    // G2
+    bool hasR;         // arc given by radius instead of I/J
     int layer;
+    unsigned char feature;   // GCodeFeature
 
     float x;
     float y;
     float z;
     float e;
-    float f;
+    float de;          // filament fed by this move (mm), absolute and relative E both handled
+    float f;           // feedrate (mm/min), modal
+    float i;           // arc center offset, or radius in R form
+    float j;
+};
+
+// tessellated arcs of one layer, built on demand.
+// Layers of arc chords kept at a time, the least recently used one makes room for the next.
+const int ARC_CACHE_LAYERS = 64;
+
+struct GCodeArcLayer
+{
+    GCodeArcLayer() : cached(false), used(0) {}
+    bool cached;
+    qint64 used;                // GCode::m_arcUse of the last arcPoints() on the layer
+    QVector<int> offsets;       // per code line of the layer, into points (size = lines + 1)
+    QVector<QVector3D> points;  // gcode coordinates
+};
+
+// Layers per band of chunks and XY tiling used to cull the toolpath.
+const int   CHUNK_LAYERS    = 16;
+const float CHUNK_TILE_SIZE = 25.f;   // mm
+const int   CHUNK_MAX_TILES = 8;      // per side
+
+// A band of CHUNK_LAYERS layers within one XY tile. Geometry is stored chunk by chunk,
+// layer by layer within a chunk, so that each chunk and layer is one contiguous range.
+struct GCodeChunk
+{
+    float min[3];   // bounding box in scene coordinates
+    float max[3];
+    bool visible;
 };
 
+// lines of one level of detail of the extrusion paths (or the travel moves), drawn as GL_LINES.
+// Extrusions are sorted by feature first, then by chunk slot, so hiding a feature
+// only drops draw ranges.
+struct GCodeLineSet
+{
+    GCodeLineSet() : tolerance(0), colorStamp(-1) {}
+    float tolerance;               // maximum deviation (mm) from the full toolpath
+    QVector<QVector3D> vertices;   // scene coordinates, pairs of line end points
+    QVector<int> offsets;          // first vertex of each feature and chunk slot, see GCode::chunkSlot()
+    QVector<int> moves;            // code line of each pair, for the heatmap colors
+    QVector<unsigned int> colors;  // RGBA per vertex, only in heatmap mode
+    int colorStamp;                // GCode::m_colorStamp the colors were made for
+};
+
+// what the extrusions are colored by
+enum GCodeColorMode
+{
+    ColorByFeature,
+    ColorBySpeed,       // mm/s
+    ColorByFlow,        // volumetric, mm³/s
+    ColorByLayerTime,   // s, from length / feedrate, acceleration ignored
+    ColorModeCount
+};
+
+// value of a heatmap mode per code line and its range over the extrusions, see GCode::moveScalars()
+struct GCodeScalars
+{
+    GCodeScalars() : valid(false), min(0), max(0) {}
+    bool valid;
+    QVector<float> values;
+    float min, max;
+};
+
+// one outline of the reference mesh, see GCode::setReference()
+struct GCodeOutline
+{
+    int first;     // into GCode::m_referencePoints
+    int count;
+    bool closed;
+};
+
+// grid cells drawn over the shown layers, see GCode::setDiff() and GCode::setOccupancyOverlay()
+struct GCodeCells
+{
+    QVector<QVector3D> vertices;   // scene coordinates, quads just above the layer
+    QVector<int> layers;           // first vertex of each layer, size = layers + 1
+};
+
+// filament diameter (mm) used to turn E into volume
+const float FILAMENT_DIAMETER = 1.75f;
+// radius (mm) of the extrusion tubes, half the line width
+const float TUBE_RADIUS = 0.27f;
+
+struct GCodeLodRun;
+class LoadProgress;
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
 //! ============= GCode ===============
 class GCode
 {
 public:
     GCode();
     ~GCode();
-    int   open(string fileName);
+    // Loads lines only when the tubes would take the memory past memoryLimit (bytes, 0 for no
+    // limit), see tubesSkipped(). parseOnly keeps the code lines and their layers, enough to
+    // compare with and nothing to draw.
+    int   open(string fileName, LoadProgress *progress = 0, qint64 memoryLimit = 0, bool parseOnly = false);
+    // the same from file, open at its start, e.g. after detectFormat() peeked at it.
+    // fileName is where sourceLine() reads the text again.
+    int   open(QIODevice &file, string fileName, LoadProgress *progress = 0, qint64 memoryLimit = 0,
+               bool parseOnly = false);
     void  clear();
     void  draw(bool linesOnly, bool showMotion);
-    int   addLine(string line);
-    void  parseLine(GCodeLine &gcodeLine, char command, string value);
+    int   addLine(const char *begin, const char *end, long long offset = -1, int lineNumber = 0);
+    void  parseLine(GCodeLine &gcodeLine, char command, float fValue);
     vector<GCodeLine>& getCodeLines() ;
-    void  refreshMinMax();
-	float getMinX();
-	float getMinY();
-	float getMinZ();
-	float getMaxX();
-	float getMaxY();
-	float getMaxZ();
+    const vector<GCodeLine>& getCodeLines() const { return codeLines; }
+	float getMinX() const;
+	float getMinY() const;
+	float getMinZ() const;
+	float getMaxX() const;
+	float getMaxY() const;
+	float getMaxZ() const;
     int  getGCodeCount() {
         return codeLines.size();
     }
     void setGCodeLayers(int layers);
+    void setLayerRange(int first, int last);
+    int   layerCount() const { return m_layerFirstLine.isEmpty() ? 0 : m_layerFirstLine.size() - 1; }
+    void  setFeatureVisible(int feature, bool visible);
+    bool  isFeatureVisible(int feature) const { return m_featureVisible[feature]; }
+    int   featureMoves(int feature) const { return m_featureMoves[feature]; }
+    void  setColorMode(int mode);
+    int   colorMode() const { return m_colorMode; }
+    void  setColorRange(float min, float max);
+    void  colorRange(float &min, float &max) const { min = m_colorMin; max = m_colorMax; }
+    void  dataRange(int mode, float &min, float &max);
+    const QVector3D *arcPoints(unsigned int index, int &count);
+    // appends the same points, made again instead of cached, so another thread may ask
+    void  arcChords(unsigned int index, QVector<QVector3D> &points) const;
+    void  setDetailTolerance(float tolerance) { m_lodTolerance = tolerance; }
+    int   pickMove(const QVector3D &origin, const QVector3D &direction, float maxDistance);
+    string sourceLine(unsigned int index) const;
+    void  setViewProjection(const QMatrix4x4 &viewProjection);
+    // arrays of the buffer slots that have no buffer yet, numbered from firstSlot
+    void  gpuArrays(QVector<GpuArray> &arrays, int firstSlot) const;
+    void  setGpuBuffer(int slot, unsigned int id, GpuUploader *uploader) { m_buffers.set(slot, id, uploader); }
+    // draws (and uploads) the paths and tubes from 16 bit positions, see compactvertices.h
+    void  setCompactVertices(bool compact);
+    float compactPositionError() const;
+    float compactNormalError() const { return m_compactNormalError; }
+    // z of the first extrusion of each layer, -1 for layers without (travel, z hops)
+    void  layerHeights(QVector<float> &heights) const;
+    // Outlines of a mesh cut at each layer, drawn over the shown layers for comparison.
+    // offset moves the mesh x/y onto the g-code x/y, layers.size() must be layerCount().
+    void  setReference(const QVector<QVector<SliceContour> > &layers, const QVector2D &offset);
+    void  clearReference();
+    int   referenceOutlines() const { return m_referenceOutlines.size(); }
+    // Cells added (green) and removed (red) by another toolpath, drawn over the shown layers.
+    // Layers only the other toolpath prints are counted by diffGCode() but not drawn.
+    void  setDiff(const QVector<GCodeLayerDiff> &layers);
+    void  clearDiff();
+    bool  hasDiff() const { return !m_diffAdded.layers.isEmpty(); }
+    // rasterizes the extrusions into m_occupancy, setOccupancyOverlay() does it on first use
+    void  buildOccupancy(float cellSize = OCCUPANCY_CELL_SIZE);
+    const Occupancy &occupancy() const { return m_occupancy; }
+    // Cells of one OccupancyQuery over the shown layers, -1 for none. Returns the cell count.
+    int   setOccupancyOverlay(int query);
+    int   occupancyOverlay() const { return m_occupancyQuery; }
 
     bool  isOpen() const;
+    bool  tubesSkipped() const { return m_tubesSkipped; }
+    // bytes held, by category
+    void  memoryUsage(MemoryUsage &usage) const;
 protected:
 	
 private:
 	vector<GCodeLine> codeLines;
-	void replace(string& replace, string from, string to);
-	void explode(vector<string> &res, string &list, string expression);
+    bool readText(QIODevice &file, LoadProgress *progress);
+    bool readBinary(QIODevice &file, LoadProgress *progress);
     void generateTube(QVector3D &p1, QVector3D &p2, QVector3D &p3, bool saveRearFacet, float radius);
-    void recomputeAll();
+    void recomputeAll(LoadProgress *progress, qint64 memoryLimit);
+    void buildLayerIndex();
+    bool arcGeometry(unsigned int index, QVector3D &start, QVector3D &end, QVector3D &center) const;
+    int  arcSegmentCount(unsigned int index) const;
+    void cacheArcLayer(int layer);
+    void clearArcCache();
+    QVector3D firstPoint(unsigned int index, float minusX, float minusY);
+    void buildLod(LoadProgress *progress);
+    void appendLodRun(int layer, int feature, GCodeLodRun &run);
+    int  lodLevel() const;
+    void setupChunks();
+    int  tileOf(const QVector3D &point) const;
+    int  chunkSlot(int layer, int tile) const {
+        return ((layer / CHUNK_LAYERS) * m_tiles * m_tiles + tile) * CHUNK_LAYERS + layer % CHUNK_LAYERS;
+    }
+    int  chunkSlots() const { return m_chunks.size() * CHUNK_LAYERS; }
+    void growChunk(QVector<GCodeChunk> &chunks, int slot, const QVector3D &point);
+    void sortLines(const QVector<QVector3D> &pairs, const QVector<int> &lineSlots, const QVector<int> &moves,
+                   GCodeLineSet &set, QVector<GCodeChunk> &chunks, int features);
+    const GCodeScalars &moveScalars(int mode);
+    void updateMoveColors();
+    void updateSetColors(GCodeLineSet &set);
+    void visibleRanges(const int *offsets, const QVector<GCodeChunk> &chunks, int firstLayer,
+                       int lastLayer, QVector<QPair<int, int> > &ranges) const;
+    void drawLines(const GCodeLineSet &set, int slot, const QVector<GCodeChunk> &chunks, int feature,
+                   int firstLayer, int lastLayer);
+    // buffer slots: one per level of detail, then the travel moves and the tubes
+    int  travelSlot() const { return m_lodLevels.size(); }
+    int  tubeSlot() const { return m_lodLevels.size() + 1; }   // vertices, normals, indices
+    void buildPickGrid(int layer);
+    void drawReference();
+    void drawDiff();
+    void drawCells(const GCodeCells &cells, int firstLayer, int lastLayer);
+    void shownLayers(int &firstLayer, int &lastLayer) const;
+    void occupancySegments(QVector<OccupancySegment> &segments, QVector<int> &layerFirst);
 
 	float minX, minY, minZ;
 	float maxX, maxY, maxZ;
+	float lastX, lastY;
 	float lastZ;
+	float lastF, lastE;
+	bool relativeE;    // M83
 	int currentLayer;
-    int showLayers;
+    unsigned char currentFeature;
+    int showLayers;     // number of code lines shown
+    int m_firstLayer;   // layers below are hidden
 
     QVector<QVector3D> m_tubeVertices;
     QVector<int> m_tubeIndices;
     QVector<QVector3D> m_tubeNormals;
     QVector<QVector3D> m_prevFacet;
 
+    QVector<unsigned int> m_layerFirstLine;  // first code line of each layer, size = layers + 1
+    QVector<GCodeArcLayer> m_arcLayers;
+    QVector<int> m_arcCached;              // layers with their chords in m_arcLayers
+    qint64 m_arcUse;
+
+    QVector<GCodeLineSet> m_lodLevels;
+    GCodeLineSet m_travel;                 // shared by all levels
+    float m_lodTolerance;
+
+    QVector<GCodeChunk> m_chunks;          // band * tiles + tile, extrusions and tubes
+    QVector<GCodeChunk> m_travelChunks;    // same for the travel moves, they often cross the plate
+    QVector<int> m_tubeOffsets;            // first index of each feature and chunk slot into m_tubeIndices
+    QVector<int> m_tubeMoves;              // code line of each tube triangle
+    QVector<unsigned int> m_tubeColors;    // RGBA per tube vertex, only in heatmap mode
+    int m_tubeColorStamp;
+    int   m_tiles;                         // per side
+    float m_tileX, m_tileY, m_tileSize;    // scene coordinates
+
+    string m_fileName;
+    QVector<SegmentGrid> m_pickGrids;   // extrusions of each layer, built on the first pick
+
+    bool m_featureVisible[FeatureCount];
+    int  m_featureMoves[FeatureCount];
+
+    int   m_colorMode;
+    float m_colorMin, m_colorMax;
+    int   m_colorStamp;                    // bumped when the mapping changes
+    QVector<unsigned int> m_moveColors;    // RGBA per code line
+    int   m_moveColorStamp;
+    GCodeScalars m_moveScalars[ColorModeCount];   // by mode, made the first time it is shown
+
+    GpuBuffers m_buffers;                  // see travelSlot() and tubeSlot()
+    QVector<CompactPositions> m_compactLines;   // by slot, levels of detail and travel moves
+    CompactPositions m_compactTube;
+    QByteArray m_compactTubeNormals;
+    QByteArray m_compactTubeIndices;       // only if 16 bit will do
+    float m_compactNormalError;
+
+    QVector<QVector3D> m_referencePoints;       // scene coordinates, at the layer heights
+    QVector<GCodeOutline> m_referenceOutlines;
+    QVector<int> m_referenceLayers;             // first outline of each layer, size = layers + 1
+
+    GCodeCells m_diffAdded;
+    GCodeCells m_diffRemoved;
+
+    Occupancy  m_occupancy;
+    GCodeCells m_occupancyCells;
+    int        m_occupancyQuery;               // OccupancyQuery shown, -1 for none
+
+    bool m_tubesSkipped;                   // over the memory limit of open(), drawn as lines
+
 };
 
 #endif /* GCode_H_ */
@@ -0,0 +1,247 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "gcodediff.h"
+#include "gcode.h"
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+struct DiffSegment
+{
+    float x0, y0;
+    float x1, y1;
+};
+
+// extrusions of one toolpath, layer after layer
+struct DiffPaths
+{
+    QVector<float> heights;              // see GCode::layerHeights()
+    QVector<int> first;                  // first segment of each layer, size = layers + 1
+    std::vector<DiffSegment> segments;   // gcode x/y
+    QVector<float> times;                // s per layer
+    QVector<float> speeds;               // mm/s per layer
+};
+
+// layers of both toolpaths printed at one height
+struct DiffTask
+{
+    const DiffPaths *paths[2];
+    float cellSize;
+    GCodeLayerDiff *diff;
+};
+
+struct DiffHeight
+{
+    float z;
+    int layer;
+    bool operator<(const DiffHeight &other) const { return z < other.z || (z == other.z && layer < other.layer); }
+};
+
+// Single pass over the code lines, the same move lengths GCode::moveScalars() takes for the
+// layer times. Arcs are tessellated here, so the parallel part never touches the GCode.
+void collectPaths(const GCode &gcode, DiffPaths &paths)
+{
+    const vector<GCodeLine> &lines = gcode.getCodeLines();
+    const int layers = gcode.layerCount();
+    gcode.layerHeights(paths.heights);
+    paths.first.fill(0, layers + 1);
+    paths.times.fill(0, layers);
+    paths.speeds.fill(0, layers);
+    paths.segments.clear();
+    QVector<float> extruded(layers, 0);
+    QVector<QVector3D> points;
+
+    float x = 0, y = 0, z = 0;
+    for (unsigned int i = 0; i < lines.size(); ++i) {
+        const GCodeLine &line = lines[i];
+        const bool inLayer = line.layer >= 0 && line.layer < layers;
+        const bool extrusion = inLayer && line.hasE && line.hasXYZ && line.de > 0;
+        const size_t segments = paths.segments.size();
+        float length = 0;
+        if (line.isArc) {
+            points.clear();
+            gcode.arcChords(i, points);
+            for (int j = 0; j < points.size(); ++j) {
+                length += (points[j] - QVector3D(x, y, z)).length();
+                if (extrusion) {
+                    const DiffSegment segment = { x, y, points[j].x(), points[j].y() };
+                    paths.segments.push_back(segment);
+                }
+                x = points[j].x();
+                y = points[j].y();
+                z = points[j].z();
+            }
+        } else {
+            length = QVector3D(line.x - x, line.y - y, line.z - z).length();
+            if (extrusion) {
+                const DiffSegment segment = { x, y, line.x, line.y };
+                paths.segments.push_back(segment);
+            }
+        }
+        if (inLayer && line.f > 0) {
+            paths.times[line.layer] += length * 60 / line.f;
+            if (extrusion) {
+                paths.speeds[line.layer] += length * line.f / 60;
+                extruded[line.layer] += length;
+            }
+        }
+        if (inLayer)
+            paths.first[line.layer + 1] += int(paths.segments.size() - segments);
+        x = line.x;
+        y = line.y;
+        z = line.z;
+    }
+    for (int layer = 0; layer < layers; ++layer) {
+        paths.first[layer + 1] += paths.first.at(layer);
+        if (extruded.at(layer) > 0)
+            paths.speeds[layer] /= extruded.at(layer);
+    }
+}
+
+void sortedHeights(const QVector<float> &heights, std::vector<DiffHeight> &sorted)
+{
+    for (int layer = 0; layer < heights.size(); ++layer) {
+        if (heights.at(layer) >= 0) {
+            const DiffHeight height = { heights.at(layer), layer };
+            sorted.push_back(height);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+}
+
+// Occupancy grid of both layers, bit 1 for the first toolpath and bit 2 for the other one,
+// with a free cell around so the neighbours of every occupied cell exist.
+void diffLayer(DiffTask &task)
+{
+    GCodeLayerDiff &diff = *task.diff;
+    const int layers[2] = { diff.layer, diff.otherLayer };
+    float min[2] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float max[2] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+    for (int side = 0; side < 2; ++side) {
+        if (layers[side] < 0)
+            continue;
+        const DiffPaths &paths = *task.paths[side];
+        for (int i = paths.first.at(layers[side]); i < paths.first.at(layers[side] + 1); ++i) {
+            const DiffSegment &segment = paths.segments[i];
+            min[0] = qMin(min[0], qMin(segment.x0, segment.x1));
+            min[1] = qMin(min[1], qMin(segment.y0, segment.y1));
+            max[0] = qMax(max[0], qMax(segment.x0, segment.x1));
+            max[1] = qMax(max[1], qMax(segment.y0, segment.y1));
+        }
+    }
+    if (min[0] > max[0])
+        return;
+
+    const float cell = qMax(task.cellSize, qMax(max[0] - min[0], max[1] - min[1]) / (DIFF_MAX_SIDE - 3));
+    const int width = int((max[0] - min[0]) / cell) + 3;
+    const int height = int((max[1] - min[1]) / cell) + 3;
+    const float originX = min[0] - cell, originY = min[1] - cell;
+    std::vector<unsigned char> grid(size_t(width) * height, 0);
+    for (int side = 0; side < 2; ++side) {
+        if (layers[side] < 0)
+            continue;
+        const DiffPaths &paths = *task.paths[side];
+        const unsigned char bit = 1 << side;
+        for (int i = paths.first.at(layers[side]); i < paths.first.at(layers[side] + 1); ++i) {
+            const DiffSegment &segment = paths.segments[i];
+            const float dx = segment.x1 - segment.x0, dy = segment.y1 - segment.y0;
+            const int steps = int(std::sqrt(dx * dx + dy * dy) / (cell * 0.5f)) + 1;
+            for (int step = 0; step <= steps; ++step) {
+                const float t = float(step) / steps;
+                const int cx = int((segment.x0 + dx * t - originX) / cell);
+                const int cy = int((segment.y0 + dy * t - originY) / cell);
+                grid[size_t(cy) * width + cx] |= bit;
+            }
+        }
+    }
+
+    diff.cellSize = cell;
+    for (int cy = 1; cy + 1 < height; ++cy) {
+        for (int cx = 1; cx + 1 < width; ++cx) {
+            const unsigned char *center = &grid[size_t(cy) * width + cx];
+            if (!*center)
+                continue;
+            unsigned char around = 0;
+            for (int ny = -1; ny <= 1; ++ny)
+                around |= center[ny * width - 1] | center[ny * width] | center[ny * width + 1];
+            const QVector2D point(originX + (cx + 0.5f) * cell, originY + (cy + 0.5f) * cell);
+            if ((*center & 1) && !(around & 2)) {
+                ++diff.removed;
+                if (diff.removedCells.size() < DIFF_MAX_LAYER_CELLS)
+                    diff.removedCells.push_back(point);
+            }
+            if ((*center & 2) && !(around & 1)) {
+                ++diff.added;
+                if (diff.addedCells.size() < DIFF_MAX_LAYER_CELLS)
+                    diff.addedCells.push_back(point);
+            } else if (*center & 2) {
+                ++diff.kept;
+            }
+        }
+    }
+}
+
+} // namespace
+
+void diffGCode(const GCode &gcode, const GCode &other, float cellSize, QVector<GCodeLayerDiff> &layers)
+{
+    layers.clear();
+    DiffPaths paths[2];
+    collectPaths(gcode, paths[0]);
+    collectPaths(other, paths[1]);
+
+    // merge both layer stacks by height
+    std::vector<DiffHeight> heights[2];
+    sortedHeights(paths[0].heights, heights[0]);
+    sortedHeights(paths[1].heights, heights[1]);
+    size_t i = 0, j = 0;
+    while (i < heights[0].size() || j < heights[1].size()) {
+        GCodeLayerDiff diff;
+        const bool first = i < heights[0].size();
+        const bool second = j < heights[1].size();
+        if (first && second && qAbs(heights[0][i].z - heights[1][j].z) <= DIFF_Z_TOLERANCE) {
+            diff.layer = heights[0][i++].layer;
+            diff.otherLayer = heights[1][j++].layer;
+        } else if (first && (!second || heights[0][i].z < heights[1][j].z)) {
+            diff.layer = heights[0][i++].layer;
+        } else {
+            diff.otherLayer = heights[1][j++].layer;
+        }
+        diff.z = diff.layer >= 0 ? paths[0].heights.at(diff.layer) : paths[1].heights.at(diff.otherLayer);
+        if (diff.layer >= 0) {
+            diff.time = paths[0].times.at(diff.layer);
+            diff.speed = paths[0].speeds.at(diff.layer);
+        }
+        if (diff.otherLayer >= 0) {
+            diff.otherTime = paths[1].times.at(diff.otherLayer);
+            diff.otherSpeed = paths[1].speeds.at(diff.otherLayer);
+        }
+        layers.push_back(diff);
+    }
+
+    QVector<DiffTask> tasks(layers.size());
+    for (int k = 0; k < layers.size(); ++k) {
+        DiffTask &task = tasks[k];
+        task.paths[0] = &paths[0];
+        task.paths[1] = &paths[1];
+        task.cellSize = cellSize;
+        task.diff = &layers[k];
+    }
+    QtConcurrent::blockingMap(tasks, diffLayer);
+}
@@ -0,0 +1,60 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef GCODEDIFF_H
+#define GCODEDIFF_H
+
+#include <QVector2D>
+#include <QVector>
+
+class GCode;
+
+// Side of the occupancy cells the layers are compared on (mm), about a line width.
+// Layers are paired when their heights differ by less than DIFF_Z_TOLERANCE.
+const float DIFF_CELL_SIZE     = 0.5f;
+const float DIFF_Z_TOLERANCE   = 0.02f;
+const int   DIFF_MAX_SIDE      = 4096;     // cells per side, larger layers get coarser cells
+const int   DIFF_MAX_LAYER_CELLS = 65536;  // changed cells kept per layer for drawing
+
+//! Differences of one layer height between a toolpath and another one.
+struct GCodeLayerDiff
+{
+    GCodeLayerDiff() : z(0), layer(-1), otherLayer(-1), cellSize(0), added(0), removed(0), kept(0),
+                       time(0), otherTime(0), speed(0), otherSpeed(0) {}
+    float z;
+    int   layer;         // in the first toolpath, -1 if only the other one prints at z
+    int   otherLayer;    // in the other toolpath, -1 if only the first one prints at z
+    float cellSize;      // mm
+    int   added;         // cells extruded only by the other toolpath
+    int   removed;       // cells extruded only by the first one
+    int   kept;          // cells of the other toolpath the first one covers as well
+    float time;          // s, length / feedrate of all moves of the layer
+    float otherTime;
+    float speed;         // mm/s, extrusions weighted by length
+    float otherSpeed;
+    QVector<QVector2D> addedCells;     // centers, gcode x/y, at most DIFF_MAX_LAYER_CELLS
+    QVector<QVector2D> removedCells;
+
+    bool changed() const { return added || removed || qAbs(speed - otherSpeed) > 0.01f * qMax(speed, otherSpeed); }
+};
+
+// Pairs the layers of both toolpaths by their heights and compares each pair in parallel:
+// the extrusions are rasterized into cells of cellSize, and a cell counts as added or removed
+// only if the other toolpath extrudes in none of its 8 neighbours either, so paths moved by
+// less than a cell do not show up. Arcs are compared as their chords. Both toolpaths are only
+// read, either may be drawn meanwhile.
+void diffGCode(const GCode &gcode, const GCode &other, float cellSize, QVector<GCodeLayerDiff> &layers);
+
+#endif // GCODEDIFF_H
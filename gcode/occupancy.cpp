@@ -0,0 +1,283 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "occupancy.h"
+#include <QtAlgorithms>
+#include <QtConcurrent/QtConcurrent>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// extrusions of one layer
+struct RasterTask
+{
+    const OccupancySegment *segments;
+    int first, last;
+    float originX, originY;
+    float cellSize;
+    float lineWidth;
+    LayerOccupancy *layer;
+};
+
+// the cells of a window of width * height at left/top with a value >= threshold, in a tight map
+void pack(const std::vector<unsigned char> &values, int left, int top, int width, int height,
+          unsigned char threshold, OccupancyMap &map)
+{
+    int minX = width, minY = height, maxX = -1, maxY = -1;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (values[size_t(y) * width + x] >= threshold) {
+                minX = qMin(minX, x);
+                maxX = qMax(maxX, x);
+                minY = qMin(minY, y);
+                maxY = y;
+            }
+        }
+    }
+    if (maxX < 0) {
+        map = OccupancyMap();
+        return;
+    }
+    map.reset(left + minX, top + minY, maxX - minX + 1, maxY - minY + 1);
+    for (int y = minY; y <= maxY; ++y) {
+        for (int x = minX; x <= maxX; ++x) {
+            if (values[size_t(y) * width + x] >= threshold)
+                map.set(left + x, top + y);
+        }
+    }
+}
+
+// Marks the cells within half a line width of each segment. Passes through the narrower core
+// are counted, unless the cell was last passed by the same run less than a line width of path
+// earlier: corners and short arc chords cross the same cells several times in one pass.
+void rasterizeLayer(RasterTask &task)
+{
+    if (task.first >= task.last)
+        return;
+    const float radius = task.lineWidth * 0.5f;
+    const float core = radius * (1 - OCCUPANCY_OVERLAP_SHARE);
+    const float cell = task.cellSize;
+    float minX = std::numeric_limits<float>::max(), minY = minX;
+    float maxX = -std::numeric_limits<float>::max(), maxY = maxX;
+    for (int i = task.first; i < task.last; ++i) {
+        const OccupancySegment &segment = task.segments[i];
+        minX = qMin(minX, qMin(segment.x0, segment.x1));
+        minY = qMin(minY, qMin(segment.y0, segment.y1));
+        maxX = qMax(maxX, qMax(segment.x0, segment.x1));
+        maxY = qMax(maxY, qMax(segment.y0, segment.y1));
+    }
+    const int left = qMax(int((minX - radius - task.originX) / cell), 0);
+    const int top = qMax(int((minY - radius - task.originY) / cell), 0);
+    const int width = int((maxX + radius - task.originX) / cell) - left + 1;
+    const int height = int((maxY + radius - task.originY) / cell) - top + 1;
+    std::vector<unsigned char> covered(size_t(width) * height, 0);
+    std::vector<unsigned char> passes(covered.size(), 0);
+    std::vector<int> runs(covered.size(), -1);
+    std::vector<float> positions(covered.size(), 0);
+
+    for (int i = task.first; i < task.last; ++i) {
+        const OccupancySegment &segment = task.segments[i];
+        const float dx = segment.x1 - segment.x0, dy = segment.y1 - segment.y0;
+        const float length2 = dx * dx + dy * dy;
+        const float length = std::sqrt(length2);
+        const int x0 = qMax(int((qMin(segment.x0, segment.x1) - radius - task.originX) / cell), left);
+        const int x1 = qMin(int((qMax(segment.x0, segment.x1) + radius - task.originX) / cell), left + width - 1);
+        const int y0 = qMax(int((qMin(segment.y0, segment.y1) - radius - task.originY) / cell), top);
+        const int y1 = qMin(int((qMax(segment.y0, segment.y1) + radius - task.originY) / cell), top + height - 1);
+        for (int y = y0; y <= y1; ++y) {
+            const float py = task.originY + (y + 0.5f) * cell - segment.y0;
+            for (int x = x0; x <= x1; ++x) {
+                const float px = task.originX + (x + 0.5f) * cell - segment.x0;
+                const float t = length2 > 0 ? qBound(0.f, (px * dx + py * dy) / length2, 1.f) : 0;
+                const float ex = px - t * dx, ey = py - t * dy;
+                const float distance2 = ex * ex + ey * ey;
+                if (distance2 > radius * radius)
+                    continue;
+                const size_t k = size_t(y - top) * width + (x - left);
+                covered[k] = 1;
+                if (distance2 > core * core)
+                    continue;
+                const float position = segment.position + t * length;
+                if (runs[k] != segment.run || std::fabs(positions[k] - position) >= task.lineWidth)
+                    passes[k] = passes[k] < 255 ? passes[k] + 1 : 255;
+                runs[k] = segment.run;
+                positions[k] = position;
+            }
+        }
+    }
+    pack(covered, left, top, width, height, 1, task.layer->covered);
+    pack(passes, left, top, width, height, 2, task.layer->overlaps);
+}
+
+} // namespace
+
+void OccupancyMap::reset(int left, int top, int width, int height)
+{
+    m_left = left;
+    m_top = top;
+    m_width = width;
+    m_height = height;
+    m_rowWords = (width + 31) >> 5;
+    m_bits.fill(0, m_rowWords * height);
+}
+
+int OccupancyMap::count() const
+{
+    int count = 0;
+    for (int i = 0; i < m_bits.size(); ++i)
+        count += qPopulationCount(m_bits.at(i));
+    return count;
+}
+
+void Occupancy::build(const QVector<OccupancySegment> &segments, const QVector<int> &layerFirst,
+                      float lineWidth, float cellSize)
+{
+    clear();
+    m_lineWidth = lineWidth;
+    m_cellSize = cellSize;
+    m_layers.resize(qMax(layerFirst.size() - 1, 0));
+    if (segments.isEmpty() || m_layers.isEmpty())
+        return;
+
+    float minX = std::numeric_limits<float>::max(), minY = minX;
+    float maxX = -std::numeric_limits<float>::max(), maxY = maxX;
+    for (int i = 0; i < segments.size(); ++i) {
+        const OccupancySegment &segment = segments.at(i);
+        minX = qMin(minX, qMin(segment.x0, segment.x1));
+        minY = qMin(minY, qMin(segment.y0, segment.y1));
+        maxX = qMax(maxX, qMax(segment.x0, segment.x1));
+        maxY = qMax(maxY, qMax(segment.y0, segment.y1));
+    }
+    const float margin = lineWidth;
+    m_originX = minX - margin;
+    m_originY = minY - margin;
+    m_cellSize = qMax(cellSize, (qMax(maxX - minX, maxY - minY) + 2 * margin) / OCCUPANCY_MAX_SIDE);
+
+    QVector<RasterTask> tasks(m_layers.size());
+    for (int i = 0; i < m_layers.size(); ++i) {
+        RasterTask &task = tasks[i];
+        task.segments = segments.constData();
+        task.first = layerFirst.at(i);
+        task.last = layerFirst.at(i + 1);
+        task.originX = m_originX;
+        task.originY = m_originY;
+        task.cellSize = m_cellSize;
+        task.lineWidth = lineWidth;
+        task.layer = &m_layers[i];
+    }
+    QtConcurrent::blockingMap(tasks, rasterizeLayer);
+}
+
+void Occupancy::clear()
+{
+    m_layers.clear();
+}
+
+// Both passes slide a window of 2 * reach + 1 cells, first along the rows of the layer below,
+// then down the columns of that result.
+void Occupancy::overhangs(int layer, float reach, OccupancyMap &cells) const
+{
+    cells = OccupancyMap();
+    const OccupancyMap &map = covered(layer);
+    int below = layer - 1;
+    while (below >= 0 && covered(below).isEmpty())
+        --below;
+    if (map.isEmpty() || below < 0)
+        return;
+
+    const OccupancyMap &support = covered(below);
+    const int r = qMax(int(reach / m_cellSize + 0.5f), 0);
+    const int width = map.width(), rows = map.height() + 2 * r;
+    std::vector<unsigned char> near(size_t(width) * rows, 0);
+    for (int y = 0; y < rows; ++y) {
+        const int gy = map.top() - r + y;
+        int hits = 0;
+        for (int x = -2 * r; x < width; ++x) {
+            hits += support.test(map.left() + x + r, gy);
+            if (x >= 0) {
+                near[size_t(y) * width + x] = hits > 0;
+                hits -= support.test(map.left() + x - r, gy);
+            }
+        }
+    }
+
+    cells.reset(map.left(), map.top(), width, map.height());
+    for (int x = 0; x < width; ++x) {
+        int hits = 0;
+        for (int y = -2 * r; y < map.height(); ++y) {
+            hits += near[size_t(y + 2 * r) * width + x];
+            if (y >= 0) {
+                if (!hits && map.test(map.left() + x, map.top() + y))
+                    cells.set(map.left() + x, map.top() + y);
+                hits -= near[size_t(y) * width + x];
+            }
+        }
+    }
+}
+
+void Occupancy::gaps(int layer, OccupancyMap &cells) const
+{
+    cells = OccupancyMap();
+    const OccupancyMap &map = covered(layer);
+    if (map.isEmpty())
+        return;
+
+    cells.reset(map.left(), map.top(), map.width(), map.height());
+    for (int y = map.top(); y < map.top() + map.height(); ++y) {
+        int last = -1;
+        for (int x = map.left(); x < map.left() + map.width(); ++x) {
+            if (!map.test(x, y))
+                continue;
+            if (last >= 0 && x - last > 1 && (x - last - 1) * m_cellSize < m_lineWidth) {
+                for (int gap = last + 1; gap < x; ++gap)
+                    cells.set(gap, y);
+            }
+            last = x;
+        }
+    }
+    for (int x = map.left(); x < map.left() + map.width(); ++x) {
+        int last = -1;
+        for (int y = map.top(); y < map.top() + map.height(); ++y) {
+            if (!map.test(x, y))
+                continue;
+            if (last >= 0 && y - last > 1 && (y - last - 1) * m_cellSize < m_lineWidth) {
+                for (int gap = last + 1; gap < y; ++gap)
+                    cells.set(x, gap);
+            }
+            last = y;
+        }
+    }
+}
+
+void Occupancy::query(int kind, int layer, OccupancyMap &cells) const
+{
+    if (kind == OccupancyOverlaps)
+        cells = overlaps(layer);
+    else if (kind == OccupancyOverhangs)
+        overhangs(layer, m_lineWidth * 0.5f, cells);
+    else if (kind == OccupancyGaps)
+        gaps(layer, cells);
+    else
+        cells = OccupancyMap();
+}
+
+int Occupancy::bytes() const
+{
+    int bytes = 0;
+    for (int i = 0; i < m_layers.size(); ++i)
+        bytes += m_layers.at(i).covered.bytes() + m_layers.at(i).overlaps.bytes();
+    return bytes;
+}
@@ -0,0 +1,124 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <QVector2D>
+#include <QVector>
+
+// Default cell side (mm) of the occupancy grid, plates wider than OCCUPANCY_MAX_SIDE cells
+// get coarser cells. Neighbouring lines may share OCCUPANCY_OVERLAP_SHARE of a line width
+// (slicers overlap perimeters a little on purpose) before the cells count as overlaps.
+const float OCCUPANCY_CELL_SIZE     = 0.2f;
+const int   OCCUPANCY_MAX_SIDE      = 4096;
+const float OCCUPANCY_OVERLAP_SHARE = 0.25f;
+
+//! One bit per cell over a window of the grid all layers share, so maps of different
+//! layers line up cell by cell. Cells are addressed in grid coordinates.
+class OccupancyMap
+{
+public:
+    OccupancyMap() : m_left(0), m_top(0), m_width(0), m_height(0), m_rowWords(0) {}
+    void reset(int left, int top, int width, int height);
+    int  left() const { return m_left; }
+    int  top() const { return m_top; }
+    int  width() const { return m_width; }
+    int  height() const { return m_height; }
+    bool isEmpty() const { return m_width == 0 || m_height == 0; }
+    // false outside the window
+    bool test(int x, int y) const {
+        x -= m_left;
+        y -= m_top;
+        if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+            return false;
+        return (m_bits.at(y * m_rowWords + (x >> 5)) >> (x & 31)) & 1;
+    }
+    // the cell must be inside the window
+    void set(int x, int y) {
+        x -= m_left;
+        y -= m_top;
+        m_bits[y * m_rowWords + (x >> 5)] |= 1u << (x & 31);
+    }
+    int  count() const;
+    int  bytes() const { return m_bits.size() * sizeof(quint32); }
+
+private:
+    int m_left, m_top;
+    int m_width, m_height;
+    int m_rowWords;
+    QVector<quint32> m_bits;   // rows of m_rowWords words, bit x & 31 of word x >> 5
+};
+
+// a straight piece of extrusion, arcs are split into their chords
+struct OccupancySegment
+{
+    float x0, y0;
+    float x1, y1;
+    int   run;        // extrusions without a travel move in between share the run
+    float position;   // length of the run up to x0/y0 (mm)
+};
+
+enum OccupancyQuery
+{
+    OccupancyOverlaps,    // cells two passes extrude over
+    OccupancyOverhangs,   // cells not within reach of the layer below
+    OccupancyGaps,        // free cells narrower than a line between extrusions
+    OccupancyQueryCount
+};
+
+struct LayerOccupancy
+{
+    OccupancyMap covered;    // within half a line width of an extrusion
+    OccupancyMap overlaps;
+};
+
+//! ============= Occupancy ===============
+//! The extrusions of every layer rasterized into bitmaps, layers in parallel.
+//! Overlaps are counted while rasterizing, overhangs and gaps are found on request.
+class Occupancy
+{
+public:
+    Occupancy() : m_originX(0), m_originY(0), m_cellSize(0), m_lineWidth(0) {}
+    // segments of layer i are segments[layerFirst[i]] up to segments[layerFirst[i + 1]]
+    void build(const QVector<OccupancySegment> &segments, const QVector<int> &layerFirst,
+               float lineWidth, float cellSize = OCCUPANCY_CELL_SIZE);
+    void clear();
+    bool isEmpty() const { return m_layers.isEmpty(); }
+    int  layerCount() const { return m_layers.size(); }
+    float cellSize() const { return m_cellSize; }
+    // gcode x/y of a cell center
+    QVector2D cellCenter(int x, int y) const {
+        return QVector2D(m_originX + (x + 0.5f) * m_cellSize, m_originY + (y + 0.5f) * m_cellSize);
+    }
+    const OccupancyMap &covered(int layer) const { return m_layers.at(layer).covered; }
+    const OccupancyMap &overlaps(int layer) const { return m_layers.at(layer).overlaps; }
+    // Covered cells farther than reach (mm) from the next lower layer with extrusions,
+    // nothing for the lowest one, it sits on the bed.
+    void overhangs(int layer, float reach, OccupancyMap &cells) const;
+    // free cells between extrusions of the layer less than a line width apart along x or y
+    void gaps(int layer, OccupancyMap &cells) const;
+    // one of OccupancyQuery, overhangs within half a line width
+    void query(int kind, int layer, OccupancyMap &cells) const;
+    int  bytes() const;
+
+private:
+    float m_originX, m_originY;   // gcode x/y of the grid corner
+    float m_cellSize;
+    float m_lineWidth;
+    QVector<LayerOccupancy> m_layers;
+};
+
+#endif // OCCUPANCY_H
@@ -0,0 +1,181 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "segmentgrid.h"
+#include <QtGlobal>
+#include <cmath>
+#include <limits>
+
+const float GRID_MIN_CELL = 0.5f;   // mm
+const int   GRID_SEGMENTS_PER_CELL = 4;
+
+SegmentGrid::SegmentGrid()
+    : m_minX(0)
+    , m_minY(0)
+    , m_cellSize(1)
+    , m_columns(0)
+    , m_rows(0)
+    , m_built(false)
+{
+
+}
+
+int SegmentGrid::bytes() const
+{
+    return m_segments.capacity() * sizeof(GridSegment)
+           + (m_cellStart.capacity() + m_cellSegments.capacity()) * sizeof(int);
+}
+
+void SegmentGrid::clear()
+{
+    m_segments.clear();
+    m_cellStart.clear();
+    m_cellSegments.clear();
+    m_columns = m_rows = 0;
+    m_built = false;
+}
+
+void SegmentGrid::addSegment(float x0, float y0, float x1, float y1, int id)
+{
+    GridSegment segment = { x0, y0, x1, y1, id };
+    m_segments.push_back(segment);
+}
+
+// walks the cells crossed by the segment (Amanatides-Woo).
+template <typename Visitor>
+void SegmentGrid::visitCells(const GridSegment &segment, Visitor &visitor) const
+{
+    const float x0 = (segment.x0 - m_minX) / m_cellSize, y0 = (segment.y0 - m_minY) / m_cellSize;
+    const float x1 = (segment.x1 - m_minX) / m_cellSize, y1 = (segment.y1 - m_minY) / m_cellSize;
+    int column = qBound(0, int(x0), m_columns - 1), row = qBound(0, int(y0), m_rows - 1);
+    const int lastColumn = qBound(0, int(x1), m_columns - 1), lastRow = qBound(0, int(y1), m_rows - 1);
+
+    const float dx = x1 - x0, dy = y1 - y0;
+    const int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+    const float infinity = std::numeric_limits<float>::max();
+    const float deltaX = dx != 0 ? qAbs(1 / dx) : infinity;
+    const float deltaY = dy != 0 ? qAbs(1 / dy) : infinity;
+    float maxX = dx != 0 ? ((stepX > 0 ? column + 1 - x0 : x0 - column) * deltaX) : infinity;
+    float maxY = dy != 0 ? ((stepY > 0 ? row + 1 - y0 : y0 - row) * deltaY) : infinity;
+
+    visitor(cellIndex(column, row));
+    int steps = qAbs(lastColumn - column) + qAbs(lastRow - row);
+    while (steps-- > 0) {
+        if (maxX < maxY) {
+            maxX += deltaX;
+            column += stepX;
+        } else {
+            maxY += deltaY;
+            row += stepY;
+        }
+        if (column < 0 || column >= m_columns || row < 0 || row >= m_rows)
+            break;
+        visitor(cellIndex(column, row));
+    }
+}
+
+struct GridCounter
+{
+    QVector<int> *counts;
+    void operator()(int cell) { ++(*counts)[cell + 1]; }
+};
+
+struct GridFiller
+{
+    QVector<int> *cursor;
+    QVector<int> *entries;
+    int segment;
+    void operator()(int cell) { (*entries)[(*cursor)[cell]++] = segment; }
+};
+
+void SegmentGrid::build()
+{
+    m_built = true;
+    if (m_segments.isEmpty())
+        return;
+
+    float minX = m_segments.at(0).x0, maxX = minX;
+    float minY = m_segments.at(0).y0, maxY = minY;
+    for (int i = 0; i < m_segments.size(); ++i) {
+        const GridSegment &s = m_segments.at(i);
+        minX = qMin(minX, qMin(s.x0, s.x1));
+        maxX = qMax(maxX, qMax(s.x0, s.x1));
+        minY = qMin(minY, qMin(s.y0, s.y1));
+        maxY = qMax(maxY, qMax(s.y0, s.y1));
+    }
+
+    // about GRID_SEGMENTS_PER_CELL segments per cell on an evenly filled layer.
+    const float area = qMax(maxX - minX, GRID_MIN_CELL) * qMax(maxY - minY, GRID_MIN_CELL);
+    m_cellSize = qMax(GRID_MIN_CELL, float(sqrt(area * GRID_SEGMENTS_PER_CELL / m_segments.size())));
+    m_minX = minX;
+    m_minY = minY;
+    m_columns = int((maxX - minX) / m_cellSize) + 1;
+    m_rows = int((maxY - minY) / m_cellSize) + 1;
+
+    // count, prefix sum, fill
+    m_cellStart.fill(0, m_columns * m_rows + 1);
+    GridCounter counter = { &m_cellStart };
+    for (int i = 0; i < m_segments.size(); ++i)
+        visitCells(m_segments.at(i), counter);
+    for (int i = 1; i < m_cellStart.size(); ++i)
+        m_cellStart[i] += m_cellStart[i - 1];
+
+    m_cellSegments.resize(m_cellStart.last());
+    QVector<int> cursor = m_cellStart;
+    GridFiller filler = { &cursor, &m_cellSegments, 0 };
+    for (int i = 0; i < m_segments.size(); ++i) {
+        filler.segment = i;
+        visitCells(m_segments.at(i), filler);
+    }
+    m_segments.squeeze();
+}
+
+int SegmentGrid::nearest(float x, float y, float maxDistance, int maxId, float &distance) const
+{
+    if (!m_built || m_segments.isEmpty())
+        return -1;
+
+    const int firstColumn = qMax(0, int(floor((x - maxDistance - m_minX) / m_cellSize)));
+    const int lastColumn  = qMin(m_columns - 1, int(floor((x + maxDistance - m_minX) / m_cellSize)));
+    const int firstRow    = qMax(0, int(floor((y - maxDistance - m_minY) / m_cellSize)));
+    const int lastRow     = qMin(m_rows - 1, int(floor((y + maxDistance - m_minY) / m_cellSize)));
+
+    int best = -1;
+    float bestDistance2 = maxDistance * maxDistance;
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const int cell = cellIndex(column, row);
+            for (int i = m_cellStart.at(cell); i < m_cellStart.at(cell + 1); ++i) {
+                const GridSegment &s = m_segments.at(m_cellSegments.at(i));
+                if (s.id >= maxId)
+                    continue;
+
+                const float dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+                const float length2 = dx * dx + dy * dy;
+                float t = length2 > 0 ? ((x - s.x0) * dx + (y - s.y0) * dy) / length2 : 0;
+                t = qBound(0.f, t, 1.f);
+                const float ex = s.x0 + t * dx - x, ey = s.y0 + t * dy - y;
+                const float distance2 = ex * ex + ey * ey;
+                if (distance2 <= bestDistance2) {
+                    bestDistance2 = distance2;
+                    best = s.id;
+                }
+            }
+        }
+    }
+
+    distance = sqrt(bestDistance2);
+    return best;
+}
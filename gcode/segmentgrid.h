@@ -0,0 +1,58 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef SEGMENTGRID_H
+#define SEGMENTGRID_H
+
+#include <QVector>
+
+struct GridSegment
+{
+    float x0, y0;
+    float x1, y1;
+    int id;
+};
+
+//! Uniform 2D grid over line segments for nearest-segment queries.
+//! Segments are added first, build() then sorts them into the cells they cross.
+class SegmentGrid
+{
+public:
+    SegmentGrid();
+
+    void clear();
+    void addSegment(float x0, float y0, float x1, float y1, int id);
+    void build();
+    bool isBuilt() const { return m_built; }
+    int  segmentCount() const { return m_segments.size(); }
+    int  bytes() const;
+
+    // id of the nearest segment within maxDistance whose id is below maxId, -1 if none.
+    int  nearest(float x, float y, float maxDistance, int maxId, float &distance) const;
+
+private:
+    template <typename Visitor> void visitCells(const GridSegment &segment, Visitor &visitor) const;
+    int  cellIndex(int column, int row) const { return row * m_columns + column; }
+
+    QVector<GridSegment> m_segments;
+    QVector<int> m_cellStart;      // first entry of each cell in m_cellSegments, size = cells + 1
+    QVector<int> m_cellSegments;   // indices into m_segments
+    float m_minX, m_minY;
+    float m_cellSize;
+    int m_columns, m_rows;
+    bool m_built;
+};
+
+#endif // SEGMENTGRID_H
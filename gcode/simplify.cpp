@@ -0,0 +1,82 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "simplify.h"
+#include <QPair>
+
+// squared distance of p to the segment a-b
+static float distanceToSegment2(const QVector3D &p, const QVector3D &a, const QVector3D &b)
+{
+    const QVector3D ab = b - a;
+    const QVector3D ap = p - a;
+    const float length2 = QVector3D::dotProduct(ab, ab);
+    float t = length2 > 0 ? QVector3D::dotProduct(ap, ab) / length2 : 0;
+    if (t < 0)
+        t = 0;
+    else if (t > 1)
+        t = 1;
+    return (ap - ab * t).lengthSquared();
+}
+
+int simplifyPolyline(const QVector3D *points, int count, float tolerance, QVector<QVector3D> &out,
+                     QVector<int> *indices)
+{
+    if (count <= 2) {
+        for (int i = 0; i < count; ++i) {
+            out.push_back(points[i]);
+            if (indices)
+                indices->push_back(i);
+        }
+        return count;
+    }
+
+    const float tolerance2 = tolerance * tolerance;
+    QVector<bool> keep(count, false);
+    keep[0] = keep[count - 1] = true;
+
+    // explicit stack, perimeters can have tens of thousands of points.
+    QVector<QPair<int, int> > stack;
+    stack.push_back(qMakePair(0, count - 1));
+    while (!stack.isEmpty()) {
+        const QPair<int, int> range = stack.last();
+        stack.pop_back();
+
+        int farthest = -1;
+        float maxDistance2 = tolerance2;
+        for (int i = range.first + 1; i < range.second; ++i) {
+            const float d2 = distanceToSegment2(points[i], points[range.first], points[range.second]);
+            if (d2 > maxDistance2) {
+                maxDistance2 = d2;
+                farthest = i;
+            }
+        }
+
+        if (farthest < 0)
+            continue;
+        keep[farthest] = true;
+        stack.push_back(qMakePair(range.first, farthest));
+        stack.push_back(qMakePair(farthest, range.second));
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; ++i) {
+        if (keep.at(i)) {
+            out.push_back(points[i]);
+            if (indices)
+                indices->push_back(i);
+            ++kept;
+        }
+    }
+    return kept;
+}
@@ -0,0 +1,27 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <QVector3D>
+#include <QVector>
+
+//! Douglas-Peucker simplification of a polyline. The kept points (always including
+//! the first and the last one) are appended to out, their positions in points to indices
+//! if given. Returns the number of points appended.
+int simplifyPolyline(const QVector3D *points, int count, float tolerance, QVector<QVector3D> &out,
+                     QVector<int> *indices = 0);
+
+#endif // SIMPLIFY_H
@@ -0,0 +1,76 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "gpubuffers.h"
+#include "gpuuploader.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+GpuBuffers::~GpuBuffers()
+{
+    clear();
+}
+
+void GpuBuffers::set(int slot, unsigned int id, GpuUploader *uploader)
+{
+    release(slot);
+    if (m_ids.size() <= slot)
+        m_ids.resize(slot + 1);
+    m_ids[slot] = id;
+    m_uploader = uploader;
+}
+
+void GpuBuffers::release(int slot)
+{
+    if (slot >= m_ids.size() || !m_ids.at(slot))
+        return;
+    if (m_uploader)
+        m_uploader->release(QVector<unsigned int>() << m_ids.at(slot));
+    m_ids[slot] = 0;
+}
+
+void GpuBuffers::clear()
+{
+    QVector<unsigned int> ids;
+    for (int i = 0; i < m_ids.size(); ++i) {
+        if (m_ids.at(i))
+            ids.push_back(m_ids.at(i));
+    }
+    if (!ids.isEmpty() && m_uploader)
+        m_uploader->release(ids);
+    m_ids.clear();
+}
+
+const void *GpuBuffers::bind(int slot, unsigned int target, const void *clientData) const
+{
+    if (m_ids.isEmpty())
+        return clientData;
+
+    // another slot of ours may still be bound to target
+    const unsigned int buffer = id(slot);
+    QOpenGLContext::currentContext()->functions()->glBindBuffer(target, buffer);
+    return buffer ? 0 : clientData;
+}
+
+void GpuBuffers::unbind() const
+{
+    if (m_ids.isEmpty())
+        return;
+
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,79 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef GPUBUFFERS_H
+#define GPUBUFFERS_H
+
+#include <QByteArray>
+#include <QVector3D>
+#include <QVector>
+#include <QMetaType>
+
+class GpuUploader;
+
+// One client side array to be copied into a buffer object. The arrays are implicitly
+// shared copies, so the owner may replace its own while the upload is running.
+struct GpuArray
+{
+    GpuArray() : target(0), slot(0), buffer(0), offset(0), base(0) {}
+    unsigned int target;             // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+    int slot;                        // see Model::gpuArrays()
+    unsigned int buffer;             // filled in by the uploader, unless given (a GpuPool page)
+    int offset;                      // bytes into a given buffer
+    int base;                        // added to the indices on the way into a given buffer
+    QVector<QVector3D> vertices;
+    QVector<int> indices;
+    QByteArray packed;               // any other layout, see compactvertices.h
+
+    int bytes() const { return vertices.size() * sizeof(QVector3D) + indices.size() * sizeof(int) + packed.size(); }
+    const char *data() const {
+        if (!packed.isEmpty())
+            return packed.constData();
+        return vertices.isEmpty() ? (const char *)indices.constData() : (const char *)vertices.constData();
+    }
+};
+
+Q_DECLARE_METATYPE(GpuArray)
+
+//! Buffer objects of one owner by slot. Slots without a buffer (not uploaded yet, or dropped
+//! because the data changed) are drawn from the client side arrays as before, so the
+//! owner can be rendered at any time, also by contexts that never upload (Thumbnailer).
+class GpuBuffers
+{
+public:
+    GpuBuffers() : m_uploader(0) {}
+    ~GpuBuffers();
+
+    bool isEmpty() const { return m_ids.isEmpty(); }
+    unsigned int id(int slot) const { return slot < m_ids.size() ? m_ids.at(slot) : 0; }
+    void set(int slot, unsigned int id, GpuUploader *uploader);
+    void release(int slot);
+    void clear();
+
+    // binds the buffer of slot to target and returns the offset to pass to gl*Pointer or
+    // glDrawElements, or clientData when the slot has no buffer.
+    const void *bind(int slot, unsigned int target, const void *clientData) const;
+    // back to client arrays, must follow every bind() before other arrays are set up.
+    void unbind() const;
+
+private:
+    GpuBuffers(const GpuBuffers &);
+    GpuBuffers &operator=(const GpuBuffers &);
+
+    QVector<unsigned int> m_ids;
+    GpuUploader *m_uploader;    // deletes the buffers on its own context
+};
+
+#endif // GPUBUFFERS_H
@@ -0,0 +1,258 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "gpupool.h"
+#include "gpuuploader.h"
+#include "profiler.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QDebug>
+
+typedef void (QOPENGLF_APIENTRYP MultiDrawElements)(GLenum mode, const GLsizei *count, GLenum type,
+                                                    const GLvoid *const *indices, GLsizei drawcount);
+
+namespace {
+
+// first fit, -1 if no free range is large enough
+int takeRange(QMap<int, int> &free, int count)
+{
+    for (QMap<int, int>::iterator it = free.begin(); it != free.end(); ++it) {
+        if (it.value() < count)
+            continue;
+        const int first = it.key();
+        const int rest = it.value() - count;
+        free.erase(it);
+        if (rest > 0)
+            free.insert(first + count, rest);
+        return first;
+    }
+    return -1;
+}
+
+void giveRange(QMap<int, int> &free, int first, int count)
+{
+    if (count <= 0)
+        return;
+    QMap<int, int>::iterator next = free.lowerBound(first);
+    if (next != free.begin()) {
+        QMap<int, int>::iterator previous = next - 1;
+        if (previous.key() + previous.value() == first) {
+            first = previous.key();
+            count += previous.value();
+            free.erase(previous);
+        }
+    }
+    next = free.lowerBound(first);
+    if (next != free.end() && first + count == next.key()) {
+        count += next.value();
+        free.erase(next);
+    }
+    free.insert(first, count);
+}
+
+} // namespace
+
+//! ============= GpuPool ===============
+GpuPool::~GpuPool()
+{
+    clear();
+}
+
+bool GpuPool::allocate(int vertices, int indices, GpuPoolBlock &block)
+{
+    block = GpuPoolBlock();
+    if (vertices <= 0 || indices <= 0)
+        return false;
+
+    int page = -1;
+    int firstVertex = -1, firstIndex = -1;
+    for (int i = 0; i < m_pages.size() && page < 0; ++i) {
+        Page &candidate = m_pages[i];
+        if (!candidate.buffers[Positions])
+            continue;
+        firstVertex = takeRange(candidate.freeVertices, vertices);
+        if (firstVertex < 0)
+            continue;
+        firstIndex = takeRange(candidate.freeIndices, indices);
+        if (firstIndex < 0) {
+            giveRange(candidate.freeVertices, firstVertex, vertices);
+            continue;
+        }
+        page = i;
+    }
+    if (page < 0) {
+        page = createPage(qMax(vertices, GPU_POOL_PAGE_VERTICES), qMax(indices, GPU_POOL_PAGE_INDICES));
+        if (page < 0)
+            return false;
+        firstVertex = takeRange(m_pages[page].freeVertices, vertices);
+        firstIndex = takeRange(m_pages[page].freeIndices, indices);
+    }
+
+    Page &target = m_pages[page];
+    target.usedVertices += vertices;
+    target.usedIndices += indices;
+    block.page = page;
+    block.firstVertex = firstVertex;
+    block.vertices = vertices;
+    block.firstIndex = firstIndex;
+    block.indices = indices;
+    return true;
+}
+
+void GpuPool::free(const GpuPoolBlock &block)
+{
+    if (!block.isValid() || block.page >= m_pages.size())
+        return;
+    Page &page = m_pages[block.page];
+    if (!page.buffers[Positions])
+        return;
+    giveRange(page.freeVertices, block.firstVertex, block.vertices);
+    giveRange(page.freeIndices, block.firstIndex, block.indices);
+    page.usedVertices -= block.vertices;
+    page.usedIndices -= block.indices;
+    // pages made for one large mesh don't stay around empty
+    if (page.usedVertices == 0 && (page.vertexCapacity > GPU_POOL_PAGE_VERTICES
+                                   || page.indexCapacity > GPU_POOL_PAGE_INDICES))
+        releasePage(page);
+}
+
+void GpuPool::clear()
+{
+    for (int i = 0; i < m_pages.size(); ++i)
+        releasePage(m_pages[i]);
+    m_pages.clear();
+}
+
+unsigned int GpuPool::buffer(int page, Buffer buffer) const
+{
+    return page >= 0 && page < m_pages.size() ? m_pages.at(page).buffers[buffer] : 0;
+}
+
+bool GpuPool::owns(unsigned int buffer) const
+{
+    for (int i = 0; i < m_pages.size() && buffer; ++i) {
+        for (int j = 0; j < BufferCount; ++j) {
+            if (m_pages.at(i).buffers[j] == buffer)
+                return true;
+        }
+    }
+    return false;
+}
+
+void GpuPool::draw(int page, const QVector<QPair<int, int> > &ranges)
+{
+    PROFILE_SCOPE("GpuPool::draw");
+    if (ranges.isEmpty() || !buffer(page, Positions))
+        return;
+    const Page &source = m_pages.at(page);
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+    gl->glBindBuffer(GL_ARRAY_BUFFER, source.buffers[Positions]);
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    gl->glBindBuffer(GL_ARRAY_BUFFER, source.buffers[Normals]);
+    glNormalPointer(GL_FLOAT, 0, 0);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, source.buffers[Indices]);
+
+    // neighbouring ranges (of one model's culled chunks) are joined
+    m_counts.clear();
+    m_offsets.clear();
+    int end = -1;
+    for (int i = 0; i < ranges.size(); ++i) {
+        if (ranges.at(i).first == end) {
+            m_counts.last() += ranges.at(i).second;
+        } else {
+            m_counts.push_back(ranges.at(i).second);
+            m_offsets.push_back((const char *)0 + ranges.at(i).first * sizeof(int));
+        }
+        end = ranges.at(i).first + ranges.at(i).second;
+    }
+    if (m_multiDrawElements) {
+        ((MultiDrawElements)m_multiDrawElements)(GL_TRIANGLES, m_counts.constData(), GL_UNSIGNED_INT,
+                                                 m_offsets.constData(), m_counts.size());
+    } else {
+        for (int i = 0; i < m_counts.size(); ++i)
+            glDrawElements(GL_TRIANGLES, m_counts.at(i), GL_UNSIGNED_INT, m_offsets.at(i));
+    }
+    gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+qint64 GpuPool::capacityBytes() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_pages.size(); ++i) {
+        if (m_pages.at(i).buffers[Positions])
+            bytes += qint64(m_pages.at(i).vertexCapacity) * 2 * 3 * sizeof(float)
+                   + qint64(m_pages.at(i).indexCapacity) * sizeof(int);
+    }
+    return bytes;
+}
+
+qint64 GpuPool::usedBytes() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_pages.size(); ++i)
+        bytes += qint64(m_pages.at(i).usedVertices) * 2 * 3 * sizeof(float)
+               + qint64(m_pages.at(i).usedIndices) * sizeof(int);
+    return bytes;
+}
+
+// storage only, the uploader fills it in through the shared context.
+int GpuPool::createPage(int vertices, int indices)
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context) {
+        qWarning("GpuPool: no current context to create a page in");
+        return -1;
+    }
+    if (!m_multiDrawElements)
+        m_multiDrawElements = context->getProcAddress("glMultiDrawElements");
+
+    int index = 0;
+    while (index < m_pages.size() && m_pages.at(index).buffers[Positions])
+        ++index;
+    if (index == m_pages.size())
+        m_pages.resize(index + 1);
+    Page &page = m_pages[index];
+    page = Page();
+    page.vertexCapacity = vertices;
+    page.indexCapacity = indices;
+    page.freeVertices.insert(0, vertices);
+    page.freeIndices.insert(0, indices);
+
+    QOpenGLFunctions *gl = context->functions();
+    gl->glGenBuffers(BufferCount, page.buffers);
+    const qint64 vertexBytes = qint64(vertices * 3 * sizeof(float));
+    const qint64 bytes[BufferCount] = { vertexBytes, vertexBytes, qint64(indices * sizeof(int)) };
+    for (int i = 0; i < BufferCount; ++i) {
+        const GLenum target = i == Indices ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
+        gl->glBindBuffer(target, page.buffers[i]);
+        gl->glBufferData(target, bytes[i], 0, GL_STATIC_DRAW);
+        gl->glBindBuffer(target, 0);
+    }
+    qDebug() << Q_FUNC_INFO << index << vertices << "vertices" << indices << "indices";
+    return index;
+}
+
+void GpuPool::releasePage(Page &page)
+{
+    if (!page.buffers[Positions])
+        return;
+    QVector<unsigned int> ids;
+    for (int i = 0; i < BufferCount; ++i)
+        ids.push_back(page.buffers[i]);
+    if (m_uploader)
+        m_uploader->release(ids);
+    page = Page();
+}
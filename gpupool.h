@@ -0,0 +1,101 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef GPUPOOL_H
+#define GPUPOOL_H
+
+#include <QMap>
+#include <QPair>
+#include <QVector>
+
+class GpuUploader;
+
+// Capacity of a shared page. Meshes that don't fit get a page of their own size.
+const int GPU_POOL_PAGE_VERTICES = 1 << 20;   // 12 MB of positions and as much of normals
+const int GPU_POOL_PAGE_INDICES  = 1 << 22;   // 16 MB
+
+// Where the mesh of one model lives in a GpuPool, counted in vertices and indices.
+struct GpuPoolBlock
+{
+    GpuPoolBlock() : page(-1), firstVertex(0), vertices(0), firstIndex(0), indices(0) {}
+    bool isValid() const { return page >= 0; }
+    int page;
+    int firstVertex;
+    int vertices;
+    int firstIndex;   // the indices are rebased onto firstVertex when uploaded
+    int indices;
+};
+
+//! Buffer objects shared by the meshes of all models. Each page holds float positions,
+//! float normals and int indices, and a mesh takes one range of each from the same page,
+//! so adding or removing a model leaves the others in place, and all the meshes in a
+//! page are drawn with one glMultiDrawElements. Only pages are created here, the data
+//! goes through the GpuUploader like any other array (see GpuArray::offset).
+class GpuPool
+{
+public:
+    enum Buffer { Positions, Normals, Indices, BufferCount };
+
+    GpuPool() : m_uploader(0), m_multiDrawElements(0) {}
+    ~GpuPool();
+
+    // Needs the view's context current if a new page has to be made.
+    bool allocate(int vertices, int indices, GpuPoolBlock &block);
+    // the range may be reused right away, so only once nothing draws from it anymore.
+    void free(const GpuPoolBlock &block);
+    // drops all pages, the blocks handed out become invalid.
+    void clear();
+    // pages go back to the uploader, which deletes them on its own context
+    void setUploader(GpuUploader *uploader) { m_uploader = uploader; }
+
+    int pages() const { return m_pages.size(); }
+    unsigned int buffer(int page, Buffer buffer) const;
+    bool owns(unsigned int buffer) const;
+    // Draws the index ranges (first, count) of page as GL_TRIANGLES in one call, the vertex
+    // and normal arrays must be enabled.
+    void draw(int page, const QVector<QPair<int, int> > &ranges);
+
+    qint64 capacityBytes() const;
+    qint64 usedBytes() const;
+
+private:
+    GpuPool(const GpuPool &);
+    GpuPool &operator=(const GpuPool &);
+
+    struct Page
+    {
+        Page() : vertexCapacity(0), indexCapacity(0), usedVertices(0), usedIndices(0) {
+            for (int i = 0; i < BufferCount; ++i)
+                buffers[i] = 0;
+        }
+        unsigned int buffers[BufferCount];   // 0 once released, the slot is reused
+        int vertexCapacity;
+        int indexCapacity;
+        int usedVertices;
+        int usedIndices;
+        QMap<int, int> freeVertices;         // first -> count, coalesced
+        QMap<int, int> freeIndices;
+    };
+
+    int  createPage(int vertices, int indices);
+    void releasePage(Page &page);
+
+    QVector<Page> m_pages;
+    GpuUploader *m_uploader;
+    QFunctionPointer m_multiDrawElements;    // GL 1.4, resolved with the first page
+    QVector<int> m_counts;                   // scratch of draw()
+    QVector<const void *> m_offsets;
+};
+
+#endif // GPUPOOL_H
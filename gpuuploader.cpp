@@ -0,0 +1,161 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "gpuuploader.h"
+#include "profiler.h"
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QDebug>
+
+//! ============= GpuUploadWorker ===============
+GpuUploadWorker::GpuUploadWorker(QOpenGLContext *context, QOffscreenSurface *surface)
+    : m_context(context)
+    , m_surface(surface)
+{
+}
+
+void GpuUploadWorker::upload(int ticket, QVector<GpuArray> arrays)
+{
+    PROFILE_SCOPE("GpuUploadWorker::upload");
+    if (!m_context->makeCurrent(m_surface)) {
+        qWarning("GpuUploader: cannot make the upload context current");
+        emit uploaded(ticket, QVector<GpuArray>());
+        return;
+    }
+
+    QOpenGLFunctions *gl = m_context->functions();
+    qint64 total = 0;
+    for (int i = 0; i < arrays.size(); ++i) {
+        GpuArray &array = arrays[i];
+        const int bytes = array.bytes();
+        if (bytes == 0)
+            continue;
+
+        const char *data = array.data();
+        if (array.buffer) {
+            // a range of a shared buffer, see GpuPool
+            gl->glBindBuffer(array.target, array.buffer);
+        } else {
+            gl->glGenBuffers(1, &array.buffer);
+            gl->glBindBuffer(array.target, array.buffer);
+            gl->glBufferData(array.target, bytes, 0, GL_STATIC_DRAW);
+            array.offset = 0;
+        }
+        const bool rebase = array.base != 0 && !array.indices.isEmpty();
+        for (int offset = 0; offset < bytes; offset += GPU_UPLOAD_CHUNK) {
+            const int size = qMin(GPU_UPLOAD_CHUNK, bytes - offset);
+            if (rebase) {
+                m_rebased.resize(size / sizeof(int));
+                const int *indices = (const int *)(data + offset);
+                for (int j = 0; j < m_rebased.size(); ++j)
+                    m_rebased[j] = indices[j] + array.base;
+            }
+            gl->glBufferSubData(array.target, array.offset + offset, size,
+                                rebase ? (const char *)m_rebased.constData() : data + offset);
+            gl->glFlush();
+        }
+        gl->glBindBuffer(array.target, 0);
+        total += bytes;
+
+        // the owner keeps its arrays, our references go before the result travels back.
+        array.vertices = QVector<QVector3D>();
+        array.indices = QVector<int>();
+        array.packed = QByteArray();
+    }
+    // the view's context may only use the buffers once they are complete.
+    gl->glFinish();
+    m_context->doneCurrent();
+
+    qDebug() << Q_FUNC_INFO << ticket << arrays.size() << "buffers" << total << "bytes";
+    emit uploaded(ticket, arrays);
+}
+
+void GpuUploadWorker::release(QVector<unsigned int> ids)
+{
+    if (!m_context->makeCurrent(m_surface))
+        return;
+    m_context->functions()->glDeleteBuffers(ids.size(), ids.constData());
+    m_context->doneCurrent();
+}
+
+//! ============= GpuUploader ===============
+GpuUploader::GpuUploader(QObject *parent)
+    : QObject(parent)
+    , m_surface(0)
+    , m_context(0)
+    , m_worker(0)
+    , m_ticket(0)
+{
+    QOpenGLContext *shareContext = QOpenGLContext::currentContext();
+    if (!shareContext) {
+        qWarning("GpuUploader: no current context to share the buffers with");
+        return;
+    }
+
+    qRegisterMetaType<QVector<GpuArray> >("QVector<GpuArray>");
+    qRegisterMetaType<QVector<unsigned int> >("QVector<unsigned int>");
+
+    // the surface has to be created on the GUI thread, the context is moved afterwards.
+    m_surface = new QOffscreenSurface;
+    m_surface->setFormat(shareContext->format());
+    m_surface->create();
+
+    m_context = new QOpenGLContext;
+    m_context->setFormat(shareContext->format());
+    m_context->setShareContext(shareContext);
+    if (!m_context->create() || !QOpenGLContext::areSharing(m_context, shareContext)) {
+        qWarning("GpuUploader: cannot create a shared context, models are drawn from client arrays");
+        delete m_context;
+        m_context = 0;
+        delete m_surface;
+        m_surface = 0;
+        return;
+    }
+    m_context->moveToThread(&m_thread);
+
+    m_worker = new GpuUploadWorker(m_context, m_surface);
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, SIGNAL(finished()), m_worker, SLOT(deleteLater()));
+    connect(m_worker, SIGNAL(uploaded(int,QVector<GpuArray>)), this, SIGNAL(uploaded(int,QVector<GpuArray>)));
+    m_thread.start();
+}
+
+GpuUploader::~GpuUploader()
+{
+    if (m_worker) {
+        m_thread.quit();
+        m_thread.wait();
+    }
+    delete m_context;
+    delete m_surface;
+}
+
+int GpuUploader::upload(const QVector<GpuArray> &arrays)
+{
+    if (!m_worker)
+        return 0;
+    const int ticket = ++m_ticket;
+    QMetaObject::invokeMethod(m_worker, "upload", Qt::QueuedConnection,
+                              Q_ARG(int, ticket), Q_ARG(QVector<GpuArray>, arrays));
+    return ticket;
+}
+
+void GpuUploader::release(const QVector<unsigned int> &ids)
+{
+    if (m_worker)
+        QMetaObject::invokeMethod(m_worker, "release", Qt::QueuedConnection, Q_ARG(QVector<unsigned int>, ids));
+}
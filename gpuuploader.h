@@ -0,0 +1,85 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef GPUUPLOADER_H
+#define GPUUPLOADER_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+#include "gpubuffers.h"
+
+QT_BEGIN_NAMESPACE
+class QOffscreenSurface;
+class QOpenGLContext;
+QT_END_NAMESPACE
+
+// bytes copied per glBufferSubData, the driver gets a flush in between so that a large
+// g-code never needs one huge staging copy.
+const int GPU_UPLOAD_CHUNK = 4 << 20;
+
+//! Lives on the upload thread with a context shared with the view.
+class GpuUploadWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    GpuUploadWorker(QOpenGLContext *context, QOffscreenSurface *surface);
+
+public slots:
+    void upload(int ticket, QVector<GpuArray> arrays);
+    void release(QVector<unsigned int> ids);
+
+signals:
+    void uploaded(int ticket, const QVector<GpuArray> &arrays);
+
+private:
+    QOpenGLContext *m_context;
+    QOffscreenSurface *m_surface;
+    QVector<int> m_rebased;   // one chunk of indices moved by GpuArray::base
+};
+
+//! Copies vertex and index arrays into buffer objects on a thread of its own, so the view
+//! keeps drawing while a large model goes to the GPU. Create it on the GUI thread while
+//! the view's context is current; uploaded() is delivered there too. The buffers are
+//! finished (glFinish) before uploaded() is emitted and can be used by the view right away.
+class GpuUploader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GpuUploader(QObject *parent = 0);
+    ~GpuUploader();
+
+    bool isValid() const { return m_worker != 0; }
+    // queues the arrays, returns the ticket uploaded() reports them with (0 if not valid).
+    int upload(const QVector<GpuArray> &arrays);
+    // deletes buffers, thread safe.
+    void release(const QVector<unsigned int> &ids);
+
+signals:
+    // arrays carry the buffer ids, but no data anymore. Empty if the upload failed.
+    void uploaded(int ticket, const QVector<GpuArray> &arrays);
+
+private:
+    QThread m_thread;
+    QOffscreenSurface *m_surface;
+    QOpenGLContext *m_context;
+    GpuUploadWorker *m_worker;
+    int m_ticket;
+};
+
+#endif // GPUUPLOADER_H
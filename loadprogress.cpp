@@ -0,0 +1,78 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "loadprogress.h"
+
+#include <QFutureInterface>
+
+// share of LOAD_PROGRESS_RANGE each phase covers, reading dominates for every format. A
+// comparison reads and then compares, nothing in between.
+static const int PHASE_START[LoadProgress::PhaseCount] = { 0, 500, 800, 950, 500 };
+static const int PHASE_END[LoadProgress::PhaseCount]   = { 500, 800, 950, LOAD_PROGRESS_RANGE, LOAD_PROGRESS_RANGE };
+
+LoadProgress::LoadProgress(QFutureInterfaceBase *future)
+    : m_future(future)
+    , m_phase(Reading)
+    , m_total(0)
+    , m_value(-1)
+{
+}
+
+void LoadProgress::setPhase(Phase phase, qint64 total)
+{
+    m_phase = phase;
+    m_total = total;
+    step(0);
+}
+
+// cheap while the value stays the same, QFutureInterface throttles the signals itself.
+void LoadProgress::step(qint64 done)
+{
+    if (!m_future)
+        return;
+
+    const int start = PHASE_START[m_phase];
+    const int span  = PHASE_END[m_phase] - start;
+    const int value = start + (m_total > 0 ? int(qMin(done, m_total) * span / m_total) : 0);
+    if (value == m_value)
+        return;
+    m_value = value;
+
+    QString text;
+    if (m_phase == Reading && m_total > 0)
+        text = QString("%1 %2 of %3 MB").arg(phaseName(m_phase))
+               .arg(done / 1048576.0, 0, 'f', 1).arg(m_total / 1048576.0, 0, 'f', 1);
+    else
+        text = QString("%1 %2%").arg(phaseName(m_phase))
+               .arg(m_total > 0 ? qMin(done, m_total) * 100 / m_total : 0);
+    m_future->setProgressValueAndText(value, text);
+}
+
+bool LoadProgress::isCanceled() const
+{
+    return m_future && m_future->isCanceled();
+}
+
+const char *LoadProgress::phaseName(int phase)
+{
+    switch (phase) {
+    case Reading:       return "Reading";
+    case Tessellating:  return "Building tubes";
+    case Simplifying:   return "Simplifying";
+    case Indexing:      return "Indexing";
+    case Comparing:     return "Comparing";
+    }
+    return "";
+}
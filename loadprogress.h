@@ -0,0 +1,62 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef LOADPROGRESS_H
+#define LOADPROGRESS_H
+
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QFutureInterfaceBase;
+QT_END_NAMESPACE
+
+// progress values reported to the future, see LoadProgress::setPhase()
+const int LOAD_PROGRESS_RANGE = 1000;
+// loaders poll once per this many lines (or triangles, layers)
+const int LOAD_POLL_INTERVAL  = 4096;
+
+//! Progress and cancellation of one model load. The loaders (Model, GCode) call setPhase()
+//! at the start of each phase and step() as they go, and give up as soon as isCanceled()
+//! says so. Reported through a QFutureInterface, so a QFutureWatcher gets the progress
+//! and cancels the load. Without a future it does nothing.
+class LoadProgress
+{
+public:
+    enum Phase
+    {
+        Reading,        // bytes of the file
+        Tessellating,   // g-code lines turned into tubes
+        Simplifying,    // g-code layers, levels of detail
+        Indexing,       // mesh normals and the BVH
+        Comparing,      // a side load against the shown model, follows Reading
+        PhaseCount
+    };
+
+    explicit LoadProgress(QFutureInterfaceBase *future = 0);
+
+    void setPhase(Phase phase, qint64 total);
+    void step(qint64 done);
+    bool isCanceled() const;
+
+    static const char *phaseName(int phase);
+
+private:
+    QFutureInterfaceBase *m_future;
+    Phase  m_phase;
+    qint64 m_total;
+    int    m_value;     // last reported progress value
+};
+
+#endif // LOADPROGRESS_H
@@ -13,6 +13,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
    
 #include "openglscene.h"
+#include "thumbnailer.h"
 
 #include <QtGui>
 #include <QGLWidget>
@@ -40,6 +41,16 @@ const int HEIGHT = 768;
 
 int main(int argc, char **argv)
 {
+    // batch thumbnails, no window is shown
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--thumbnails") == 0) {
+            if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+                qputenv("QT_QPA_PLATFORM", "offscreen");
+            QGuiApplication app(argc, argv);
+            return runThumbnails(app.arguments());
+        }
+    }
+
     QApplication app(argc, argv);
 
     GraphicsView view;
@@ -0,0 +1,37 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "memoryusage.h"
+
+#include <cstring>
+
+void addMemory(MemoryUsage &usage, const char *category, qint64 bytes)
+{
+    for (int i = 0; i < usage.size(); ++i) {
+        if (strcmp(usage.at(i).category, category) == 0) {
+            usage[i].bytes += bytes;
+            return;
+        }
+    }
+    const MemoryItem item = { category, bytes };
+    usage.push_back(item);
+}
+
+qint64 totalBytes(const MemoryUsage &usage)
+{
+    qint64 total = 0;
+    for (int i = 0; i < usage.size(); ++i)
+        total += usage.at(i).bytes;
+    return total;
+}
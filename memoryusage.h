@@ -0,0 +1,47 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <string>
+#include <vector>
+
+// bytes one kind of data takes, see Model::memoryUsage()
+struct MemoryItem
+{
+    const char *category;   // a string literal
+    qint64 bytes;
+};
+typedef QVector<MemoryItem> MemoryUsage;
+
+// heap bytes of a container, by capacity
+template <typename T>
+qint64 containerBytes(const QVector<T> &container) { return qint64(container.capacity()) * sizeof(T); }
+template <typename T>
+qint64 containerBytes(const std::vector<T> &container) { return qint64(container.capacity()) * sizeof(T); }
+inline qint64 containerBytes(const QByteArray &container) { return container.capacity(); }
+// short strings live in the object itself, as long as they fit an empty one
+inline qint64 containerBytes(const std::string &string) {
+    return string.capacity() > std::string().capacity() ? qint64(string.capacity()) + 1 : 0;
+}
+
+// adds bytes to category, a new item if it has none yet
+void addMemory(MemoryUsage &usage, const char *category, qint64 bytes);
+qint64 totalBytes(const MemoryUsage &usage);
+
+#endif // MEMORYUSAGE_H
@@ -0,0 +1,220 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <vector>
+
+float averageCacheMissRatio(const QVector<int> &indices, int vertexCount, int cacheSize)
+{
+    if (indices.size() < 3)
+        return 0;
+    // a vertex is in the cache while less than cacheSize others came in after it
+    std::vector<int> inserted(vertexCount, -cacheSize - 1);
+    int misses = 0;
+    for (int i = 0; i < indices.size(); ++i) {
+        const int vertex = indices.at(i);
+        if (misses - inserted[vertex] >= cacheSize)
+            inserted[vertex] = misses++;
+    }
+    return float(misses) / (indices.size() / 3);
+}
+
+//! ============= Tipsify ===============
+namespace {
+
+struct TriangleCluster
+{
+    int first;      // triangle of the output
+    int count;
+    float facing;   // of the cluster normal towards the outside, higher draws first
+    bool operator<(const TriangleCluster &other) const { return facing > other.facing; }
+};
+
+class Tipsify
+{
+public:
+    Tipsify(const int *indices, int count, int cacheSize)
+        : m_count(count), m_cacheSize(cacheSize), m_cursor(0)
+    {
+        // the triangles work on vertices numbered 0.. within this range
+        m_vertices.assign(indices, indices + count * 3);
+        std::sort(m_vertices.begin(), m_vertices.end());
+        m_vertices.erase(std::unique(m_vertices.begin(), m_vertices.end()), m_vertices.end());
+        m_local.resize(count * 3);
+        for (int i = 0; i < count * 3; ++i)
+            m_local[i] = std::lower_bound(m_vertices.begin(), m_vertices.end(), indices[i]) - m_vertices.begin();
+
+        const int vertices = m_vertices.size();
+        m_live.assign(vertices, 0);
+        for (int i = 0; i < count * 3; ++i)
+            ++m_live[m_local[i]];
+        m_offsets.assign(vertices + 1, 0);
+        for (int v = 0; v < vertices; ++v)
+            m_offsets[v + 1] = m_offsets[v] + m_live[v];
+        m_triangles.resize(count * 3);
+        std::vector<int> fill(m_offsets.begin(), m_offsets.end() - 1);
+        for (int i = 0; i < count * 3; ++i)
+            m_triangles[fill[m_local[i]]++] = i / 3;
+        m_cached.assign(vertices, -cacheSize - 1);
+        m_emitted.assign(count, false);
+    }
+
+    // triangles in output order, and where a cluster starts: after a jump the cache has
+    // nothing of the triangles before.
+    void run(std::vector<int> &order, std::vector<int> &clusterStarts)
+    {
+        order.reserve(m_count);
+        int time = 0;
+        int vertex = 0;
+        while (vertex >= 0) {
+            m_candidates.clear();
+            for (int i = m_offsets[vertex]; i < m_offsets[vertex + 1]; ++i) {
+                const int triangle = m_triangles[i];
+                if (m_emitted[triangle])
+                    continue;
+                m_emitted[triangle] = true;
+                order.push_back(triangle);
+                for (int j = 0; j < 3; ++j) {
+                    const int v = m_local[triangle * 3 + j];
+                    m_deadEnd.push_back(v);
+                    m_candidates.push_back(v);
+                    --m_live[v];
+                    if (time - m_cached[v] > m_cacheSize)
+                        m_cached[v] = time++;
+                }
+            }
+            vertex = nextVertex(time);
+            if (vertex < 0) {
+                vertex = skipDeadEnd();
+                if (vertex >= 0)
+                    clusterStarts.push_back(order.size());
+            }
+        }
+    }
+
+private:
+    // the candidate that stays longest in the cache once its remaining triangles went out
+    int nextVertex(int time) const
+    {
+        int best = -1, bestPriority = -1;
+        for (size_t i = 0; i < m_candidates.size(); ++i) {
+            const int v = m_candidates[i];
+            if (m_live[v] <= 0)
+                continue;
+            int priority = 0;
+            if (time - m_cached[v] + 2 * m_live[v] <= m_cacheSize)
+                priority = time - m_cached[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+        return best;
+    }
+
+    // a recently used vertex with triangles left, else the next one in input order
+    int skipDeadEnd()
+    {
+        while (!m_deadEnd.empty()) {
+            const int v = m_deadEnd.back();
+            m_deadEnd.pop_back();
+            if (m_live[v] > 0)
+                return v;
+        }
+        for (; m_cursor < (int)m_vertices.size(); ++m_cursor) {
+            if (m_live[m_cursor] > 0)
+                return m_cursor;
+        }
+        return -1;
+    }
+
+    int m_count;
+    int m_cacheSize;
+    int m_cursor;
+    std::vector<int> m_vertices;    // local vertex -> mesh vertex
+    std::vector<int> m_local;       // indices in local vertices
+    std::vector<int> m_live;        // triangles left per vertex
+    std::vector<int> m_offsets;     // into m_triangles per vertex
+    std::vector<int> m_triangles;   // triangles of each vertex
+    std::vector<int> m_cached;      // time the vertex entered the cache
+    std::vector<bool> m_emitted;
+    std::vector<int> m_deadEnd;
+    std::vector<int> m_candidates;
+};
+
+} // namespace
+
+void optimizeTriangleOrder(int *indices, int count, const QVector<QVector3D> &vertices, int cacheSize)
+{
+    if (count < 2)
+        return;
+    std::vector<int> order;
+    std::vector<int> starts(1, 0);
+    Tipsify(indices, count, cacheSize).run(order, starts);
+    starts.push_back(count);
+
+    // area weighted normal and centroid of each cluster against the centroid of all
+    QVector3D center;
+    for (int i = 0; i < count * 3; ++i)
+        center += vertices.at(indices[i]);
+    center /= count * 3;
+    std::vector<TriangleCluster> clusters;
+    for (size_t c = 0; c + 1 < starts.size(); ++c) {
+        if (starts[c] == starts[c + 1])
+            continue;
+        QVector3D normal, centroid;
+        for (int t = starts[c]; t < starts[c + 1]; ++t) {
+            const int *triangle = indices + order[t] * 3;
+            const QVector3D &a = vertices.at(triangle[0]);
+            const QVector3D &b = vertices.at(triangle[1]);
+            const QVector3D &d = vertices.at(triangle[2]);
+            normal += QVector3D::crossProduct(b - a, d - a);
+            centroid += a + b + d;
+        }
+        centroid /= (starts[c + 1] - starts[c]) * 3;
+        TriangleCluster cluster;
+        cluster.first = starts[c];
+        cluster.count = starts[c + 1] - starts[c];
+        cluster.facing = QVector3D::dotProduct(centroid - center, normal.normalized());
+        clusters.push_back(cluster);
+    }
+    std::stable_sort(clusters.begin(), clusters.end());
+
+    std::vector<int> sorted;
+    sorted.reserve(count * 3);
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        for (int t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+            const int *triangle = indices + order[t] * 3;
+            sorted.insert(sorted.end(), triangle, triangle + 3);
+        }
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+void vertexFetchOrder(const QVector<int> &indices, int vertexCount, QVector<int> &remap)
+{
+    remap.fill(-1, vertexCount);
+    int next = 0;
+    for (int i = 0; i < indices.size(); ++i) {
+        int &vertex = remap[indices.at(i)];
+        if (vertex < 0)
+            vertex = next++;
+    }
+    for (int i = 0; i < vertexCount; ++i) {
+        if (remap.at(i) < 0)
+            remap[i] = next++;
+    }
+}
@@ -0,0 +1,156 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "meshslicer.h"
+
+#include <QHash>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct SliceSegment
+{
+    QVector2D from;
+    QVector2D to;
+};
+
+// triangles crossing one plane
+struct SliceTask
+{
+    const QVector3D *vertices;
+    const int *indices;
+    float height;
+    std::vector<int> triangles;
+    QVector<SliceContour> *contours;
+};
+
+struct HeightLess
+{
+    const float *heights;
+    bool operator()(int a, int b) const { return heights[a] < heights[b]; }
+};
+
+quint64 pointKey(const QVector2D &point)
+{
+    const float x = point.x() + 0.0f, y = point.y() + 0.0f;   // -0 and 0 are the same point
+    quint32 bits[2];
+    memcpy(&bits[0], &x, sizeof(float));
+    memcpy(&bits[1], &y, sizeof(float));
+    return (quint64(bits[0]) << 32) | bits[1];
+}
+
+// where the edge crosses the plane, from its lower end so both faces get the same point
+QVector2D crossing(const QVector3D &p, const QVector3D &q, float height)
+{
+    const QVector3D &low = p.z() < q.z() ? p : q;
+    const QVector3D &high = p.z() < q.z() ? q : p;
+    const float t = (height - low.z()) / (high.z() - low.z());
+    return QVector2D(low.x() + (high.x() - low.x()) * t, low.y() + (high.y() - low.y()) * t);
+}
+
+void sliceTriangles(SliceTask &task)
+{
+    std::vector<SliceSegment> segments;
+    segments.reserve(task.triangles.size());
+    for (size_t i = 0; i < task.triangles.size(); ++i) {
+        const int *corners = task.indices + task.triangles[i] * 3;
+        const QVector3D p[3] = { task.vertices[corners[0]], task.vertices[corners[1]], task.vertices[corners[2]] };
+        QVector2D points[2];
+        int count = 0;
+        for (int j = 0; j < 3 && count < 2; ++j) {
+            const QVector3D &a = p[j], &b = p[(j + 1) % 3];
+            if ((a.z() < task.height) != (b.z() < task.height))
+                points[count++] = crossing(a, b, task.height);
+        }
+        if (count < 2 || points[0] == points[1])
+            continue;
+        // outside on the right hand, seen from above
+        const QVector3D normal = QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+        const QVector2D direction = points[1] - points[0];
+        SliceSegment segment = { points[0], points[1] };
+        if (direction.y() * normal.x() - direction.x() * normal.y() < 0)
+            std::swap(segment.from, segment.to);
+        segments.push_back(segment);
+    }
+
+    QHash<quint64, int> starts;
+    starts.reserve(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i)
+        starts.insert(pointKey(segments[i].from), i);
+
+    std::vector<char> used(segments.size(), 0);
+    for (size_t first = 0; first < segments.size(); ++first) {
+        if (used[first])
+            continue;
+        SliceContour contour;
+        contour.points.push_back(segments[first].from);
+        int segment = first;
+        for (;;) {
+            used[segment] = 1;
+            const QHash<quint64, int>::const_iterator next = starts.constFind(pointKey(segments[segment].to));
+            if (next != starts.constEnd() && next.value() == int(first)) {
+                contour.closed = true;
+                break;
+            }
+            contour.points.push_back(segments[segment].to);
+            if (next == starts.constEnd() || used[next.value()])
+                break;
+            segment = next.value();
+        }
+        task.contours->push_back(contour);
+    }
+}
+
+} // namespace
+
+void sliceMesh(const QVector<QVector3D> &vertices, const QVector<int> &indices, const QVector<float> &heights,
+               QVector<QVector<SliceContour> > &contours)
+{
+    contours.clear();
+    contours.resize(heights.size());
+    if (heights.isEmpty())
+        return;
+
+    QVector<SliceTask> tasks(heights.size());
+    for (int i = 0; i < heights.size(); ++i) {
+        SliceTask &task = tasks[i];
+        task.vertices = vertices.constData();
+        task.indices = indices.constData();
+        task.height = heights.at(i);
+        task.contours = &contours[i];
+    }
+    std::vector<float> sorted(heights.begin(), heights.end());
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> sortedTask(heights.size());
+    for (int i = 0; i < heights.size(); ++i)
+        sortedTask[i] = i;
+    HeightLess less = { heights.constData() };
+    std::stable_sort(sortedTask.begin(), sortedTask.end(), less);
+
+    // a face crosses the planes in (lowest, highest]
+    for (int i = 0; i + 2 < indices.size(); i += 3) {
+        float low = vertices.at(indices.at(i)).z(), high = low;
+        for (int j = 1; j < 3; ++j) {
+            low = qMin(low, vertices.at(indices.at(i + j)).z());
+            high = qMax(high, vertices.at(indices.at(i + j)).z());
+        }
+        for (size_t k = std::upper_bound(sorted.begin(), sorted.end(), low) - sorted.begin();
+             k < sorted.size() && sorted[k] <= high; ++k)
+            tasks[sortedTask[k]].triangles.push_back(i / 3);
+    }
+    QtConcurrent::blockingMap(tasks, sliceTriangles);
+}
@@ -0,0 +1,38 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MESHSLICER_H
+#define MESHSLICER_H
+
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector>
+
+//! One outline of a mesh cut by a horizontal plane. Outer outlines run counterclockwise
+//! seen from above and holes clockwise, as long as the faces point outwards.
+struct SliceContour
+{
+    SliceContour() : closed(false) {}
+    QVector<QVector2D> points;   // x/y of the mesh, the last one is not repeated
+    bool closed;                 // false where the mesh has holes
+};
+
+// Cuts the mesh by the planes z = heights[i] into contours[i]. Triangles are bucketed by the
+// heights their z range spans, then the slices are traced in parallel. Vertices on a plane
+// count as above it, and segments are joined by their exact end points, which both faces
+// of an edge compute alike, so unindexed meshes (STL) slice as well.
+void sliceMesh(const QVector<QVector3D> &vertices, const QVector<int> &indices, const QVector<float> &heights,
+               QVector<QVector<SliceContour> > &contours);
+
+#endif // MESHSLICER_H
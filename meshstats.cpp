@@ -0,0 +1,191 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "meshstats.h"
+#include "profiler.h"
+
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// an edge by its ends, a has the smaller position
+struct StatsEdge
+{
+    quint32 hash;
+    int a;
+    int b;
+};
+
+bool positionLess(const QVector3D &p, const QVector3D &q)
+{
+    if (p.x() != q.x())
+        return p.x() < q.x();
+    if (p.y() != q.y())
+        return p.y() < q.y();
+    return p.z() < q.z();
+}
+
+quint32 positionHash(const QVector3D &p)
+{
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < 3; ++i) {
+        const float value = p[i] + 0.0f;   // -0 and 0 are the same position
+        quint32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+bool sameEdge(const QVector3D *vertices, const StatsEdge &e, const StatsEdge &f)
+{
+    return e.hash == f.hash && vertices[e.a] == vertices[f.a] && vertices[e.b] == vertices[f.b];
+}
+
+// sums of one range of triangles, and its edges by bucket
+struct StatsChunk
+{
+    const QVector3D *vertices;
+    const int *indices;
+    int first;
+    int count;
+    double volume;
+    double area;
+    double moment[3];   // volume weighted centroids
+    std::vector<StatsEdge> buckets[STATS_EDGE_BUCKETS];
+};
+
+struct StatsBucket
+{
+    const QVector<StatsChunk> *chunks;
+    const QVector3D *vertices;
+    int bucket;
+    int edges;
+    int openEdges;
+    int nonManifoldEdges;
+};
+
+void measureChunk(StatsChunk &chunk)
+{
+    chunk.volume = chunk.area = 0;
+    chunk.moment[0] = chunk.moment[1] = chunk.moment[2] = 0;
+    for (int i = chunk.first; i < chunk.first + chunk.count; ++i) {
+        const int *corners = chunk.indices + i * 3;
+        const QVector3D &a = chunk.vertices[corners[0]];
+        const QVector3D &b = chunk.vertices[corners[1]];
+        const QVector3D &c = chunk.vertices[corners[2]];
+        const QVector3D cross = QVector3D::crossProduct(b - a, c - a);
+        chunk.area += 0.5 * cross.length();
+        // signed tetrahedron (origin, a, b, c), its centroid is (a + b + c) / 4
+        const double volume = QVector3D::dotProduct(a, QVector3D::crossProduct(b, c)) / 6.0;
+        chunk.volume += volume;
+        for (int j = 0; j < 3; ++j)
+            chunk.moment[j] += volume * (a[j] + b[j] + c[j]) / 4;
+
+        // a face with coincident corners has no edges of its own
+        if (a == b || b == c || a == c)
+            continue;
+        for (int j = 0; j < 3; ++j) {
+            StatsEdge edge = { 0, corners[j], corners[(j + 1) % 3] };
+            if (positionLess(chunk.vertices[edge.b], chunk.vertices[edge.a]))
+                std::swap(edge.a, edge.b);
+            const quint32 hashA = positionHash(chunk.vertices[edge.a]);
+            edge.hash = hashA ^ (positionHash(chunk.vertices[edge.b]) + 0x9e3779b9u + (hashA << 6) + (hashA >> 2));
+            chunk.buckets[edge.hash % STATS_EDGE_BUCKETS].push_back(edge);
+        }
+    }
+}
+
+// counts the faces on each edge in an open addressing table
+void countBucket(StatsBucket &bucket)
+{
+    int size = 0;
+    for (int i = 0; i < bucket.chunks->size(); ++i)
+        size += bucket.chunks->at(i).buckets[bucket.bucket].size();
+    int capacity = 16;
+    while (capacity < size * 2)
+        capacity *= 2;
+    std::vector<StatsEdge> table(capacity);
+    std::vector<int> faces(capacity, 0);
+
+    bucket.edges = 0;
+    for (int i = 0; i < bucket.chunks->size(); ++i) {
+        const std::vector<StatsEdge> &edges = bucket.chunks->at(i).buckets[bucket.bucket];
+        for (size_t j = 0; j < edges.size(); ++j) {
+            // the low bits picked the bucket
+            int slot = (edges[j].hash / STATS_EDGE_BUCKETS) & (capacity - 1);
+            while (faces[slot] > 0 && !sameEdge(bucket.vertices, table[slot], edges[j]))
+                slot = (slot + 1) & (capacity - 1);
+            if (faces[slot]++ == 0) {
+                table[slot] = edges[j];
+                ++bucket.edges;
+            }
+        }
+    }
+    bucket.openEdges = bucket.nonManifoldEdges = 0;
+    for (int i = 0; i < capacity; ++i) {
+        if (faces[i] == 1)
+            ++bucket.openEdges;
+        else if (faces[i] > 2)
+            ++bucket.nonManifoldEdges;
+    }
+}
+
+} // namespace
+
+void computeMeshStatistics(const QVector<QVector3D> &vertices, const QVector<int> &indices,
+                           MeshStatistics &statistics)
+{
+    PROFILE_SCOPE("computeMeshStatistics");
+    statistics = MeshStatistics();
+    const int triangles = indices.size() / 3;
+    if (triangles == 0)
+        return;
+
+    QVector<StatsChunk> chunks((triangles + STATS_CHUNK_TRIANGLES - 1) / STATS_CHUNK_TRIANGLES);
+    for (int i = 0; i < chunks.size(); ++i) {
+        StatsChunk &chunk = chunks[i];
+        chunk.vertices = vertices.constData();
+        chunk.indices = indices.constData();
+        chunk.first = i * STATS_CHUNK_TRIANGLES;
+        chunk.count = qMin(STATS_CHUNK_TRIANGLES, triangles - chunk.first);
+    }
+    QtConcurrent::blockingMap(chunks, measureChunk);
+
+    QVector<StatsBucket> buckets(STATS_EDGE_BUCKETS);
+    for (int i = 0; i < buckets.size(); ++i) {
+        StatsBucket bucket = { &chunks, vertices.constData(), i, 0, 0, 0 };
+        buckets[i] = bucket;
+    }
+    QtConcurrent::blockingMap(buckets, countBucket);
+
+    double moment[3] = { 0, 0, 0 };
+    for (int i = 0; i < chunks.size(); ++i) {
+        statistics.volume += chunks.at(i).volume;
+        statistics.area += chunks.at(i).area;
+        for (int j = 0; j < 3; ++j)
+            moment[j] += chunks.at(i).moment[j];
+    }
+    if (statistics.volume != 0)
+        statistics.centerOfMass = QVector3D(moment[0] / statistics.volume, moment[1] / statistics.volume,
+                                            moment[2] / statistics.volume);
+    for (int i = 0; i < buckets.size(); ++i) {
+        statistics.edges += buckets.at(i).edges;
+        statistics.openEdges += buckets.at(i).openEdges;
+        statistics.nonManifoldEdges += buckets.at(i).nonManifoldEdges;
+    }
+}
@@ -0,0 +1,46 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MESHSTATS_H
+#define MESHSTATS_H
+
+#include <QVector3D>
+#include <QVector>
+
+// triangles per task of the first pass, and edge buckets of the second
+const int STATS_CHUNK_TRIANGLES = 65536;
+const int STATS_EDGE_BUCKETS    = 64;
+
+//! Size and soundness of a triangle mesh, see computeMeshStatistics(). In the units of the
+//! vertices, the volume and center of mass only mean something for closed meshes.
+struct MeshStatistics
+{
+    MeshStatistics() : volume(0), area(0), edges(0), openEdges(0), nonManifoldEdges(0) {}
+
+    double volume;           // enclosed, negative if the faces point inwards
+    double area;
+    QVector3D centerOfMass;  // of a solid of uniform density
+    int edges;               // distinct, by position
+    int openEdges;           // used by one face
+    int nonManifoldEdges;    // used by more than two faces
+    bool isWatertight() const { return edges > 0 && openEdges == 0 && nonManifoldEdges == 0; }
+};
+
+// Volume and center of mass from the signed tetrahedra between the origin and each face,
+// and the edge counts from a map of the edges by the positions of their ends, so
+// unindexed meshes (STL) are measured like welded ones. Both passes run on the thread pool.
+void computeMeshStatistics(const QVector<QVector3D> &vertices, const QVector<int> &indices,
+                           MeshStatistics &statistics);
+
+#endif // MESHSTATS_H
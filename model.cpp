@@ -14,35 +14,113 @@
    
 #include "model.h"
 #include "gcode/gcode.h"
+#include "loadprogress.h"
+#include "parsenumber.h"
+#include "decompressdevice.h"
+#include "modelformat.h"
+#include "meshoptimizer.h"
+#include "decimate.h"
+#include "meshslicer.h"
+#include "profiler.h"
 #include <QFileInfo>
 #include <QFile>
-#include <QTextStream>
+#include <QScopedPointer>
 #include <QVarLengthArray>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
 #include <QtOpenGL>
 #include <QDebug>
 
+// BVH subtrees below this many triangles are drawn whole instead of being culled further.
+const int MODEL_CULL_CHUNK = 4096;
 
-Model::Model(const QString &filePath)
-    : m_fileName(QFileInfo(filePath).fileName())
+// triangles of one BVH chunk, see Model::optimizeMesh()
+struct MeshChunk
+{
+    int *indices;
+    int count;
+    const QVector<QVector3D> *vertices;
+};
+
+static void optimizeChunk(MeshChunk &chunk)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly))
+    optimizeTriangleOrder(chunk.indices, chunk.count, *chunk.vertices);
+}
+
+static void remapVertices(QVector<QVector3D> &vertices, const QVector<int> &remap)
+{
+    if (vertices.size() != remap.size())
         return;
+    QVector<QVector3D> remapped(vertices.size());
+    for (int i = 0; i < vertices.size(); ++i)
+        remapped[remap.at(i)] = vertices.at(i);
+    vertices.swap(remapped);
+}
 
-    if (filePath.endsWith(".stl", Qt::CaseInsensitive)) {
-        loadStl(file);
-    } else if (filePath.endsWith(".obj", Qt::CaseInsensitive)) {
-        loadObj(file);
-    } else if (filePath.endsWith(".gcode", Qt::CaseInsensitive)) {
-        loadGCode(filePath.toStdString());
-    }
+static void remapIndices(QVector<int> &indices, const QVector<int> &remap)
+{
+    for (int i = 0; i < indices.size(); ++i)
+        indices[i] = remap.at(indices.at(i));
+}
 
+Model::Model(const QString &filePath, LoadProgress *progress, qint64 memoryLimit, LoadMode mode)
+    : m_fileName(QFileInfo(filePath).fileName())
+    , m_culled(false)
+    , m_compact(false)
+    , m_normalError(0)
+    , m_pool(0)
+{
+    PROFILE_SCOPE("Model::Model");
+    m_cacheMissRatio[0] = m_cacheMissRatio[1] = 0;
+    QScopedPointer<QIODevice> file(openInput(filePath));
+    if (!file)
+        return;
+    // by the contents, the name (without a compression suffix) only breaks ties
+    const ModelFormat format = detectFormat(*file, uncompressedName(filePath));
+    if (format == GCodeFormat || format == BinaryGCodeFormat) {
+        // read on from the same device, a compressed file is decompressed once
+        loadGCode(*file, filePath.toStdString(), progress, memoryLimit, mode == LoadGeometry);
+    } else if (format != UnknownFormat) {
+        if (progress)
+            progress->setPhase(LoadProgress::Reading, inputSize(file.data()));
+        if (format == ObjFormat)
+            loadObj(*file, progress);
+        else
+            loadStl(*file, format == StlAscii, progress);
+        if (inputFailed(file.data())) {   // a part of the mesh is no mesh either
+            qWarning() << Q_FUNC_INFO << file->errorString();
+            m_vertices.clear();
+            m_vertexIndices.clear();
+            m_edgeIndices.clear();
+        }
+        if (mode == LoadAll && !(progress && progress->isCanceled())) {
+            m_verticesNew = m_vertices;
+            recomputeAll();
+        }
+    } else {
+        qWarning() << Q_FUNC_INFO << "unknown format" << filePath;
+    }
+    if ((progress && progress->isCanceled()) || mode == LoadGeometry)
+        return;
+    if (progress)
+        progress->setPhase(LoadProgress::Indexing, 1);
+
+    QElapsedTimer timer;
+    timer.start();
+    computeMeshStatistics(m_vertices, m_vertexIndices, m_statistics);
+    if (!m_vertexIndices.isEmpty())
+        qDebug() << Q_FUNC_INFO << "volume" << m_statistics.volume << "area" << m_statistics.area
+                 << "open edges" << m_statistics.openEdges << "non-manifold" << m_statistics.nonManifoldEdges
+                 << "in" << timer.elapsed() << "ms";
+
+    // built on the untransformed vertices, queries map into model space instead of rebuilding.
+    m_bvh.build(m_vertices, m_vertexIndices);
     m_transform.setToIdentity();
 }
 
 Model::~Model()
 {
-
+    releasePoolBlock();
 }
 
 void Model::transform(QMatrix4x4 matrix)
@@ -65,16 +143,440 @@ void Model::transform(QMatrix4x4 matrix)
     m_verticesNew = v;
 
     recomputeAll();
+    if (m_compact)
+        packVertices();
+    transformProxy();
+    // drawn from client memory again until the scene uploads the new positions
+    releasePoolBlock();
+    m_buffers.release(MeshVertices);
+    m_buffers.release(MeshNormals);
+    m_buffers.release(ProxyVertices);
+    m_buffers.release(ProxyNormals);
+}
+
+bool Model::pick(const QVector3D &origin, const QVector3D &direction, QVector3D &hit) const
+{
+    if (m_bvh.isEmpty())
+        return false;
+
+    const QMatrix4x4 inverse = m_transform.inverted();
+    const QVector3D localOrigin = inverse * origin;
+    const QVector3D localDirection = inverse.mapVector(direction);
+    float distance;
+    int triangle;
+    if (!m_bvh.intersect(localOrigin, localDirection, distance, triangle))
+        return false;
+
+    hit = m_transform * (localOrigin + localDirection * distance);
+    return true;
+}
+
+bool Model::nearestPoint(const QVector3D &point, QVector3D &nearest) const
+{
+    if (m_bvh.isEmpty())
+        return false;
+
+    QVector3D localNearest;
+    int triangle;
+    if (!m_bvh.nearestPoint(m_transform.inverted() * point, localNearest, triangle))
+        return false;
+
+    nearest = m_transform * localNearest;
+    return true;
+}
+
+void Model::compareWith(const Model &target, LoadProgress *progress)
+{
+    m_compareOutlines.clear();
+    m_compareLayers.clear();
+    const GCode &gcode = target.m_gCode;
+    if (!gcode.isOpen() || (m_vertices.isEmpty() && !m_gCode.isOpen()))
+        return;
+    if (progress)
+        progress->setPhase(LoadProgress::Comparing, 1);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (m_gCode.isOpen()) {
+        ::diffGCode(gcode, m_gCode, DIFF_CELL_SIZE, m_compareLayers);
+        qDebug() << Q_FUNC_INFO << m_compareLayers.size() << "layers compared in" << timer.elapsed() << "ms";
+    } else {
+        QVector<float> heights;
+        gcode.layerHeights(heights);
+
+        QVector3D min = m_vertices.first(), max = min;
+        for (int i = 1; i < m_vertices.size(); ++i) {
+            const QVector3D &v = m_vertices.at(i);
+            min = QVector3D(qMin(min.x(), v.x()), qMin(min.y(), v.y()), qMin(min.z(), v.z()));
+            max = QVector3D(qMax(max.x(), v.x()), qMax(max.y(), v.y()), qMax(max.z(), v.z()));
+        }
+        // the middle of each layer, a layer spans from the one below (or the bed) up to its height
+        QVector<float> cuts(heights.size(), min.z() - 1);   // below the mesh where nothing is extruded
+        float below = 0;
+        for (int i = 0; i < heights.size(); ++i) {
+            if (heights.at(i) < 0)
+                continue;
+            cuts[i] = min.z() + (below + heights.at(i)) * 0.5f;
+            below = heights.at(i);
+        }
+
+        sliceMesh(m_vertices, m_vertexIndices, cuts, m_compareOutlines);
+        m_compareOffset = QVector2D((gcode.getMinX() + gcode.getMaxX() - min.x() - max.x()) * 0.5f,
+                                    (gcode.getMinY() + gcode.getMaxY() - min.y() - max.y()) * 0.5f);
+        qDebug() << Q_FUNC_INFO << heights.size() << "layers sliced in" << timer.elapsed() << "ms";
+    }
+    if (progress)
+        progress->step(1);
+}
+
+int Model::setGCodeReference(const Model &mesh)
+{
+    m_gCode.clearReference();
+    if (!m_gCode.isOpen() || mesh.m_compareOutlines.isEmpty())
+        return 0;
+    m_gCode.setReference(mesh.m_compareOutlines, mesh.m_compareOffset);
+    return m_gCode.referenceOutlines();
+}
+
+int Model::diffGCode(const Model &other, QVector<GCodeLayerDiff> &layers)
+{
+    m_gCode.clearDiff();
+    layers = other.m_compareLayers;
+    if (!m_gCode.isOpen() || layers.isEmpty())
+        return 0;
+
+    m_gCode.setDiff(layers);
+    int changed = 0;
+    for (int i = 0; i < layers.size(); ++i)
+        changed += layers.at(i).changed() || layers.at(i).layer < 0 || layers.at(i).otherLayer < 0;
+    return changed;
+}
+
+// Bounding box of the mesh and the toolpath in scene coordinates.
+void Model::bounds(QVector3D &min, QVector3D &max)
+{
+    min = QVector3D( 1e9f,  1e9f,  1e9f);
+    max = QVector3D(-1e9f, -1e9f, -1e9f);
+    if (!m_verticesNew.isEmpty()) {
+        min = m_min;
+        max = m_max;
+    }
+    if (m_gCode.isOpen() && m_gCode.getMaxX() >= m_gCode.getMinX()) {
+        // same mapping as GCode::draw(), x/y centered on the plate and z up
+        const float minusX = m_gCode.getMaxX() * 0.5f;
+        const float minusY = m_gCode.getMaxY() * 0.5f;
+        min = QVector3D(qMin(min.x(), m_gCode.getMinX() - minusX), qMin(min.y(), m_gCode.getMinZ()),
+                        qMin(min.z(), m_gCode.getMinY() - minusY));
+        max = QVector3D(qMax(max.x(), m_gCode.getMaxX() - minusX), qMax(max.y(), m_gCode.getMaxZ()),
+                        qMax(max.z(), m_gCode.getMaxY() - minusY));
+    }
+}
+
+// Culls the mesh and the g-code chunks against the camera, used by the next render().
+void Model::setViewProjection(const QMatrix4x4 &viewProjection)
+{
+    PROFILE_SCOPE("Model::setViewProjection");
+    m_culled = !m_bvh.isEmpty();
+    if (m_culled)
+        m_bvh.cull(viewProjection * m_transform, MODEL_CULL_CHUNK, m_visibleTriangles);
+    if (m_gCode.isOpen())
+        m_gCode.setViewProjection(viewProjection);
+}
+
+QVector<GpuArray> Model::gpuArrays(const GpuPool *pool, const GpuPoolBlock &block) const
+{
+    QVector<GpuArray> arrays;
+    GpuArray array;
+    if (pool && block.isValid()) {
+        array.target = GL_ARRAY_BUFFER;
+        array.slot = MeshVertices;
+        array.buffer = pool->buffer(block.page, GpuPool::Positions);
+        array.offset = block.firstVertex * sizeof(QVector3D);
+        array.vertices = m_verticesNew;
+        arrays.push_back(array);
+        array.slot = MeshNormals;
+        array.buffer = pool->buffer(block.page, GpuPool::Normals);
+        array.vertices = m_normals;
+        arrays.push_back(array);
+        array.target = GL_ELEMENT_ARRAY_BUFFER;
+        array.slot = MeshIndices;
+        array.buffer = pool->buffer(block.page, GpuPool::Indices);
+        array.offset = block.firstIndex * sizeof(int);
+        array.base = block.firstVertex;
+        array.vertices.clear();
+        array.indices = drawIndices();
+        arrays.push_back(array);
+        array = GpuArray();
+    }
+    const bool mesh = !isPooled() && !(pool && block.isValid());
+    array.target = GL_ARRAY_BUFFER;
+    if (mesh && !m_buffers.id(MeshVertices) && !m_verticesNew.isEmpty()) {
+        array.slot = MeshVertices;
+        if (m_compact)
+            array.packed = m_compactPositions.data;
+        else
+            array.vertices = m_verticesNew;
+        arrays.push_back(array);
+    }
+    if (mesh && !m_buffers.id(MeshNormals) && !m_normals.isEmpty()) {
+        array.slot = MeshNormals;
+        if (m_compact)
+            array.packed = m_compactNormals;
+        else
+            array.vertices = m_normals;
+        arrays.push_back(array);
+    }
+    if (mesh && !m_buffers.id(MeshIndices) && !m_vertexIndices.isEmpty()) {
+        array.target = GL_ELEMENT_ARRAY_BUFFER;
+        array.slot = MeshIndices;
+        array.vertices.clear();
+        array.packed = m_compactIndices;
+        if (m_compactIndices.isEmpty())
+            array.indices = drawIndices();
+        arrays.push_back(array);
+    }
+    array.target = GL_ARRAY_BUFFER;
+    array.packed.clear();
+    array.indices.clear();
+    if (!m_buffers.id(ProxyVertices) && !m_proxyVerticesNew.isEmpty()) {
+        array.slot = ProxyVertices;
+        array.vertices = m_proxyVerticesNew;
+        arrays.push_back(array);
+    }
+    if (!m_buffers.id(ProxyNormals) && !m_proxyNormals.isEmpty()) {
+        array.slot = ProxyNormals;
+        array.vertices = m_proxyNormals;
+        arrays.push_back(array);
+    }
+    if (!m_buffers.id(ProxyIndices) && !m_proxyIndices.isEmpty()) {
+        array.target = GL_ELEMENT_ARRAY_BUFFER;
+        array.slot = ProxyIndices;
+        array.vertices.clear();
+        array.indices = m_proxyIndices;
+        arrays.push_back(array);
+    }
+    if (m_gCode.isOpen())
+        m_gCode.gpuArrays(arrays, MeshSlots);
+    return arrays;
+}
+
+void Model::setGpuBuffers(const QVector<GpuArray> &arrays, GpuUploader *uploader, GpuPool *pool,
+                          const GpuPoolBlock &block)
+{
+    if (pool && block.isValid()) {
+        releasePoolBlock();
+        m_buffers.release(MeshVertices);
+        m_buffers.release(MeshNormals);
+        m_buffers.release(MeshIndices);
+        m_pool = pool;
+        m_poolBlock = block;
+    }
+    for (int i = 0; i < arrays.size(); ++i) {
+        if (arrays.at(i).slot <= MeshIndices && pool && block.isValid())
+            continue;   // pool pages, not ours
+        if (arrays.at(i).slot < MeshSlots)
+            m_buffers.set(arrays.at(i).slot, arrays.at(i).buffer, uploader);
+        else
+            m_gCode.setGpuBuffer(arrays.at(i).slot - MeshSlots, arrays.at(i).buffer, uploader);
+    }
+}
+
+// Triangles only move within the BVH chunks, so culled ranges stay valid, and the chunks
+// are optimized in parallel. Picking keeps using m_vertexIndices in tree order.
+void Model::optimizeMesh()
+{
+    PROFILE_SCOPE("Model::optimizeMesh");
+    if (m_vertexIndices.isEmpty() || m_bvh.isEmpty())
+        return;
+    QElapsedTimer timer;
+    timer.start();
+    m_cacheMissRatio[0] = averageCacheMissRatio(m_vertexIndices, m_vertices.size());
+
+    QVector<QPair<int, int> > chunks;
+    m_bvh.chunks(MODEL_CULL_CHUNK, chunks);
+    m_drawIndices = m_vertexIndices;
+    QVector<MeshChunk> tasks;
+    for (int i = 0; i < chunks.size(); ++i) {
+        MeshChunk task = { m_drawIndices.data() + chunks.at(i).first * 3, chunks.at(i).second, &m_vertices };
+        tasks.push_back(task);
+    }
+    QtConcurrent::blockingMap(tasks, optimizeChunk);
+
+    // renumbered in draw order, the same vertices are in all lists
+    QVector<int> remap;
+    vertexFetchOrder(m_drawIndices, m_vertices.size(), remap);
+    remapVertices(m_vertices, remap);
+    remapVertices(m_verticesNew, remap);
+    remapVertices(m_normals, remap);
+    remapIndices(m_vertexIndices, remap);
+    remapIndices(m_drawIndices, remap);
+    remapIndices(m_edgeIndices, remap);
+    releasePoolBlock();
+    m_buffers.clear();
+    if (m_compact)
+        packVertices();
+
+    m_cacheMissRatio[1] = averageCacheMissRatio(m_drawIndices, m_vertices.size());
+    qDebug() << Q_FUNC_INFO << "ACMR" << m_cacheMissRatio[0] << "->" << m_cacheMissRatio[1]
+             << "in" << chunks.size() << "chunks," << timer.elapsed() << "ms";
+}
+
+void Model::setCompactVertices(bool compact)
+{
+    m_compact = compact && !m_verticesNew.isEmpty();
+    if (m_compact) {
+        packVertices();
+    } else {
+        m_compactPositions.clear();
+        m_compactNormals.clear();
+        m_compactIndices.clear();
+        m_normalError = 0;
+    }
+    if (m_gCode.isOpen())
+        m_gCode.setCompactVertices(compact);
+    releasePoolBlock();
+    m_buffers.clear();
+}
+
+float Model::positionError() const
+{
+    return qMax(m_compactPositions.maxError, m_gCode.compactPositionError());
+}
+
+// Over the bounding box of the transformed vertices, see recomputeAll().
+void Model::packVertices()
+{
+    m_compactPositions.pack(m_verticesNew, m_min, m_max);
+    m_normalError = packNormals(m_normals, m_compactNormals);
+    packIndices(drawIndices(), m_compactIndices);
+}
+
+void Model::releasePoolBlock()
+{
+    if (m_pool)
+        m_pool->free(m_poolBlock);
+    m_pool = 0;
+    m_poolBlock = GpuPoolBlock();
+}
+
+void Model::poolRanges(QVector<QPair<int, int> > &ranges) const
+{
+    if (!isPooled())
+        return;
+    if (m_culled) {
+        for (int i = 0; i < m_visibleTriangles.size(); ++i)
+            ranges.push_back(qMakePair(m_poolBlock.firstIndex + m_visibleTriangles.at(i).first * 3,
+                                       m_visibleTriangles.at(i).second * 3));
+    } else {
+        ranges.push_back(qMakePair(m_poolBlock.firstIndex, m_poolBlock.indices));
+    }
+}
+
+// the full mesh, culled by the BVH
+void Model::drawMesh()
+{
+    if (isPooled()) {
+        QVector<QPair<int, int> > ranges;
+        poolRanges(ranges);
+        m_pool->draw(m_poolBlock.page, ranges);
+        return;
+    }
+    if (m_compact) {
+        m_compactPositions.pushTransform();
+        glEnable(GL_NORMALIZE);
+        glVertexPointer(3, GL_SHORT, COMPACT_POSITION_STRIDE,
+                        m_buffers.bind(MeshVertices, GL_ARRAY_BUFFER, m_compactPositions.data.constData()));
+        glNormalPointer(GL_BYTE, COMPACT_NORMAL_STRIDE,
+                        m_buffers.bind(MeshNormals, GL_ARRAY_BUFFER, m_compactNormals.constData()));
+    } else {
+        glVertexPointer(3, GL_FLOAT, 0, m_buffers.bind(MeshVertices, GL_ARRAY_BUFFER, m_verticesNew.constData()));
+        glNormalPointer(GL_FLOAT, 0, m_buffers.bind(MeshNormals, GL_ARRAY_BUFFER, m_normals.constData()));
+    }
+    const bool shortIndices = !m_compactIndices.isEmpty();
+    const GLenum indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    const int indexSize = shortIndices ? sizeof(quint16) : sizeof(int);
+    const char *indices = (const char *)m_buffers.bind(MeshIndices, GL_ELEMENT_ARRAY_BUFFER,
+            shortIndices ? (const void *)m_compactIndices.constData() : (const void *)drawIndices().constData());
+    if (m_culled) {
+        for (int i = 0; i < m_visibleTriangles.size(); ++i)
+            glDrawElements(GL_TRIANGLES, m_visibleTriangles.at(i).second * 3, indexType,
+                           indices + m_visibleTriangles.at(i).first * 3 * indexSize);
+    } else {
+        glDrawElements(GL_TRIANGLES, m_vertexIndices.size(), indexType, indices);
+    }
+    m_buffers.unbind();
+    if (m_compact) {
+        glDisable(GL_NORMALIZE);
+        glPopMatrix();
+    }
+}
+
+void Model::drawProxy()
+{
+    glVertexPointer(3, GL_FLOAT, 0, m_buffers.bind(ProxyVertices, GL_ARRAY_BUFFER, m_proxyVerticesNew.constData()));
+    glNormalPointer(GL_FLOAT, 0, m_buffers.bind(ProxyNormals, GL_ARRAY_BUFFER, m_proxyNormals.constData()));
+    const void *indices = m_buffers.bind(ProxyIndices, GL_ELEMENT_ARRAY_BUFFER, m_proxyIndices.constData());
+    glDrawElements(GL_TRIANGLES, m_proxyIndices.size(), GL_UNSIGNED_INT, indices);
+    m_buffers.unbind();
+}
+
+// Built from the untransformed mesh like the BVH, transform() moves it along.
+bool Model::buildProxy(int targetFaces, float maxError, LoadProgress *progress)
+{
+    PROFILE_SCOPE("Model::buildProxy");
+    m_proxyVertices.clear();
+    m_proxyIndices.clear();
+    if (faces() <= targetFaces)
+        return true;
+    if (progress)
+        progress->setPhase(LoadProgress::Simplifying, 1);
+    QElapsedTimer timer;
+    timer.start();
+    if (!decimateMesh(m_vertices, m_vertexIndices, targetFaces, maxError * m_size.length(),
+                      m_proxyVertices, m_proxyIndices, progress)) {
+        m_proxyVertices.clear();
+        m_proxyIndices.clear();
+        return false;
+    }
+    transformProxy();
+    m_buffers.release(ProxyVertices);
+    m_buffers.release(ProxyNormals);
+    m_buffers.release(ProxyIndices);
+    qDebug() << Q_FUNC_INFO << faces() << "->" << proxyFaces() << "faces in" << timer.elapsed() << "ms";
+    return true;
 }
 
-void Model::render(bool wireframe, bool normals, bool showGcodeMotion, bool showGcodeLines)
+void Model::transformProxy()
 {
+    const int size = m_proxyVertices.size();
+    m_proxyVerticesNew.resize(size);
+    for (int i = 0; i < size; ++i)
+        m_proxyVerticesNew[i] = m_transform * m_proxyVertices.at(i);
+
+    m_proxyNormals.resize(size);
+    for (int i = 0; i < size; ++i)
+        m_proxyNormals[i] = QVector3D();
+    for (int i = 0; i < m_proxyIndices.size(); i += 3) {
+        const QVector3D a = m_proxyVerticesNew.at(m_proxyIndices.at(i));
+        const QVector3D b = m_proxyVerticesNew.at(m_proxyIndices.at(i + 1));
+        const QVector3D c = m_proxyVerticesNew.at(m_proxyIndices.at(i + 2));
+        const QVector3D normal = QVector3D::crossProduct(b - a, c - a).normalized();
+        for (int j = 0; j < 3; ++j)
+            m_proxyNormals[m_proxyIndices.at(i + j)] += normal;
+    }
+    for (int i = 0; i < size; ++i)
+        m_proxyNormals[i].normalize();
+}
+
+void Model::render(bool wireframe, bool normals, bool showGcodeMotion, bool showGcodeLines, bool proxy, bool mesh)
+{
+    PROFILE_SCOPE("Model::render");
 //    glEnable(GL_DEPTH_TEST);
     glEnableClientState(GL_VERTEX_ARRAY);
     if (wireframe) {
         glVertexPointer(3, GL_FLOAT, 0, (float *)m_vertices.data());
         glDrawElements(GL_LINES, m_edgeIndices.size(), GL_UNSIGNED_INT, m_edgeIndices.data());
-    } else {
+    } else if (mesh) {
         glEnable(GL_LIGHTING);
         glEnable(GL_LIGHT0);
         glEnable(GL_COLOR_MATERIAL);
@@ -82,9 +584,10 @@ void Model::render(bool wireframe, bool normals, bool showGcodeMotion, bool show
 
         glEnableClientState(GL_NORMAL_ARRAY);
 
-        glVertexPointer(3, GL_FLOAT, 0, (float *)m_verticesNew.data());
-        glNormalPointer(GL_FLOAT, 0, (float *)m_normals.data());
-        glDrawElements(GL_TRIANGLES, m_vertexIndices.size(), GL_UNSIGNED_INT, m_vertexIndices.data());
+        if (proxy && !m_proxyIndices.isEmpty())
+            drawProxy();
+        else
+            drawMesh();
 
         glDisableClientState(GL_NORMAL_ARRAY);
         glDisable(GL_COLOR_MATERIAL);
@@ -152,27 +655,79 @@ void Model::render(bool wireframe, bool normals, bool showGcodeMotion, bool show
 }
 
 
-void Model::loadObj(QFile &file)
+// First pass of the text loaders, so the arrays are allocated once instead of growing line
+// by line: counts all lines and the OBJ vertex and face lines. The file is rewound.
+// Compressed files are not counted, that would decompress them twice.
+static void countLines(QIODevice &file, qint64 &lines, qint64 &vertexLines, qint64 &faceLines)
+{
+    lines = vertexLines = faceLines = 0;
+    if (file.isSequential())
+        return;
+    int column = 0;
+    char first = 0;
+    for (;;) {
+        const QByteArray block = file.read(1 << 20);
+        if (block.isEmpty())
+            break;
+        for (int i = 0; i < block.size(); ++i) {
+            const char c = block.at(i);
+            if (column == 0) {
+                first = c;
+            } else if (column == 1 && (c == ' ' || c == '\t')) {   // 'v ', but not 'vn' or 'vt'
+                if (first == 'v')
+                    ++vertexLines;
+                else if (first == 'f')
+                    ++faceLines;
+            }
+            if (c == '\n') {
+                ++lines;
+                column = 0;
+            } else {
+                ++column;
+            }
+        }
+    }
+    file.seek(0);
+}
+
+void Model::loadObj(QIODevice &file, LoadProgress *progress)
 {
+    PROFILE_SCOPE("Model::loadObj");
     // 1e9 = 1*10^9 = 1,000,000,000
     QVector3D boundsMin( 1e9, 1e9, 1e9);
     QVector3D boundsMax(-1e9,-1e9,-1e9);
 
-    QTextStream in(&file);
-    while (!in.atEnd()) {
-        QString input = in.readLine();
+    qint64 lines, vertexLines, faceLines;
+    countLines(file, lines, vertexLines, faceLines);
+    // faces are mostly triangles, quads grow the lists once more
+    m_vertices.reserve(vertexLines);
+    m_vertexIndices.reserve(faceLines * 3);
+    m_edgeIndices.reserve(faceLines * 3);
+
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        if (progress && ++lineNumber % LOAD_POLL_INTERVAL == 0) {
+            progress->step(inputPos(&file));
+            if (progress->isCanceled())
+                return;
+        }
+        const QByteArray input = file.readLine();
+        const char *end = input.constData() + input.size();
+        const char *at = skipSpaces(input.constData(), end);
         // # means comment
-        if (input.isEmpty() || input[0] == '#')
+        if (at == end || *at == '#')
             continue;
 
-        QTextStream ts(&input);
-        QString id;
-        ts >> id;
+        const char *idEnd = skipWord(at, end);
+        const QByteArray id = QByteArray::fromRawData(at, idEnd - at);
+        at = idEnd;
         //---------------  v = List of vertices with (x,y,z[,w]) corrdinates. -----------------
         if (id == "v") {
             QVector3D p;
             for (int i = 0; i < 3; ++i) {
-                ts >> p[i];
+                float value;
+                at = parseFloat(skipSpaces(at, end), end, value);
+                p[i] = value;
                 boundsMin[i] = qMin(boundsMin[i], p[i]);
                 boundsMax[i] = qMax(boundsMax[i], p[i]);
             }
@@ -182,12 +737,11 @@ void Model::loadObj(QFile &file)
         } else if (id == "f" || id == "fo") {
             QVarLengthArray<int, 4> p;
 
-            while (!ts.atEnd()) {
-                QString vertex;
-                ts >> vertex;
+            for (at = skipSpaces(at, end); at != end; at = skipSpaces(skipWord(at, end), end)) {
                 //e.g. vertex / texture
                 // vertex index in correspondence with vertex list.
-                const int vertexIndex = vertex.split('/').value(0).toInt();
+                int vertexIndex;
+                parseInt(at, end, vertexIndex);
 //                qDebug() << "> vertexIndex : " << vertexIndex;
                 if (vertexIndex) {
                     p.append((vertexIndex > 0) ? (vertexIndex - 1) : (m_vertices.size() + vertexIndex));
@@ -196,7 +750,6 @@ void Model::loadObj(QFile &file)
                 }
             }
 
-            qDebug() << QString("p.size(%1) vs. vertexIndices.size(%2)").arg(p.size()).arg(m_vertexIndices.size());
             for (int i = 0; i < p.size(); ++i) {
                 const int edgeA = p[i];
                 const int edgeB = p[(i + 1) % p.size()];
@@ -236,60 +789,81 @@ void Model::loadObj(QFile &file)
 //        m_vertices[i] = (m_vertices[i] - (boundsMin + bounds * ratio)) * scale;
 //    }
 
-    m_verticesNew = m_vertices;
-    recomputeAll();
 }
 
-void Model::loadStl(QFile &file)
+void Model::loadStl(QIODevice &file, bool ascii, LoadProgress *progress)
 {    
-    QTextStream stream(&file);
-    const QString &head = stream.readLine();
-    if (head.left(6) == "solid " && head.size() < 80)	// ASCII format
+    PROFILE_SCOPE("Model::loadStl");
+    if (ascii)
     {
 //        name = head.right(head.size() - 6).toStdString();
-        QString word;
-        stream >> word;
-        for(; word == "facet" ; stream >> word)
-        {
-            stream >> word;	// normal x y z
-            QVector3D n;
-            stream >> n[0] >> n[1] >> n[2];
-            n.normalize();
-
-            stream >> word >> word;	// outer loop
-            stream >> word;
-            size_t startIndex = m_vertices.size();
-            for(; word != "endloop" ; stream >> word)
-            {
+        // an ASCII facet takes 7 lines
+        qint64 lines, vertexLines, faceLines;
+        countLines(file, lines, vertexLines, faceLines);
+        m_vertices.reserve(lines / 7 * 3);
+        m_vertexIndices.reserve(lines / 7 * 3);
+        m_edgeIndices.reserve(lines / 7 * 3);
+
+        // solid name, then facet normal, outer loop, vertex x y z..., endloop, endfacet.
+        // The normals are recomputed anyway.
+        int startIndex = m_vertices.size();
+        int facet = 0;
+        while (!file.atEnd()) {
+            const QByteArray line = file.readLine();
+            const char *end = line.constData() + line.size();
+            const char *at = skipSpaces(line.constData(), end);
+            const char *wordEnd = skipWord(at, end);
+            const QByteArray word = QByteArray::fromRawData(at, wordEnd - at);
+            if (word == "vertex") {
                 QVector3D v; //vertex x y z
-                stream >> v[0] >> v[1] >> v[2];
+                at = wordEnd;
+                for (int i = 0; i < 3; ++i) {
+                    float value;
+                    at = parseFloat(skipSpaces(at, end), end, value);
+                    v[i] = value;
+                }
                 m_vertices.push_back(v);
-//                qDebug() << "==== outer loop ===";
-            }
-
-            for(size_t i = startIndex + 2 ; i < m_vertices.size() ; ++i)
-            {
-                m_vertexIndices.push_back(startIndex);
-                m_vertexIndices.push_back(i - 1);
-                m_vertexIndices.push_back(i);
-
-                qDebug() << QString("edgeA(%1), edgeB(%2)").arg(QString::number(startIndex), QString::number(i)) ;
-
-//                if (startIndex < (i-1))
-                    m_edgeIndices << (startIndex) << (i - 1) << i;
+            } else if (word == "outer") {
+                startIndex = m_vertices.size();
+                if (progress && ++facet % LOAD_POLL_INTERVAL == 0) {
+                    progress->step(inputPos(&file));
+                    if (progress->isCanceled())
+                        return;
+                }
+            } else if (word == "endloop") {
+                for(int i = startIndex + 2 ; i < m_vertices.size() ; ++i)
+                {
+                    m_vertexIndices.push_back(startIndex);
+                    m_vertexIndices.push_back(i - 1);
+                    m_vertexIndices.push_back(i);
+
+//                    if (startIndex < (i-1))
+                        m_edgeIndices << (startIndex) << (i - 1) << i;
+                }
+            } else if (word == "endsolid") {
+                break;
             }
-            stream >> word;	// endfacet
         }
     } else {
         file.setTextModeEnabled(false);
-        file.seek(80);
-        quint32 triangleCount;
+        file.read(80);   // header
+        quint32 triangleCount = 0;
         file.read((char*)&triangleCount, sizeof(triangleCount));
-        m_vertices.reserve(triangleCount * 3U);
-        m_normals.reserve(triangleCount * 3U);
-        m_vertexIndices.reserve(triangleCount * 3U);
-        for(size_t i = 0 ; i < triangleCount ; ++i)
+        // a count beyond the end of the file would read (and allocate) garbage
+        // and a compressed file gets checked as it goes.
+        if (!file.isSequential())
+            triangleCount = qMin<qint64>(triangleCount, qMax<qint64>(file.size() - 84, 0) / 50);
+        const quint32 reserved = file.isSequential() ? qMin(triangleCount, 1U << 22) : triangleCount;
+        m_vertices.reserve(reserved * 3U);
+        m_normals.reserve(reserved * 3U);
+        m_vertexIndices.reserve(reserved * 3U);
+        for(size_t i = 0 ; i < triangleCount && !file.atEnd() ; ++i)
         {
+            if (progress && i % LOAD_POLL_INTERVAL == 0) {
+                progress->step(inputPos(&file));
+                if (progress->isCanceled())
+                    return;
+            }
             QVector3D n, a, b, c;
 #define READ_VECTOR(v)\
             do {\
@@ -315,14 +889,34 @@ void Model::loadStl(QFile &file)
             file.read((char*)&attribute_byte_count, sizeof(attribute_byte_count));
         }
     }
-    m_verticesNew = m_vertices;
-    recomputeAll();
 }
 
-void Model::loadGCode(std::string file)
+void Model::loadGCode(QIODevice &file, std::string fileName, LoadProgress *progress, qint64 memoryLimit, bool parseOnly)
 {
     m_gCode.clear();
-    m_gCode.open(file);
+    m_gCode.open(file, fileName, progress, memoryLimit, parseOnly);
+}
+
+void Model::memoryUsage(MemoryUsage &usage) const
+{
+    addMemory(usage, "vertices", containerBytes(m_vertices));
+    addMemory(usage, "transformed vertices", containerBytes(m_verticesNew));
+    addMemory(usage, "normals", containerBytes(m_normals));
+    addMemory(usage, "edges", containerBytes(m_edgeIndices));
+    addMemory(usage, "indices", containerBytes(m_vertexIndices) + containerBytes(m_drawIndices));
+    addMemory(usage, "BVH", m_bvh.bytes() + containerBytes(m_visibleTriangles));
+    addMemory(usage, "proxy mesh", containerBytes(m_proxyVertices) + containerBytes(m_proxyVerticesNew)
+                                   + containerBytes(m_proxyNormals) + containerBytes(m_proxyIndices));
+    addMemory(usage, "compact copies", containerBytes(m_compactPositions.data) + containerBytes(m_compactNormals)
+                                       + containerBytes(m_compactIndices));
+    m_gCode.memoryUsage(usage);
+}
+
+qint64 Model::memoryBytes() const
+{
+    MemoryUsage usage;
+    memoryUsage(usage);
+    return totalBytes(usage);
 }
 
 void Model::computeEdges()
@@ -333,7 +927,13 @@ void Model::computeEdges()
 //Bounding Box : http://en.wikibooks.org/wiki/OpenGL_Programming/Bounding_box
 void Model::recomputeAll()
 {
-    qDebug() << Q_FUNC_INFO;
+    PROFILE_SCOPE("Model::recomputeAll");
+    // nothing loaded (an empty or broken file), the bounds stay zero
+    if (m_verticesNew.isEmpty()) {
+        m_normals.clear();
+        m_size = m_center = m_min = m_max = QVector3D();
+        return;
+    }
 
     //calculate normals of each face
     int size = m_verticesNew.size();
@@ -390,9 +990,7 @@ void Model::recomputeAll()
     m_min = QVector3D(minX, minY, minZ);
     m_max = QVector3D(maxX, maxY, maxZ);
 
-    qDebug() << QString("MIN : x(%1), y(%2), z(%3)").arg(m_min.x()).arg(m_min.y()).arg(m_min.z());
-    qDebug() << QString("MAN : x(%1), y(%2), z(%3)").arg(m_max.x()).arg(m_max.y()).arg(m_max.z());
-    qDebug() << QString("SIZE : x(%1), y(%2), z(%3)").arg(m_size.x()).arg(m_size.y()).arg(m_size.z());
+    qDebug() << Q_FUNC_INFO << "min" << m_min << "max" << m_max;
 
 //    QMatrix4x4 center(1,1,1,1), scale(1,1,1,1);
 //    m_transform.translate(QMatrix4x4(1,1,1) * center)
@@ -23,18 +23,31 @@
 #include <math.h>
 
 #include "gcode/gcode.h"
+#include "bvh.h"
+#include "meshstats.h"
+#include "gpupool.h"
 
-class QFile;
+class QIODevice;
 class GCoder;
+class LoadProgress;
 
 class Model
 {
 public:
-    Model() {}
-    Model(const QString &filePath);
+    // LoadGeometry keeps what compareWith() needs, the triangles or the g-code lines, and
+    // nothing to draw or pick with.
+    enum LoadMode { LoadAll, LoadGeometry };
+
+    Model() : m_culled(false), m_compact(false), m_normalError(0), m_pool(0) { m_cacheMissRatio[0] = m_cacheMissRatio[1] = 0; }
+    // progress may cancel the load, the model is empty then. A g-code toolpath that would go past
+    // memoryLimit bytes (0 for no limit) is loaded without tubes, see gcodeTubesSkipped().
+    Model(const QString &filePath, LoadProgress *progress = 0, qint64 memoryLimit = 0, LoadMode mode = LoadAll);
     ~Model();
 
-    void render(bool wireframe = false, bool normals = false, bool showGcodeMotion = false, bool showGcodeLines = true) ;
+    // proxy draws the simplified mesh instead, if there is one, see buildProxy(). Without mesh
+    // the triangles are left to a batched GpuPool::draw() over poolRanges().
+    void render(bool wireframe = false, bool normals = false, bool showGcodeMotion = false, bool showGcodeLines = true,
+                bool proxy = false, bool mesh = true) ;
     void transform(QMatrix4x4 matrix);
     QString fileName() const { return m_fileName; }
     int faces() const { return m_vertexIndices.size() / 3; }
@@ -42,6 +55,72 @@ public:
     int points() const { return m_vertices.size(); }
     int gcodeCount() { return m_gCode.getGCodeCount(); }
     void setGCodeLayers(int layers) { m_gCode.setGCodeLayers(layers); }
+    void setGCodeLayerRange(int first, int last) { m_gCode.setLayerRange(first, last); }
+    int gcodeLayerCount() const { return m_gCode.layerCount(); }
+    void setGCodeFeatureVisible(int feature, bool visible) { m_gCode.setFeatureVisible(feature, visible); }
+    int gcodeFeatureMoves(int feature) const { return m_gCode.featureMoves(feature); }
+    void setGCodeColorMode(int mode) { m_gCode.setColorMode(mode); }
+    void setGCodeColorRange(float min, float max) { m_gCode.setColorRange(min, max); }
+    void gcodeColorRange(float &min, float &max) const { m_gCode.colorRange(min, max); }
+    void bounds(QVector3D &min, QVector3D &max);
+    void setGCodeTolerance(float tolerance) { m_gCode.setDetailTolerance(tolerance); }
+    void setViewProjection(const QMatrix4x4 &viewProjection);
+    bool pick(const QVector3D &origin, const QVector3D &direction, QVector3D &hit) const;
+    bool nearestPoint(const QVector3D &point, QVector3D &nearest) const;
+    const Bvh &bvh() const { return m_bvh; }
+    // of the mesh as loaded, before any transform()
+    const MeshStatistics &statistics() const { return m_statistics; }
+    // Reorders the drawn triangles for the vertex cache and the vertices for fetch locality.
+    // Average cache miss ratios before and after, 0 until optimized.
+    void optimizeMesh();
+    float cacheMissRatio(bool optimized) const { return m_cacheMissRatio[optimized ? 1 : 0]; }
+    // Simplified copy of the mesh to draw while the view moves, at most targetFaces faces
+    // unless that moves the surface by more than maxError of the model size, see decimateMesh().
+    // Returns false if canceled.
+    bool buildProxy(int targetFaces, float maxError, LoadProgress *progress = 0);
+    int proxyFaces() const { return m_proxyIndices.size() / 3; }
+    // Draws the mesh and the toolpath from 16 bit positions and byte normals, see compactvertices.h.
+    // Picking keeps the float copies. Largest errors of the packing, 0 when not compact.
+    void setCompactVertices(bool compact);
+    float positionError() const;
+    float normalError() const { return qMax(m_normalError, m_gCode.compactNormalError()); }
+    // The slow half of setGCodeReference() or diffGCode(), whichever fits this model: cuts the
+    // mesh at the layers of target or compares the toolpaths layer by layer. Only reads target,
+    // so it may run on another thread while target is drawn.
+    void compareWith(const Model &target, LoadProgress *progress = 0);
+    // false if compareWith() had nothing to compare, the load failed or was left out
+    bool hasComparison() const { return !m_compareOutlines.isEmpty() || !m_compareLayers.isEmpty(); }
+    // Shows the outlines mesh->compareWith() cut of this toolpath (mesh as loaded, z up and resting
+    // on z = 0, cut at the middle of each layer, x/y centered on the extrusions). Returns the outlines.
+    int setGCodeReference(const Model &mesh);
+    void clearGCodeReference() { m_gCode.clearReference(); }
+    // shows the layers other->compareWith() found changed in this toolpath, returns how many
+    int diffGCode(const Model &other, QVector<GCodeLayerDiff> &layers);
+    void clearGCodeDiff() { m_gCode.clearDiff(); }
+    bool hasGCodeDiff() const { return m_gCode.hasDiff(); }
+    int setGCodeOccupancyOverlay(int query) { return m_gCode.setOccupancyOverlay(query); }
+    float gcodeOccupancyCellSize() const { return m_gCode.occupancy().cellSize(); }
+    bool gcodeTubesSkipped() const { return m_gCode.tubesSkipped(); }
+    // client side bytes by category, the toolpath included
+    void memoryUsage(MemoryUsage &usage) const;
+    qint64 memoryBytes() const;
+    int pickMove(const QVector3D &origin, const QVector3D &direction, float maxDistance) { return m_gCode.pickMove(origin, direction, maxDistance); }
+    const GCodeLine &gcodeLine(int index) { return m_gCode.getCodeLines()[index]; }
+    QString gcodeSourceLine(int index) const { return QString::fromStdString(m_gCode.sourceLine(index)); }
+
+    // buffer object slots of the mesh, the g-code slots follow
+    enum GpuSlot { MeshVertices, MeshNormals, MeshIndices, ProxyVertices, ProxyNormals, ProxyIndices, MeshSlots };
+    // Arrays still drawn from client memory, to be queued on a GpuUploader. With a block the
+    // mesh goes into that range of pool instead of buffers of its own.
+    QVector<GpuArray> gpuArrays(const GpuPool *pool = 0, const GpuPoolBlock &block = GpuPoolBlock()) const;
+    void setGpuBuffers(const QVector<GpuArray> &arrays, GpuUploader *uploader, GpuPool *pool = 0,
+                       const GpuPoolBlock &block = GpuPoolBlock());
+    // float meshes only, the compact ones keep a quantization of their own
+    bool canPool() const { return !m_compact && !m_verticesNew.isEmpty() && !m_vertexIndices.isEmpty(); }
+    bool isPooled() const { return m_poolBlock.isValid(); }
+    int poolPage() const { return m_poolBlock.page; }
+    // index ranges (first, count) of the visible triangles in the pool page
+    void poolRanges(QVector<QPair<int, int> > &ranges) const;
 private:
     QString m_fileName;
     QVector<QVector3D> m_vertices;
@@ -50,6 +129,27 @@ private:
     QVector<int> m_edgeIndices;
     QVector<int> m_vertexIndices;
     GCode m_gCode;
+    Bvh m_bvh;   // over m_vertices, m_vertexIndices is kept in tree order
+    MeshStatistics m_statistics;
+    QVector<QPair<int, int> > m_visibleTriangles;   // BVH ranges inside the frustum
+    bool m_culled;                                   // m_visibleTriangles is valid
+    GpuBuffers m_buffers;                            // see GpuSlot, wireframe stays client side
+    QVector<int> m_drawIndices;                      // optimizeMesh() order of m_vertexIndices, if any
+    float m_cacheMissRatio[2];
+    QVector<QVector3D> m_proxyVertices;              // model space, see buildProxy()
+    QVector<QVector3D> m_proxyVerticesNew;
+    QVector<QVector3D> m_proxyNormals;
+    QVector<int> m_proxyIndices;
+    bool m_compact;
+    CompactPositions m_compactPositions;             // of m_verticesNew
+    QByteArray m_compactNormals;
+    QByteArray m_compactIndices;                     // of drawIndices(), only if 16 bit will do
+    float m_normalError;
+    GpuPool *m_pool;                                 // holds the mesh at m_poolBlock, if valid
+    GpuPoolBlock m_poolBlock;
+    QVector<QVector<SliceContour> > m_compareOutlines;   // see compareWith()
+    QVector2D m_compareOffset;
+    QVector<GCodeLayerDiff> m_compareLayers;
 
     QVector3D m_size;
     QVector3D m_center;
@@ -57,9 +157,15 @@ private:
     QVector3D m_max;
     QMatrix4x4 m_transform;
 
-    void loadObj(QFile &file);
-    void loadStl(QFile &file);
-    void loadGCode(std::string file);
+    void loadObj(QIODevice &file, LoadProgress *progress);
+    void loadStl(QIODevice &file, bool ascii, LoadProgress *progress);
+    void loadGCode(QIODevice &file, std::string fileName, LoadProgress *progress, qint64 memoryLimit, bool parseOnly);
+    const QVector<int> &drawIndices() const { return m_drawIndices.isEmpty() ? m_vertexIndices : m_drawIndices; }
+    void packVertices();
+    void releasePoolBlock();
+    void transformProxy();
+    void drawMesh();
+    void drawProxy();
     void computeEdges();
     void recomputeAll();
 };
@@ -0,0 +1,115 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "modelformat.h"
+#include "gcode/bgcode.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QDebug>
+
+static const int STL_HEADER_SIZE   = 84;   // 80 byte header, triangle count
+static const int STL_TRIANGLE_SIZE = 50;   // normal, 3 vertices, attribute
+
+// no control characters besides line ends and tabs
+static bool isText(const QByteArray &bytes)
+{
+    for (int i = 0; i < bytes.size(); ++i) {
+        const uchar c = bytes.at(i);
+        if (c < 0x20 && c != '\n' && c != '\r' && c != '\t' && c != '\f')
+            return false;
+    }
+    return true;
+}
+
+// Votes of the leading word of each line: G0, M104, T1, ; for g-code, v, f, o, usemtl... for OBJ.
+static void countLineStarts(const QByteArray &text, int &gcode, int &obj)
+{
+    gcode = obj = 0;
+    int start = 0;
+    while (start < text.size()) {
+        int end = text.indexOf('\n', start);
+        if (end < 0)
+            end = text.size();
+        int at = start;
+        while (at < end && (text.at(at) == ' ' || text.at(at) == '\t'))
+            ++at;
+        int wordEnd = at;
+        while (wordEnd < end && text.at(wordEnd) != ' ' && text.at(wordEnd) != '\t' && text.at(wordEnd) != '\r')
+            ++wordEnd;
+        const QByteArray word = text.mid(at, wordEnd - at);
+        if (!word.isEmpty()) {
+            const char first = word.at(0);
+            if (first == ';') {
+                ++gcode;
+            } else if ((first == 'G' || first == 'M' || first == 'T' || first == 'N')
+                       && word.size() > 1 && word.at(1) >= '0' && word.at(1) <= '9') {
+                ++gcode;
+            } else if (word == "v" || word == "vt" || word == "vn" || word == "f" || word == "o"
+                       || word == "g" || word == "s" || word == "l" || word == "usemtl" || word == "mtllib") {
+                ++obj;
+            }
+        }
+        start = end + 1;
+    }
+}
+
+ModelFormat detectFormat(QIODevice &device, const QString &fileName)
+{
+    if (BGCodeReader::isBinaryGCode(device))
+        return BinaryGCodeFormat;
+
+    const QByteArray head = device.peek(FORMAT_SNIFF_SIZE);
+    // a compressed file's size is not known before it is read
+    if (!device.isSequential() && head.size() >= STL_HEADER_SIZE) {
+        const quint32 triangles = (uchar)head.at(80) | (uchar)head.at(81) << 8
+                | (uchar)head.at(82) << 16 | quint32((uchar)head.at(83)) << 24;
+        if (device.size() == STL_HEADER_SIZE + qint64(STL_TRIANGLE_SIZE) * triangles)
+            return StlBinary;
+    }
+
+    // the last line may be cut anywhere, even in a multi-byte character
+    if (!isText(head))
+        return head.size() >= STL_HEADER_SIZE ? StlBinary : UnknownFormat;
+
+    const QByteArray text = head.trimmed();
+    if (text.startsWith("solid") && (text.indexOf("facet") >= 0 || text.indexOf("endsolid") >= 0))
+        return StlAscii;
+    int gcode, obj;
+    countLineStarts(head, gcode, obj);
+    if (gcode > obj)
+        return GCodeFormat;
+    if (obj > gcode)
+        return ObjFormat;
+
+    if (fileName.endsWith(".gcode", Qt::CaseInsensitive))
+        return GCodeFormat;
+    if (fileName.endsWith(".obj", Qt::CaseInsensitive))
+        return ObjFormat;
+    if (fileName.endsWith(".stl", Qt::CaseInsensitive))
+        return text.startsWith("solid") ? StlAscii : StlBinary;
+    return UnknownFormat;
+}
+
+const char *formatName(int format)
+{
+    switch (format) {
+    case StlAscii:          return "ASCII STL";
+    case StlBinary:         return "binary STL";
+    case ObjFormat:         return "OBJ";
+    case GCodeFormat:       return "G-code";
+    case BinaryGCodeFormat: return "binary G-code";
+    default:                return "unknown";
+    }
+}
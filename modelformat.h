@@ -0,0 +1,43 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MODELFORMAT_H
+#define MODELFORMAT_H
+
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+// bytes looked at to tell text formats apart
+const int FORMAT_SNIFF_SIZE = 4096;
+
+enum ModelFormat
+{
+    UnknownFormat,
+    StlAscii,
+    StlBinary,
+    ObjFormat,
+    GCodeFormat,
+    BinaryGCodeFormat
+};
+
+// What device holds, by its contents; fileName only breaks ties between text formats.
+// A binary STL is an 84 byte head and 50 bytes per declared triangle, so a file of
+// exactly that size is binary whatever its head says ("solid" included). Nothing is read.
+ModelFormat detectFormat(QIODevice &device, const QString &fileName);
+const char *formatName(int format);
+
+#endif // MODELFORMAT_H
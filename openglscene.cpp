@@ -19,7 +19,11 @@
 
 #include "openglscene.h"
 #include "model.h"
+#include "gpuuploader.h"
+#include "loadprogress.h"
+#include "profiler.h"
 #include "trackball.h"
+#include "gcode/feature.h"
 
 #include <QtGui>
 #include <QtOpenGL>
@@ -42,19 +46,115 @@ const float GRID_SIZE = 100.f;
 const float CAMERA_DISTANCE = 16.0f;
 const float DEG2RAD         = 3.141593f / 180;
 
-static Model *loadModel(const QString &filePath)
+// meshes above PROXY_MIN_FACES get a simplified proxy of PROXY_FACES, within PROXY_ERROR of
+// the model size, that is drawn while the view moves and for PROXY_IDLE_MS after
+const int   PROXY_MIN_FACES = 1000000;
+const int   PROXY_FACES     = 250000;
+const float PROXY_ERROR     = 0.002f;
+const int   PROXY_IDLE_MS   = 300;
+
+// whether bytes more keep model within memoryLimit, any size fits without a limit
+static bool fitsBudget(const Model *model, qint64 bytes, qint64 memoryLimit)
+{
+    if (memoryLimit <= 0 || model->memoryBytes() + bytes <= memoryLimit)
+        return true;
+    qWarning() << Q_FUNC_INFO << model->fileName() << "skips a step of" << bytes << "bytes, the limit is" << memoryLimit;
+    return false;
+}
+
+// With a memoryLimit (bytes, 0 for none) the steps that would go past it are left out: the
+// g-code tubes, the cache order, the proxy and the compact copies.
+static Model *loadModel(const QString &filePath, bool optimize, bool compact, LoadProgress *progress = 0,
+                        qint64 memoryLimit = 0)
 {
-    return new Model(filePath);
+    Model *model = new Model(filePath, progress, memoryLimit);
+    if (progress && progress->isCanceled())
+        return model;
+    if (optimize && fitsBudget(model, qint64(model->faces()) * 3 * sizeof(int), memoryLimit))
+        model->optimizeMesh();
+    if (model->faces() > PROXY_MIN_FACES
+            && fitsBudget(model, qint64(PROXY_FACES) * (3 * sizeof(int) + 3 * sizeof(QVector3D)), memoryLimit)
+            && !model->buildProxy(PROXY_FACES, PROXY_ERROR, progress))
+        return model;
+    // about half of the float copies, positions in 6 bytes and normals in 4
+    if (compact && fitsBudget(model, model->memoryBytes() / 2, memoryLimit))
+        model->setCompactVertices(true);
+    return model;
 }
 
+// Loads no more of filePath than comparing it with target takes, see Model::compareWith().
+// The result holds the comparison for target, it is not meant to be drawn. Nothing is compared
+// if the geometry alone goes past memoryLimit.
+static Model *loadComparison(const QString &filePath, const Model *target, LoadProgress *progress = 0,
+                             qint64 memoryLimit = 0)
+{
+    Model *model = new Model(filePath, progress, memoryLimit, Model::LoadGeometry);
+    if (!(progress && progress->isCanceled()) && fitsBudget(model, 0, memoryLimit))
+        model->compareWith(*target, progress);
+    return model;
+}
+
+#ifndef QT_NO_CONCURRENT
+// Runs ::loadModel (or ::loadComparison, given a target) on the global thread pool behind a
+// QFutureInterface. Unlike QtConcurrent::run this lets a QFutureWatcher follow the progress
+// and cancel the load.
+class ModelLoadTask : public QRunnable
+{
+public:
+    static QFuture<Model *> start(const QString &filePath, bool optimize, bool compact, qint64 memoryLimit,
+                                  const Model *target = 0)
+    {
+        ModelLoadTask *task = new ModelLoadTask(filePath, optimize, compact, memoryLimit, target);   // deleted by the pool
+        task->m_future.setProgressRange(0, LOAD_PROGRESS_RANGE);
+        task->m_future.reportStarted();
+        QFuture<Model *> future = task->m_future.future();
+        QThreadPool::globalInstance()->start(task);
+        return future;
+    }
+
+    void run()
+    {
+        if (!m_future.isCanceled()) {
+            LoadProgress progress(&m_future);
+            Model *model = m_target ? ::loadComparison(m_filePath, m_target, &progress, m_memoryLimit)
+                                    : ::loadModel(m_filePath, m_optimize, m_compact, &progress, m_memoryLimit);
+            // a canceled future drops the result, nobody else would free it.
+            if (!progress.isCanceled())
+                m_future.reportResult(model);
+            if (m_future.resultCount() == 0)
+                delete model;
+        }
+        m_future.reportFinished();
+    }
+
+private:
+    ModelLoadTask(const QString &filePath, bool optimize, bool compact, qint64 memoryLimit, const Model *target)
+        : m_filePath(filePath), m_optimize(optimize), m_compact(compact), m_memoryLimit(memoryLimit)
+        , m_target(target) {}
+
+    QString m_filePath;
+    bool m_optimize;
+    bool m_compact;
+    qint64 m_memoryLimit;
+    const Model *m_target;   // only read, the scene keeps it until the task finished
+    QFutureInterface<Model *> m_future;
+};
+#endif
+
 //========================================================
 OpenGLScene::OpenGLScene()
     : m_wireframeEnabled(false)
     , m_normalsEnabled(false)
     , m_gcodeMotionEnabled(true)
+    , m_meshOptimization(false)
+    , m_compactVertices(false)
+    , m_memoryBudget(0)
     , m_modelColor(153, 255, 0)
     , m_backgroundColor(233,240,250)
     , m_model(0)
+    , m_compareTarget(0)
+    , m_replaceModels(false)
+    , m_uploader(0)
 //    , m_distance(1.4f)
 {
 #ifdef QUATERNION_CAMERA
@@ -71,9 +171,44 @@ OpenGLScene::OpenGLScene()
     connect(m_modelButton, SIGNAL(clicked()), this, SLOT(loadModel()));
 #ifndef QT_NO_CONCURRENT
     connect(&m_modelLoader, SIGNAL(finished()), this, SLOT(modelLoaded()));
+    connect(&m_compareLoader, SIGNAL(finished()), this, SLOT(comparisonLoaded()));
 #endif
     controls->layout()->addWidget(m_modelButton);
 
+    m_addButton = new QPushButton(tr("Add models..."));
+    connect(m_addButton, SIGNAL(clicked()), this, SLOT(addModels()));
+    controls->layout()->addWidget(m_addButton);
+
+    m_modelList = new QComboBox;
+    connect(m_modelList, SIGNAL(currentIndexChanged(int)), this, SLOT(selectModel(int)));
+    controls->layout()->addWidget(m_modelList);
+
+    QPushButton *removeButton = new QPushButton(tr("Remove model"));
+    connect(removeButton, SIGNAL(clicked()), this, SLOT(removeModel()));
+    controls->layout()->addWidget(removeButton);
+
+#ifndef QT_NO_CONCURRENT
+    m_loadWidget = new QWidget;
+    m_loadWidget->setLayout(new QVBoxLayout);
+    m_loadWidget->layout()->setContentsMargins(0, 0, 0, 0);
+    m_loadStatus = new QLabel;
+    m_loadProgress = new QProgressBar;
+    m_loadProgress->setRange(0, LOAD_PROGRESS_RANGE);
+    m_loadProgress->setTextVisible(false);
+    QPushButton *cancelButton = new QPushButton(tr("Cancel loading"));
+    connect(&m_modelLoader, SIGNAL(progressValueChanged(int)), m_loadProgress, SLOT(setValue(int)));
+    connect(&m_modelLoader, SIGNAL(progressTextChanged(QString)), m_loadStatus, SLOT(setText(QString)));
+    connect(cancelButton, SIGNAL(clicked()), &m_modelLoader, SLOT(cancel()));
+    connect(&m_compareLoader, SIGNAL(progressValueChanged(int)), m_loadProgress, SLOT(setValue(int)));
+    connect(&m_compareLoader, SIGNAL(progressTextChanged(QString)), m_loadStatus, SLOT(setText(QString)));
+    connect(cancelButton, SIGNAL(clicked()), &m_compareLoader, SLOT(cancel()));
+    m_loadWidget->layout()->addWidget(m_loadStatus);
+    m_loadWidget->layout()->addWidget(m_loadProgress);
+    m_loadWidget->layout()->addWidget(cancelButton);
+    m_loadWidget->hide();
+    controls->layout()->addWidget(m_loadWidget);
+#endif
+
     QCheckBox *wireframe = new QCheckBox(tr("Render as wireframe"));
     connect(wireframe, SIGNAL(toggled(bool)), this, SLOT(enableWireframe(bool)));
     controls->layout()->addWidget(wireframe);
@@ -92,6 +227,21 @@ OpenGLScene::OpenGLScene()
     connect(linesOnly, SIGNAL(toggled(bool)), this, SLOT(enableGCodeLines(bool)));
     controls->layout()->addWidget(linesOnly);
 
+    QCheckBox *optimize = new QCheckBox(tr("Optimize meshes for the vertex cache"));
+    connect(optimize, SIGNAL(toggled(bool)), this, SLOT(enableMeshOptimization(bool)));
+    controls->layout()->addWidget(optimize);
+
+    QCheckBox *compact = new QCheckBox(tr("Compact vertex formats"));
+    connect(compact, SIGNAL(toggled(bool)), this, SLOT(enableCompactVertices(bool)));
+    controls->layout()->addWidget(compact);
+
+    QHBoxLayout *budgetBox = createSpinBox(tr("Memory budget (MB, 0 for none)"), 0, 1 << 20, SLOT(setMemoryBudget(int)));
+    controls->layout()->addItem(budgetBox);
+
+    QCheckBox *profiler = new QCheckBox(tr("Show profiler"));
+    connect(profiler, SIGNAL(toggled(bool)), this, SLOT(enableProfiler(bool)));
+    controls->layout()->addWidget(profiler);
+
     QPushButton *colorButton = new QPushButton(tr("Choose model color"));
     connect(colorButton, SIGNAL(clicked()), this, SLOT(setModelColor()));
     controls->layout()->addWidget(colorButton);
@@ -104,10 +254,12 @@ OpenGLScene::OpenGLScene()
     QWidget *statistics = createDialog(tr("Model info"));
     statistics->layout()->setMargin(20);
 
-    for (int i = 0; i < 4; ++i) {
+    for (int i = 0; i < 10; ++i) {
         m_labels[i] = new QLabel;
         statistics->layout()->addWidget(m_labels[i]);
     }
+    m_memoryLabel = new QLabel;
+    statistics->layout()->addWidget(m_memoryLabel);
 
     QGroupBox *posGroupBox = new QGroupBox(tr("Translate"));
     QVBoxLayout *posVBox = new QVBoxLayout();
@@ -144,8 +296,57 @@ OpenGLScene::OpenGLScene()
     QWidget *gcodeSlider = createDialog(tr("G-Code Slider"));
     m_slider = createSlider(0, SLOT(gcodeLayers(int)));
     gcodeSlider->layout()->addWidget(m_slider);
+
+    // ================= Features Dialog ===================
+    QWidget *features = createDialog(tr("G-Code Features"));
+    for (int i = 0; i < FeatureCount; ++i) {
+        QCheckBox *feature = new QCheckBox(tr(featureName(i)));
+        const float *color = featureColor(i);
+        feature->setStyleSheet(QString("color: rgb(%1, %2, %3)").arg(int(color[0] * 255))
+                               .arg(int(color[1] * 255)).arg(int(color[2] * 255)));
+        feature->setChecked(true);
+        feature->setProperty("feature", i);
+        connect(feature, SIGNAL(toggled(bool)), this, SLOT(enableFeature(bool)));
+        features->layout()->addWidget(feature);
+        m_featureBoxes << feature;
+    }
+
+    m_colorMode = new QComboBox;
+    m_colorMode->addItems(QStringList() << tr("Color by feature") << tr("Speed (mm/s)")
+                                        << tr("Flow (mm\u00b3/s)") << tr("Layer time (s)"));
+    connect(m_colorMode, SIGNAL(currentIndexChanged(int)), this, SLOT(setColorMode(int)));
+    features->layout()->addWidget(m_colorMode);
+
+    QHBoxLayout *colorRange = new QHBoxLayout;
+    m_colorMin = new QDoubleSpinBox;
+    m_colorMax = new QDoubleSpinBox;
+    foreach (QDoubleSpinBox *spinBox, QList<QDoubleSpinBox *>() << m_colorMin << m_colorMax) {
+        spinBox->setRange(0, 100000);
+        spinBox->setDecimals(1);
+        spinBox->setEnabled(false);
+        connect(spinBox, SIGNAL(valueChanged(double)), this, SLOT(setColorRange()));
+        colorRange->addWidget(spinBox);
+    }
+    features->layout()->addItem(colorRange);
+
+    QPushButton *compareButton = new QPushButton(tr("Compare with mesh..."));
+    connect(compareButton, SIGNAL(clicked()), this, SLOT(compareWithMesh()));
+    features->layout()->addWidget(compareButton);
+    QPushButton *diffButton = new QPushButton(tr("Compare with G-code..."));
+    connect(diffButton, SIGNAL(clicked()), this, SLOT(compareWithGCode()));
+    features->layout()->addWidget(diffButton);
+    m_diffLabel = new QLabel;
+    features->layout()->addWidget(m_diffLabel);
+
+    m_occupancyMode = new QComboBox;
+    m_occupancyMode->addItems(QStringList() << tr("No occupancy overlay") << tr("Overlaps")
+                                            << tr("Overhangs") << tr("Gaps"));
+    connect(m_occupancyMode, SIGNAL(currentIndexChanged(int)), this, SLOT(setOccupancyOverlay(int)));
+    features->layout()->addWidget(m_occupancyMode);
+    m_occupancyLabel = new QLabel;
+    features->layout()->addWidget(m_occupancyLabel);
     // ================= Merge dialogs ==================
-    QWidget *widgets[] = { controls, statistics, gcodeSlider };
+    QWidget *widgets[] = { controls, statistics, gcodeSlider, features };
 
     for (uint i = 0; i < sizeof(widgets) / sizeof(*widgets); ++i) {
         QGraphicsProxyWidget *proxy = new QGraphicsProxyWidget(0, Qt::Dialog);
@@ -164,6 +365,27 @@ OpenGLScene::OpenGLScene()
         pos += QPointF(0, 10 + rect.height());
     }
 
+    // ================= Profiler Dialog ===================
+    // made after the others are stacked, it stays hidden until enabled
+    QWidget *profile = createDialog(tr("Profiler"));
+    m_profileLabel = new QLabel;
+    QFont font(QLatin1String("Monospace"));
+    font.setStyleHint(QFont::TypeWriter);
+    m_profileLabel->setFont(font);
+    profile->layout()->addWidget(m_profileLabel);
+    QPushButton *traceButton = new QPushButton(tr("Export trace..."));
+    connect(traceButton, SIGNAL(clicked()), this, SLOT(exportTrace()));
+    profile->layout()->addWidget(traceButton);
+    QPushButton *resetButton = new QPushButton(tr("Reset"));
+    connect(resetButton, SIGNAL(clicked()), this, SLOT(resetProfiler()));
+    profile->layout()->addWidget(resetButton);
+    m_profileItem = new QGraphicsProxyWidget(0, Qt::Dialog);
+    m_profileItem->setWidget(profile);
+    m_profileItem->setFlag(QGraphicsItem::ItemIsMovable);
+    m_profileItem->setPos(400, 10);
+    m_profileItem->hide();
+    addItem(m_profileItem);
+
     QRadialGradient gradient(40, 40, 40, 40, 40);
     gradient.setColorAt(0.2, Qt::yellow);
     gradient.setColorAt(1, Qt::transparent);
@@ -224,6 +446,16 @@ OpenGLScene::OpenGLScene()
 
 OpenGLScene::~OpenGLScene()
 {
+#ifndef QT_NO_CONCURRENT
+    // a comparison still reads its target
+    m_compareLoader.cancel();
+    m_compareLoader.waitForFinished();
+#endif
+    // the models and the pool hand their buffers back to the uploader
+    qDeleteAll(m_pendingModels);
+    qDeleteAll(m_models);
+    m_pool.clear();
+    delete m_uploader;
 //    glDeleteBuffersARB(1, &vboId);
 }
 
@@ -633,17 +865,24 @@ void OpenGLScene::drawBackground(QPainter *painter, const QRectF &)
         return;
     }
 
+    Profiler::instance().beginFrame();
     painter->beginNativePainting();
 
     initGL();
 
+    if (!m_uploader) {
+        m_uploader = new GpuUploader(this);
+        connect(m_uploader, SIGNAL(uploaded(int,QVector<GpuArray>)), this, SLOT(modelUploaded(int,QVector<GpuArray>)));
+        m_pool.setUploader(m_uploader);
+    }
+    flushUploads();
+
     glClearColor(m_backgroundColor.redF(), m_backgroundColor.greenF(), m_backgroundColor.blueF(), 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     glMatrixMode(GL_PROJECTION); //switch to projection matrix
     glPushMatrix();              //save current projection matrix
-    glLoadIdentity();            //reset projection matrix
-    gluPerspective(70, width() / height(), 0.01, 1000);
+    glLoadMatrixf(projectionMatrix().constData());
 
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
@@ -651,10 +890,7 @@ void OpenGLScene::drawBackground(QPainter *painter, const QRectF &)
 
     // ====== added begin ======
 #ifdef QUATERNION_CAMERA
-    QMatrix4x4 view;
-    view.rotate(m_trackBall->rotation());
-    view(2, 3) -= 2.0f * exp(m_distExp / 1200.0f);
-    glLoadMatrixf(view.constData());
+    glLoadMatrixf(viewMatrix().constData());
 #else
     /*
         //move model farther away.
@@ -666,13 +902,12 @@ void OpenGLScene::drawBackground(QPainter *painter, const QRectF &)
 
 #endif
 
-    if (m_model) {
+    if (!m_models.isEmpty()) {
         const float pos[] = { float(m_lightItem->x() - width() / 2), float(height() / 2 - m_lightItem->y()), 512, 0 };
         glLightfv(GL_LIGHT0, GL_POSITION, pos);
-        glColor4f(m_modelColor.redF(), m_modelColor.greenF(), m_modelColor.blueF(), 1.0f);
 
         glEnable(GL_MULTISAMPLE);
-        m_model->render(m_wireframeEnabled, m_normalsEnabled, m_gcodeMotionEnabled, m_gcodeLinesEnabled);
+        drawModels();
         glDisable(GL_MULTISAMPLE);
 
     }
@@ -688,11 +923,96 @@ void OpenGLScene::drawBackground(QPainter *painter, const QRectF &)
     glPopMatrix();
 
     painter->endNativePainting();
+    Profiler::instance().endFrame();
+    if (m_profileItem->isVisible() && (m_profileRefresh.isNull() || m_profileRefresh.elapsed() > 250)) {
+        m_profileLabel->setText(Profiler::instance().summary(24));
+        m_profileRefresh.start();
+    }
 
     QTimer::singleShot(20, this, SLOT(update()));
 }
 
 
+// Meshes in the pool are collected over all models and drawn page by page, everything
+// else (compact meshes, proxies, wireframes, g-code) model by model.
+void OpenGLScene::drawModels()
+{
+    PROFILE_SCOPE("OpenGLScene::drawModels");
+    const QMatrix4x4 viewProjection = projectionMatrix() * viewMatrix();
+    const bool moving = !m_interaction.isNull() && m_interaction.elapsed() < PROXY_IDLE_MS;
+    m_poolRanges.resize(m_pool.pages());
+    for (int i = 0; i < m_poolRanges.size(); ++i)
+        m_poolRanges[i].clear();
+
+    foreach (Model *model, m_models) {
+        // lets the g-code skip details smaller than a pixel.
+        model->setGCodeTolerance(pixelSize());
+        // skips the triangles and g-code chunks outside the view.
+        model->setViewProjection(viewProjection);
+        const bool pooled = model->isPooled() && !m_wireframeEnabled && !(moving && model->proxyFaces() > 0);
+        if (pooled)
+            model->poolRanges(m_poolRanges[model->poolPage()]);
+        glColor4f(m_modelColor.redF(), m_modelColor.greenF(), m_modelColor.blueF(), 1.0f);
+        model->render(m_wireframeEnabled, m_normalsEnabled, m_gcodeMotionEnabled, m_gcodeLinesEnabled, moving, !pooled);
+    }
+
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glEnable(GL_COLOR_MATERIAL);
+    glShadeModel(GL_SMOOTH);
+    glColor4f(m_modelColor.redF(), m_modelColor.greenF(), m_modelColor.blueF(), 1.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    for (int page = 0; page < m_poolRanges.size(); ++page)
+        m_pool.draw(page, m_poolRanges.at(page));
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_COLOR_MATERIAL);
+    glDisable(GL_LIGHT0);
+    glDisable(GL_LIGHTING);
+}
+
+// the upload happens with the next frame, see flushUploads().
+void OpenGLScene::requestUpload(Model *model)
+{
+    if (!m_uploadRequests.contains(model))
+        m_uploadRequests.push_back(model);
+    update();
+}
+
+// Queues the arrays of the requested models, float meshes get a block of the pool.
+// Runs in drawBackground() as new pool pages are made on our context.
+void OpenGLScene::flushUploads()
+{
+    PROFILE_SCOPE("OpenGLScene::flushUploads");
+    const QVector<Model *> requests = m_uploadRequests;
+    m_uploadRequests.clear();
+    foreach (Model *model, requests) {
+        GpuPoolBlock block;
+        QVector<GpuArray> arrays;
+        if (m_uploader->isValid()) {
+            if (model->canPool() && !model->isPooled())
+                m_pool.allocate(model->points(), model->faces() * 3, block);
+            arrays = model->gpuArrays(&m_pool, block);
+        }
+        if (arrays.isEmpty()) {
+            // drawn from client memory
+            if (m_pendingModels.removeOne(model))
+                addModel(model);
+            continue;
+        }
+        const int ticket = m_uploader->upload(arrays);
+        SceneUpload upload;
+        upload.model = model;
+        upload.block = block;
+        m_uploads.insert(ticket, upload);
+        m_uploadTickets.insert(model, ticket);
+    }
+    if (!requests.isEmpty())
+        qDebug() << Q_FUNC_INFO << m_models.size() + m_pendingModels.size() << "models, pool" << m_pool.pages()
+                 << "pages" << m_pool.usedBytes() << "of" << m_pool.capacityBytes() << "bytes";
+}
+
 void OpenGLScene::drawBox()
 {
 //    glDepthFunc(GL_ALWAYS);     // to avoid visual artifacts with grid lines
@@ -828,31 +1148,300 @@ void OpenGLScene::drawGrid()
 
 void OpenGLScene::loadModel()
 {
-    loadModel(QFileDialog::getOpenFileName(0, tr("Choose model"), QString(), QLatin1String("*.obj *.stl *.gcode")));
+    loadModel(QFileDialog::getOpenFileName(0, tr("Choose model"), QString(), QLatin1String("*.obj *.stl *.gcode *.bgcode *.gz *.zst")));
 }
 
+// replaces all models once the new one is on the GPU
 void OpenGLScene::loadModel(const QString &filePath)
 {
     if (filePath.isEmpty())
         return;
 
+    m_loadQueue = QStringList() << filePath;
+    m_replaceModels = true;
+    startLoad();
+}
+
+void OpenGLScene::addModels()
+{
+    m_loadQueue += QFileDialog::getOpenFileNames(0, tr("Add models"), QString(),
+                                                 QLatin1String("*.obj *.stl *.gcode *.bgcode *.gz *.zst"));
+    startLoad();
+}
+
+// the models are loaded one after the other, each one is added when uploaded
+void OpenGLScene::startLoad()
+{
+    if (m_loadQueue.isEmpty())
+        return;
+#ifndef QT_NO_CONCURRENT
+    if (m_modelLoader.isRunning() || m_compareLoader.isRunning())
+        return;
+#endif
+    const QString filePath = m_loadQueue.takeFirst();
+    const qint64 memoryLimit = remainingBudget();
+
     m_modelButton->setEnabled(false);
+    m_addButton->setEnabled(false);
     QApplication::setOverrideCursor(Qt::BusyCursor);
 #ifndef QT_NO_CONCURRENT
-    m_modelLoader.setFuture(QtConcurrent::run(::loadModel, filePath));
+    m_loadProgress->setValue(0);
+    m_loadStatus->setText(QFileInfo(filePath).fileName());
+    m_loadWidget->show();
+    m_modelLoader.setFuture(ModelLoadTask::start(filePath, m_meshOptimization, m_compactVertices, memoryLimit));
 #else
-    setModel(::loadModel(filePath));
+    Model *model = ::loadModel(filePath, m_meshOptimization, m_compactVertices, 0, memoryLimit);
+    m_pendingModels.push_back(model);
+    requestUpload(model);
     modelLoaded();
 #endif
 }
 
+// What the loaded models leave of the budget as a memoryLimit, models to be replaced still
+// count. 0 without a budget.
+qint64 OpenGLScene::remainingBudget() const
+{
+    if (m_memoryBudget <= 0)
+        return 0;
+    qint64 used = 0;
+    foreach (const Model *model, m_models + m_pendingModels)
+        used += model->memoryBytes();
+    return qMax(m_memoryBudget - used, qint64(1));
+}
+
+void OpenGLScene::removeModel()
+{
+    if (!m_model)
+        return;
+    deleteModel(m_model);
+    updateModelList();
+}
+
+void OpenGLScene::selectModel(int index)
+{
+    m_model = index >= 0 && index < m_models.size() ? m_models.at(index) : 0;
+    showModel();
+}
+
+void OpenGLScene::addModel(Model *model)
+{
+    if (m_replaceModels) {
+        m_replaceModels = false;
+        while (!m_models.isEmpty())
+            deleteModel(m_models.last());
+    }
+    m_models.push_back(model);
+    m_model = model;
+    updateModelList();
+}
+
+// its uploads still on the way are dropped when they arrive
+void OpenGLScene::deleteModel(Model *model)
+{
+#ifndef QT_NO_CONCURRENT
+    if (model == m_compareTarget) {   // comparisonLoaded() drops the result then
+        m_compareLoader.cancel();
+        m_compareLoader.waitForFinished();
+        m_compareTarget = 0;
+    }
+#endif
+    m_models.removeOne(model);
+    m_pendingModels.removeOne(model);
+    m_uploadRequests.removeOne(model);
+    m_uploadTickets.remove(model);
+    for (QHash<int, SceneUpload>::iterator it = m_uploads.begin(); it != m_uploads.end(); ++it) {
+        if (it.value().model == model)
+            it.value().model = 0;
+    }
+    if (m_model == model)
+        m_model = 0;
+    delete model;
+}
+
+// lists the models by file name, keeps m_model selected (or the last one)
+void OpenGLScene::updateModelList()
+{
+    if (!m_models.contains(m_model))
+        m_model = m_models.isEmpty() ? 0 : m_models.last();
+    m_modelList->blockSignals(true);
+    m_modelList->clear();
+    foreach (Model *model, m_models)
+        m_modelList->addItem(model->fileName());
+    m_modelList->setCurrentIndex(m_models.indexOf(m_model));
+    m_modelList->blockSignals(false);
+    showModel();
+}
+
+// Shows the outlines of a mesh cut at the g-code layers, the mesh itself is not kept.
+void OpenGLScene::compareWithMesh()
+{
+    compareWith(QFileDialog::getOpenFileName(0, tr("Choose mesh"), QString(),
+                                             QLatin1String("*.obj *.stl *.gz *.zst")));
+}
+
+// Colors the cells another toolpath extrudes in addition (green) or leaves out (red).
+void OpenGLScene::compareWithGCode()
+{
+    compareWith(QFileDialog::getOpenFileName(0, tr("Choose G-code"), QString(),
+                                             QLatin1String("*.gcode *.bgcode *.gz *.zst")));
+}
+
+// Loads filePath beside the selected toolpath like startLoad() does a model, see comparisonLoaded().
+void OpenGLScene::compareWith(const QString &filePath)
+{
+    if (filePath.isEmpty() || !m_model || m_model->gcodeLayerCount() == 0)
+        return;
+#ifndef QT_NO_CONCURRENT
+    if (m_modelLoader.isRunning() || m_compareLoader.isRunning())
+        return;
+#endif
+    m_compareTarget = m_model;
+    QApplication::setOverrideCursor(Qt::BusyCursor);
+#ifndef QT_NO_CONCURRENT
+    m_loadProgress->setValue(0);
+    m_loadStatus->setText(QFileInfo(filePath).fileName());
+    m_loadWidget->show();
+    m_compareLoader.setFuture(ModelLoadTask::start(filePath, false, false, remainingBudget(), m_compareTarget));
+#else
+    applyComparison(::loadComparison(filePath, m_compareTarget, 0, remainingBudget()));
+#endif
+}
+
+// The first overlay rasterizes all layers, later ones only query the maps.
+void OpenGLScene::setOccupancyOverlay(int index)
+{
+    m_occupancyLabel->clear();
+    if (!m_model || m_model->gcodeLayerCount() == 0)
+        return;
+    QApplication::setOverrideCursor(Qt::BusyCursor);
+    const int cells = m_model->setGCodeOccupancyOverlay(index - 1);
+    QApplication::restoreOverrideCursor();
+    if (index > 0) {
+        const float cellSize = m_model->gcodeOccupancyCellSize();
+        m_occupancyLabel->setText(tr("%0 cells, %1 mm\u00b2").arg(cells).arg(cells * cellSize * cellSize, 0, 'f', 1));
+    }
+    updateMemoryLabel();
+    update();
+}
+
+// Timing costs a flag test per scope while the profiler is off.
+void OpenGLScene::enableProfiler(bool enabled)
+{
+    Profiler::instance().setEnabled(enabled);
+    m_profileItem->setVisible(enabled);
+    update();
+}
+
+void OpenGLScene::exportTrace()
+{
+    const QString filePath = QFileDialog::getSaveFileName(0, tr("Export trace"), QLatin1String("trace.json"),
+                                                          QLatin1String("*.json"));
+    if (filePath.isEmpty())
+        return;
+    if (!Profiler::instance().exportTrace(filePath))
+        qWarning() << Q_FUNC_INFO << "cannot write" << filePath;
+}
+
+void OpenGLScene::resetProfiler()
+{
+    Profiler::instance().clear();
+    m_profileLabel->clear();
+}
+
 void OpenGLScene::modelLoaded()
 {
 #ifndef QT_NO_CONCURRENT
-    setModel(m_modelLoader.result());
+    m_loadWidget->hide();
+    Model *model = m_modelLoader.future().resultCount() ? m_modelLoader.result() : 0;
+    if (m_modelLoader.isCanceled()) {
+        delete model;
+        model = 0;
+        m_loadQueue.clear();
+        if (m_pendingModels.isEmpty())
+            m_replaceModels = false;
+    }
+    if (model) {
+        // the current models stay on screen until the new one is on the GPU
+        m_pendingModels.push_back(model);
+        requestUpload(model);
+    }
 #endif
     m_modelButton->setEnabled(true);
+    m_addButton->setEnabled(true);
     QApplication::restoreOverrideCursor();
+    startLoad();
+}
+
+void OpenGLScene::comparisonLoaded()
+{
+#ifndef QT_NO_CONCURRENT
+    m_loadWidget->hide();
+    Model *other = m_compareLoader.future().resultCount() ? m_compareLoader.result() : 0;
+    if (m_compareLoader.isCanceled()) {
+        delete other;
+        other = 0;
+    }
+    applyComparison(other);
+#endif
+}
+
+// applies what other compared with m_compareTarget (unless that got deleted) and frees it
+void OpenGLScene::applyComparison(Model *other)
+{
+    if (other && m_compareTarget && !other->hasComparison()) {
+        m_diffLabel->setText(tr("%0 not compared, see the log").arg(other->fileName()));
+    } else if (other && m_compareTarget) {
+        if (other->gcodeLayerCount() == 0) {
+            const int outlines = m_compareTarget->setGCodeReference(*other);
+            qDebug() << Q_FUNC_INFO << other->fileName() << outlines << "outlines";
+        } else {
+            QVector<GCodeLayerDiff> layers;
+            const int changed = m_compareTarget->diffGCode(*other, layers);
+            float added = 0, removed = 0, time = 0, otherTime = 0;
+            for (int i = 0; i < layers.size(); ++i) {
+                const GCodeLayerDiff &diff = layers.at(i);
+                added += diff.added * diff.cellSize * diff.cellSize;
+                removed += diff.removed * diff.cellSize * diff.cellSize;
+                time += diff.time;
+                otherTime += diff.otherTime;
+            }
+            m_diffLabel->setText(tr("Changed layers: %0 of %1, +%2 / -%3 mm\u00b2, time %4 -> %5 s")
+                                 .arg(changed).arg(layers.size()).arg(added, 0, 'f', 0).arg(removed, 0, 'f', 0)
+                                 .arg(time, 0, 'f', 0).arg(otherTime, 0, 'f', 0));
+        }
+    }
+    delete other;
+    m_compareTarget = 0;
+    QApplication::restoreOverrideCursor();
+    updateMemoryLabel();
+    update();
+    startLoad();
+}
+
+void OpenGLScene::modelUploaded(int ticket, const QVector<GpuArray> &arrays)
+{
+    const SceneUpload upload = m_uploads.take(ticket);
+    Model *model = upload.model;
+    if (model && m_uploadTickets.value(model) == ticket) {
+        m_uploadTickets.remove(model);
+        if (arrays.isEmpty())
+            m_pool.free(upload.block);   // failed, drawn from client memory
+        else
+            model->setGpuBuffers(arrays, m_uploader, &m_pool, upload.block);
+        if (m_pendingModels.removeOne(model))
+            addModel(model);
+        update();
+    } else {
+        // superseded, the model was removed or moved again meanwhile
+        QVector<unsigned int> ids;
+        for (int i = 0; i < arrays.size(); ++i) {
+            if (arrays.at(i).buffer && !m_pool.owns(arrays.at(i).buffer))
+                ids.push_back(arrays.at(i).buffer);
+        }
+        if (!ids.isEmpty())
+            m_uploader->release(ids);
+        m_pool.free(upload.block);
+    }
 }
 
 void OpenGLScene::enableWireframe(bool enabled)
@@ -880,21 +1469,141 @@ void OpenGLScene::enableGCodeLines(bool enabled)
     update();
 }
 
-void OpenGLScene::setModel(Model *model)
+// applies to the models loaded from now on
+void OpenGLScene::setMemoryBudget(int megabytes)
 {
-    delete m_model;
-    m_model = model;
+    m_memoryBudget = qint64(megabytes) << 20;
+}
+
+// client side memory of the selected model by category, then of all of them and the GPU pool
+void OpenGLScene::updateMemoryLabel()
+{
+    if (!m_model) {
+        m_memoryLabel->clear();
+        return;
+    }
+    MemoryUsage usage;
+    m_model->memoryUsage(usage);
+    QString text = tr("Memory:");
+    for (int i = 0; i < usage.size(); ++i) {
+        if (usage.at(i).bytes > 0)
+            text += tr("\n  %0: %1 MB").arg(QLatin1String(usage.at(i).category))
+                    .arg(usage.at(i).bytes / 1048576.0, 0, 'f', 1);
+    }
+    qint64 all = 0;
+    foreach (const Model *model, m_models)
+        all += model->memoryBytes();
+    text += tr("\n  total: %0 MB, all models %1 MB").arg(totalBytes(usage) / 1048576.0, 0, 'f', 1)
+            .arg(all / 1048576.0, 0, 'f', 1);
+    text += tr("\n  GPU pool: %0 of %1 MB").arg(m_pool.usedBytes() / 1048576.0, 0, 'f', 1)
+            .arg(m_pool.capacityBytes() / 1048576.0, 0, 'f', 1);
+    if (m_model->gcodeTubesSkipped())
+        text += tr("\n  G-code drawn as lines, the tubes were over the budget");
+    m_memoryLabel->setText(text);
+}
+
+void OpenGLScene::enableMeshOptimization(bool enabled)
+{
+    m_meshOptimization = enabled;
+}
+
+// repacks all models right away, their buffers are uploaded again like after a transform.
+void OpenGLScene::enableCompactVertices(bool enabled)
+{
+    m_compactVertices = enabled;
+    foreach (Model *model, m_models) {
+        model->setCompactVertices(enabled);
+        requestUpload(model);
+    }
+    if (m_model) {
+        updateCompactLabel();
+        updateMemoryLabel();
+    }
+}
 
-    m_labels[0]->setText(tr("File:   %0").arg(m_model->fileName()));
+void OpenGLScene::updateCompactLabel()
+{
+    if (m_compactVertices) {
+        m_labels[6]->setText(tr("Compact error: %0 mm, %1 deg").arg(m_model->positionError(), 0, 'g', 3)
+                             .arg(m_model->normalError(), 0, 'f', 2));
+        qDebug() << Q_FUNC_INFO << "position error" << m_model->positionError()
+                 << "normal error" << m_model->normalError();
+    } else {
+        m_labels[6]->setText(tr("Compact error: -"));
+    }
+}
+
+// the labels and g-code controls of the selected model
+void OpenGLScene::showModel()
+{
+    if (!m_model) {
+        m_labels[0]->setText(tr("File:   -"));
+        for (int i = 1; i < 10; ++i)
+            m_labels[i]->clear();
+        m_diffLabel->clear();
+        m_occupancyLabel->clear();
+        m_memoryLabel->clear();
+        m_slider->setRange(0, 0);
+        update();
+        return;
+    }
+    if (m_models.size() > 1)
+        m_labels[0]->setText(tr("File:   %0 (%1 of %2)").arg(m_model->fileName())
+                             .arg(m_models.indexOf(m_model) + 1).arg(m_models.size()));
+    else
+        m_labels[0]->setText(tr("File:   %0").arg(m_model->fileName()));
     m_labels[1]->setText(tr("Points: %0").arg(m_model->points()));
-    m_labels[2]->setText(tr("Edges:  %0").arg(m_model->edges()));
-    m_labels[3]->setText(tr("Faces:  %0").arg(m_model->faces()));
+    const MeshStatistics &statistics = m_model->statistics();
+    m_labels[2]->setText(tr("Edges:  %0").arg(statistics.edges));
+    if (m_model->proxyFaces() > 0)
+        m_labels[3]->setText(tr("Faces:  %0 (%1 while moving)").arg(m_model->faces()).arg(m_model->proxyFaces()));
+    else
+        m_labels[3]->setText(tr("Faces:  %0").arg(m_model->faces()));
+    m_labels[4]->setText(tr("Picked: -"));
+    if (m_model->cacheMissRatio(true) > 0)
+        m_labels[5]->setText(tr("Cache misses per face: %0 -> %1").arg(m_model->cacheMissRatio(false), 0, 'f', 2)
+                             .arg(m_model->cacheMissRatio(true), 0, 'f', 2));
+    else
+        m_labels[5]->setText(tr("Cache misses per face: -"));
+    updateCompactLabel();
+    if (m_model->faces() > 0) {
+        m_labels[7]->setText(tr("Volume: %0 mm\u00b3, area: %1 mm\u00b2").arg(statistics.volume, 0, 'f', 2)
+                             .arg(statistics.area, 0, 'f', 2));
+        m_labels[8]->setText(tr("Center of mass: (%1, %2, %3)").arg(statistics.centerOfMass.x(), 0, 'f', 2)
+                             .arg(statistics.centerOfMass.y(), 0, 'f', 2).arg(statistics.centerOfMass.z(), 0, 'f', 2));
+        m_labels[9]->setText(tr("Open edges: %0, non-manifold: %1 (%2)").arg(statistics.openEdges)
+                             .arg(statistics.nonManifoldEdges)
+                             .arg(statistics.isWatertight() ? tr("watertight") : tr("not watertight")));
+    } else {
+        m_labels[7]->setText(tr("Volume: -"));
+        m_labels[8]->setText(tr("Center of mass: -"));
+        m_labels[9]->setText(tr("Open edges: -"));
+    }
 
     m_slider->setRange(0, m_model->gcodeCount());
+    m_slider->setValue(m_model->gcodeCount());
+    for (int i = 0; i < m_featureBoxes.size(); ++i) {
+        m_featureBoxes.at(i)->setEnabled(m_model->gcodeFeatureMoves(i) > 0);
+        m_model->setGCodeFeatureVisible(i, m_featureBoxes.at(i)->isChecked());
+    }
+    m_model->setGCodeColorMode(m_colorMode->currentIndex());
+    updateColorRange();
+    if (!m_model->hasGCodeDiff())
+        m_diffLabel->clear();
+    setOccupancyOverlay(m_occupancyMode->currentIndex());
     update();
 }
 
 
+// moved vertices are drawn from client memory until their new buffers arrive.
+void OpenGLScene::transformModel(const QMatrix4x4 &matrix)
+{
+    if (!m_model)
+        return;
+    m_model->transform(matrix);
+    requestUpload(m_model);
+}
+
 void OpenGLScene::setModelColor()
 {
     const QColor color = QColorDialog::getColor(m_modelColor);
@@ -920,9 +1629,12 @@ void OpenGLScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
         return;
 
     if (event->buttons() & Qt::LeftButton) {
+        m_interaction.start();
 #ifdef QUATERNION_CAMERA
         m_trackBall->push(pixelPosToViewPos(event->scenePos()), QQuaternion());
 #endif
+    } else if (event->buttons() & Qt::RightButton) {
+        pick(event->scenePos());
     }
     event->accept();
 }
@@ -934,6 +1646,7 @@ void OpenGLScene::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
         return;
 
     if (event->buttons() & Qt::LeftButton) {
+        m_interaction.start();
 #ifdef QUATERNION_CAMERA
         m_trackBall->move(pixelPosToViewPos(event->scenePos()), QQuaternion());
 #else
@@ -972,6 +1685,7 @@ void OpenGLScene::wheelEvent(QGraphicsSceneWheelEvent *event)
     if (event->isAccepted())
         return;
 
+    m_interaction.start();
 #ifdef QUATERNION_CAMERA
     m_distExp += event->delta();
     if (m_distExp < -8 * 120)
@@ -994,14 +1708,85 @@ QPointF OpenGLScene::pixelPosToViewPos(const QPointF& p)
                    1.0 - 2.0 * float(p.y()) / height());
 }
 
+QMatrix4x4 OpenGLScene::projectionMatrix() const
+{
+    QMatrix4x4 projection;
+    projection.perspective(70, width() / height(), 0.01, 1000);
+    return projection;
+}
+
+QMatrix4x4 OpenGLScene::viewMatrix() const
+{
+    QMatrix4x4 view;
+#ifdef QUATERNION_CAMERA
+    view.rotate(m_trackBall->rotation());
+    view(2, 3) -= 2.0f * exp(m_distExp / 1200.0f);
+#endif
+    return view;
+}
+
+// size of a pixel at the distance of the camera
+float OpenGLScene::pixelSize() const
+{
+#ifdef QUATERNION_CAMERA
+    const float distance = 2.0f * exp(m_distExp / 1200.0f);
+    return 2 * distance * tan(35 * DEG2RAD) / height();
+#else
+    return 0;
+#endif
+}
+
+// Casts a ray from the camera through scenePos, g-code moves are tried before the meshes.
+// The model hit gets selected.
+void OpenGLScene::pick(const QPointF &scenePos)
+{
+    if (m_models.isEmpty())
+        return;
+
+    const QPointF viewPos = pixelPosToViewPos(scenePos);
+    const QMatrix4x4 inverse = (projectionMatrix() * viewMatrix()).inverted();
+    const QVector3D nearPoint = inverse * QVector3D(viewPos.x(), viewPos.y(), -1);
+    const QVector3D farPoint  = inverse * QVector3D(viewPos.x(), viewPos.y(),  1);
+
+    const QVector3D direction = (farPoint - nearPoint).normalized();
+
+    foreach (Model *model, m_models) {
+        const int move = model->pickMove(nearPoint, direction, qMax(0.2f, 5 * pixelSize()));
+        if (move >= 0) {
+            m_modelList->setCurrentIndex(m_models.indexOf(model));
+            const GCodeLine &line = model->gcodeLine(move);
+            m_labels[4]->setText(tr("Picked: move %1, layer %2, line %3\n%4")
+                                 .arg(move).arg(line.layer).arg(line.lineNumber)
+                                 .arg(model->gcodeSourceLine(move)));
+            return;
+        }
+    }
+
+    Model *picked = 0;
+    QVector3D hit, nearest;
+    foreach (Model *model, m_models) {
+        if (model->pick(nearPoint, direction, hit)
+                && (!picked || (hit - nearPoint).lengthSquared() < (nearest - nearPoint).lengthSquared())) {
+            picked = model;
+            nearest = hit;
+        }
+    }
+    if (picked) {
+        m_modelList->setCurrentIndex(m_models.indexOf(picked));
+        m_labels[4]->setText(tr("Picked: (%1, %2, %3)").arg(nearest.x(), 0, 'f', 2).arg(nearest.y(), 0, 'f', 2)
+                             .arg(nearest.z(), 0, 'f', 2));
+    } else {
+        m_labels[4]->setText(tr("Picked: -"));
+    }
+}
+
 
 void OpenGLScene::translateX(int value)
 {
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.translate(value, 0, 0);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 void OpenGLScene::translateY(int value)
@@ -1009,8 +1794,7 @@ void OpenGLScene::translateY(int value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.translate(0, value, 0);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 void OpenGLScene::translateZ(int value)
@@ -1018,8 +1802,7 @@ void OpenGLScene::translateZ(int value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.translate(0, 0, value);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 void OpenGLScene::rotateX(int value)
@@ -1027,8 +1810,7 @@ void OpenGLScene::rotateX(int value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.rotate(value, 1, 0, 0);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 void OpenGLScene::rotateY(int value)
@@ -1036,8 +1818,7 @@ void OpenGLScene::rotateY(int value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.rotate(value, 0, 1, 0);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 void OpenGLScene::rotateZ(int value)
@@ -1045,8 +1826,7 @@ void OpenGLScene::rotateZ(int value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.rotate(value, 0, 0, 1);
-    m_model->transform(m);
-    update();
+    transformModel(m);
 }
 
 
@@ -1055,14 +1835,56 @@ void OpenGLScene::scale(double value)
     qDebug() << Q_FUNC_INFO << value;
     QMatrix4x4 m;
     m.scale(value, value, value);
-    m_model->transform(m);
+    transformModel(m);
+}
+
+
+void OpenGLScene::enableFeature(bool enabled)
+{
+    if (!m_model)
+        return;
+    m_model->setGCodeFeatureVisible(sender()->property("feature").toInt(), enabled);
     update();
 }
 
+void OpenGLScene::setColorMode(int mode)
+{
+    if (!m_model)
+        return;
+    m_model->setGCodeColorMode(mode);
+    updateColorRange();
+    update();
+}
+
+void OpenGLScene::setColorRange()
+{
+    if (!m_model)
+        return;
+    m_model->setGCodeColorRange(m_colorMin->value(), m_colorMax->value());
+    update();
+}
+
+// shows the range picked by the model for the current color mode
+void OpenGLScene::updateColorRange()
+{
+    float min, max;
+    m_model->gcodeColorRange(min, max);
+    const bool heatmap = m_colorMode->currentIndex() != 0;
+    foreach (QDoubleSpinBox *spinBox, QList<QDoubleSpinBox *>() << m_colorMin << m_colorMax) {
+        spinBox->blockSignals(true);
+        spinBox->setEnabled(heatmap);
+    }
+    m_colorMin->setValue(min);
+    m_colorMax->setValue(max);
+    m_colorMin->blockSignals(false);
+    m_colorMax->blockSignals(false);
+}
 
 void OpenGLScene::gcodeLayers(int layers)
 {
 //    qDebug() << Q_FUNC_INFO << layers;
+    if (!m_model)
+        return;
     m_model->setGCodeLayers(layers);
     update();
 }
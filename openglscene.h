@@ -16,6 +16,8 @@
 #define OPENGLSCENE_H
 
 #include "point3d.h"
+#include "gpubuffers.h"
+#include "gpupool.h"
 
 #include <QGraphicsScene>
 #include <QLabel>
@@ -23,6 +25,8 @@
 #include <QtGui/QMatrix4x4>
 #include <QtGui/QQuaternion>
 #include <QPointF>
+#include <QHash>
+#include <QStringList>
 #include <QTime>
 #include <QGLShaderProgram>
 
@@ -39,8 +43,23 @@ class Model;
 class TrackBall;
 class QHBoxLayout;
 class QSlider;
+class QCheckBox;
+class QComboBox;
+class QDoubleSpinBox;
+class QProgressBar;
+class QGraphicsProxyWidget;
 QT_END_NAMESPACE
 
+class GpuUploader;
+
+// an upload on its way, see OpenGLScene::flushUploads()
+struct SceneUpload
+{
+    SceneUpload() : model(0) {}
+    Model *model;          // 0 once the model is gone
+    GpuPoolBlock block;    // where its mesh goes, if pooled
+};
+
 class OpenGLScene : public QGraphicsScene
 {
     Q_OBJECT
@@ -56,11 +75,19 @@ public slots:
     void enableNormals(bool enabled);
     void enableGCodeMotion(bool enabled);
     void enableGCodeLines(bool enabled);
+    void enableMeshOptimization(bool enabled);
+    void enableCompactVertices(bool enabled);
+    void setMemoryBudget(int megabytes);
     void setModelColor();
     void setBackgroundColor();
     void loadModel();
     void loadModel(const QString &filePath);
+    void addModels();
+    void removeModel();
+    void selectModel(int index);
     void modelLoaded();
+    void comparisonLoaded();
+    void modelUploaded(int ticket, const QVector<GpuArray> &arrays);
     //model control slots
     void translateX(int value);
     void translateY(int value);
@@ -70,6 +97,15 @@ public slots:
     void rotateZ(int value);
     void scale(double value);
     void gcodeLayers(int layers);
+    void enableFeature(bool enabled);
+    void setColorMode(int mode);
+    void setColorRange();
+    void compareWithMesh();
+    void compareWithGCode();
+    void setOccupancyOverlay(int index);
+    void enableProfiler(bool enabled);
+    void exportTrace();
+    void resetProfiler();
 
 protected:
     void mousePressEvent(QGraphicsSceneMouseEvent *event);
@@ -82,26 +118,68 @@ private:
     QSlider *createSlider(int rangeMax, const char *setterSlot);
     QHBoxLayout * createSpinBox(QString label, int rangeFrom, int rangeTo, const char *member);
     QHBoxLayout * createDoubleSpinBox(QString label, double rangeFrom, double rangeTo, double singleStep, const char *member);
-    void setModel(Model *model);
+    void startLoad();
+    qint64 remainingBudget() const;
+    void compareWith(const QString &filePath);
+    void applyComparison(Model *other);
+    void addModel(Model *model);
+    void deleteModel(Model *model);
+    void updateModelList();
+    void showModel();
+    void requestUpload(Model *model);
+    void flushUploads();
+    void drawModels();
+    void updateCompactLabel();
+    void updateMemoryLabel();
+    void transformModel(const QMatrix4x4 &matrix);
+    void updateColorRange();
 
     bool m_wireframeEnabled;
     bool m_normalsEnabled;
     bool m_gcodeMotionEnabled;
     bool m_gcodeLinesEnabled;
+    bool m_meshOptimization;     // of the models loaded from now on
+    bool m_compactVertices;      // 16 bit positions and byte normals in the buffers
+    qint64 m_memoryBudget;       // bytes for all models, loads leave steps out to stay within, 0 for none
 
     QColor m_modelColor;
     QColor m_backgroundColor;
 
-    Model *m_model;
-
-    QLabel *m_labels[4];
+    QVector<Model *> m_models;
+    Model *m_model;                      // selected, the controls act on it
+    Model *m_compareTarget;              // what the running comparison is for, see compareWith()
+    QVector<Model *> m_pendingModels;    // loaded, added once their buffers are uploaded
+    QStringList m_loadQueue;
+    bool m_replaceModels;                // the next model added replaces the others
+    GpuUploader *m_uploader;             // made with the first frame, it shares our context
+    GpuPool m_pool;                      // the float meshes of all models
+    QVector<Model *> m_uploadRequests;   // queued with the next frame, pool pages need our context
+    QHash<int, SceneUpload> m_uploads;   // by ticket
+    QHash<Model *, int> m_uploadTickets; // latest ticket of each model, older ones are superseded
+    QVector<QVector<QPair<int, int> > > m_poolRanges;   // by pool page, see drawModels()
+
+    QLabel *m_labels[10];
+    QLabel *m_memoryLabel;
     QSlider * m_slider;
+    QVector<QCheckBox *> m_featureBoxes;
+    QComboBox *m_colorMode;
+    QDoubleSpinBox *m_colorMin;
+    QDoubleSpinBox *m_colorMax;
+    QLabel *m_diffLabel;
+    QComboBox *m_occupancyMode;
+    QLabel *m_occupancyLabel;
     QWidget *m_modelButton;
+    QWidget *m_addButton;
+    QComboBox *m_modelList;
 
     QGraphicsRectItem *m_lightItem;
 
 #ifndef QT_NO_CONCURRENT
     QFutureWatcher<Model *> m_modelLoader;
+    QFutureWatcher<Model *> m_compareLoader;   // see compareWith(), shares the progress widget
+    QWidget *m_loadWidget;        // progress and cancel button, shown while loading
+    QProgressBar *m_loadProgress;
+    QLabel *m_loadStatus;
 #endif
 
     //======= added ==========
@@ -122,6 +200,11 @@ private:
     float m_cameraAngleY;
     float m_cameraDistance;
 #endif
+    QTime m_interaction;     // since the last mouse input, the model draws its proxy for a while
+
+    QGraphicsProxyWidget *m_profileItem;   // timings of the frames and loads, see Profiler
+    QLabel *m_profileLabel;
+    QTime m_profileRefresh;
 
     void initGL();
     void initLights();
@@ -131,6 +214,10 @@ private:
     void generateTube(QVector3D p1, QVector3D p2, QVector3D p3, float radius = 2, bool saveRearVector = false);
     void drawTube(/*QVector3D p1, QVector3D p2, float radius*/);
     QPointF pixelPosToViewPos(const QPointF& p);
+    QMatrix4x4 projectionMatrix() const;
+    QMatrix4x4 viewMatrix() const;
+    float pixelSize() const;
+    void pick(const QPointF &scenePos);
 
     // Test
     GLuint vboId;
@@ -2,7 +2,7 @@
 # Automatically generated by qmake (2.01a) Thu Jun 19 18:52:29 2008
 ######################################################################
 
-QT += opengl widgets core
+QT += opengl widgets core concurrent
 CONFIG  += c++11
 
 TEMPLATE = app
@@ -12,17 +12,71 @@ INCLUDEPATH += .
 
 # Input
 HEADERS += openglscene.h point3d.h model.h \
+    bvh.h \
+    decompressdevice.h \
+    frustum.h \
+    gpubuffers.h \
+    gpuuploader.h \
+    gpupool.h \
+    loadprogress.h \
+    meshoptimizer.h \
+    compactvertices.h \
+    decimate.h \
+    meshstats.h \
+    meshslicer.h \
+    profiler.h \
+    memoryusage.h \
+    modelformat.h \
+    parsenumber.h \
+    thumbnailer.h \
     trackball.h \
     gcode/gcode.h \
+    gcode/bgcode.h \
+    gcode/arc.h \
+    gcode/simplify.h \
+    gcode/segmentgrid.h \
+    gcode/feature.h \
+    gcode/gcodediff.h \
+    gcode/occupancy.h \
 #    gcode/gcoder.h \
 #    gcode/command.h
 
 SOURCES += main.cpp model.cpp openglscene.cpp \
+    bvh.cpp \
+    decompressdevice.cpp \
+    gpubuffers.cpp \
+    gpuuploader.cpp \
+    gpupool.cpp \
+    loadprogress.cpp \
+    meshoptimizer.cpp \
+    compactvertices.cpp \
+    decimate.cpp \
+    meshstats.cpp \
+    meshslicer.cpp \
+    profiler.cpp \
+    memoryusage.cpp \
+    modelformat.cpp \
+    parsenumber.cpp \
+    thumbnailer.cpp \
     trackball.cpp \
     gcode/gcode.cpp \
+    gcode/bgcode.cpp \
+    gcode/arc.cpp \
+    gcode/simplify.cpp \
+    gcode/segmentgrid.cpp \
+    gcode/feature.cpp \
+    gcode/gcodediff.cpp \
+    gcode/occupancy.cpp \
 #    gcode/gcoder.cpp \
 #    gcode/command.cpp
 
+# compressed input: gzip always, zstd when the library is there
+LIBS += -lz
+packagesExist(libzstd) {
+    DEFINES += HAVE_ZSTD
+    LIBS += -lzstd
+}
+
 win32 {
     #glew
     INCLUDEPATH +="D:/Qt/glew-1.11.0/include"
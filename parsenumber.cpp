@@ -0,0 +1,173 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "parsenumber.h"
+
+#include <cfloat>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+
+// all of them are exact
+static const float FLOAT_POWERS_OF_TEN[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+static const double DOUBLE_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const int MAX_DIGITS = 19;   // that still fit into the 64 bit mantissa
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// true if d lies exactly halfway between two floats, rounding it to float again could
+// then go the wrong way. Anywhere else the nearest double rounds to the nearest float.
+static bool isFloatMidpoint(double d)
+{
+    unsigned long long bits;
+    memcpy(&bits, &d, sizeof(bits));
+    const unsigned long long low = bits & ((1ull << 29) - 1);   // 53 - 24 bits float doesn't keep
+    return low == (1ull << 28);
+}
+
+// exact but slow, for what the fast paths can't do (long mantissas, large exponents).
+static float parseFloatSlow(const char *begin, const char *end)
+{
+    std::istringstream stream(std::string(begin, end));
+    stream.imbue(std::locale::classic());
+    float value = 0;
+    stream >> value;
+    // the stream gives the largest float for an overflow, strtof infinity
+    if (stream.fail() && (value == FLT_MAX || value == -FLT_MAX))
+        value = value > 0 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+    return value;
+}
+
+const char *parseFloat(const char *begin, const char *end, float &value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    // up to MAX_DIGITS significant digits, value = mantissa * 10^exponent
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    bool truncated = false;
+    for (; p != end && isDigit(*p); ++p) {
+        any = true;
+        if (digits < MAX_DIGITS) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                ++digits;
+        } else {
+            ++exponent;
+            truncated |= *p != '0';
+        }
+    }
+    if (p != end && *p == '.') {
+        ++p;
+        for (; p != end && isDigit(*p); ++p) {
+            any = true;
+            if (digits < MAX_DIGITS) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    if (!any) {
+        value = 0;
+        return begin;
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q != end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            ++q;
+        }
+        if (q != end && isDigit(*q)) {
+            int e = 0;
+            for (; q != end && isDigit(*q); ++q) {
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    if (mantissa == 0) {
+        value = negative ? -0.f : 0.f;
+        return p;
+    }
+    if (!truncated) {
+        // Clinger's fast path: both operands exact, one correctly rounded operation.
+        if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+            const float f = exponent < 0 ? float(mantissa) / FLOAT_POWERS_OF_TEN[-exponent]
+                                         : float(mantissa) * FLOAT_POWERS_OF_TEN[exponent];
+            value = negative ? -f : f;
+            return p;
+        }
+        // the same in double, then once more to float
+        if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+            const double d = exponent < 0 ? double(mantissa) / DOUBLE_POWERS_OF_TEN[-exponent]
+                                          : double(mantissa) * DOUBLE_POWERS_OF_TEN[exponent];
+            if (d >= FLT_MIN && d <= FLT_MAX && !isFloatMidpoint(d)) {
+                value = float(negative ? -d : d);
+                return p;
+            }
+        }
+    }
+    value = parseFloatSlow(begin, p);
+    return p;
+}
+
+const char *parseInt(const char *begin, const char *end, int &value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p == end || !isDigit(*p)) {
+        value = 0;
+        return begin;
+    }
+    long long result = 0;
+    for (; p != end && isDigit(*p); ++p) {
+        if (result <= 0x7fffffffLL)
+            result = result * 10 + (*p - '0');
+    }
+    if (result > 0x7fffffffLL)
+        result = 0x7fffffffLL;
+    value = int(negative ? -result : result);
+    return p;
+}
@@ -0,0 +1,52 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef PARSENUMBER_H
+#define PARSENUMBER_H
+
+//! Number parsing shared by the loaders. Independent of the locale (QApplication sets
+//! the user's on Unix, atof then stops at the '.' in German or French ones) and much
+//! faster than atof, QTextStream or QString::toFloat on the short fixed point numbers
+//! slicers and mesh exporters write.
+//!
+//! Both parse [+-]digits[.digits][(e|E)[+-]digits] from begin and return the end of the
+//! number, or begin (and 0) if there is none. Leading whitespace is not skipped.
+
+// correctly rounded like strtof in the C locale, out of range too: +-inf past the largest
+// float, denormals or (signed) 0 below the smallest
+const char *parseFloat(const char *begin, const char *end, float &value);
+const char *parseInt(const char *begin, const char *end, int &value);
+
+// words of a line, in place over the text the loaders read
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline const char *skipSpaces(const char *at, const char *end)
+{
+    while (at != end && isSpace(*at))
+        ++at;
+    return at;
+}
+
+inline const char *skipWord(const char *at, const char *end)
+{
+    while (at != end && !isSpace(*at))
+        ++at;
+    return at;
+}
+
+#endif // PARSENUMBER_H
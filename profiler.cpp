@@ -0,0 +1,225 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "profiler.h"
+
+#include <QFile>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+QAtomicInt Profiler::s_enabled;
+
+namespace {
+
+struct StatSlower
+{
+    bool operator()(const ProfileStat &a, const ProfileStat &b) const { return a.total > b.total; }
+};
+
+double toMs(qint64 ns)
+{
+    return ns / 1e6;
+}
+
+// names are literals, quotes and backslashes are all JSON needs escaped
+QByteArray jsonString(const char *text)
+{
+    QByteArray string("\"");
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            string += '\\';
+        string += *c;
+    }
+    return string + '"';
+}
+
+} // namespace
+
+Profiler::Profiler()
+    : m_frameBegin(-1)
+    , m_frameCount(0)
+{
+    m_clock.start();
+}
+
+Profiler &Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled);
+    if (!enabled)
+        m_frameBegin = -1;
+}
+
+// under m_mutex
+int Profiler::threadNumber()
+{
+    const quintptr id = quintptr(QThread::currentThreadId());
+    QHash<quintptr, int>::const_iterator thread = m_threads.constFind(id);
+    if (thread != m_threads.constEnd())
+        return thread.value();
+    const int number = m_threads.size();
+    m_threads.insert(id, number);
+    return number;
+}
+
+void Profiler::record(const char *name, qint64 begin, qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+    if (int(m_events.size()) < PROFILE_MAX_EVENTS) {
+        const ProfileEvent event = { name, begin, end - begin, threadNumber() };
+        m_events.push_back(event);
+    }
+
+    int index = m_statIndex.value(name, -1);
+    if (index < 0) {
+        index = m_stats.size();
+        m_statIndex.insert(name, index);
+        m_stats.push_back(ProfileStat());
+        m_stats.last().name = name;
+    }
+    ProfileStat &stat = m_stats[index];
+    ++stat.count;
+    stat.total += end - begin;
+    stat.max = qMax(stat.max, end - begin);
+    stat.last = end - begin;
+    stat.frame += end - begin;
+}
+
+void Profiler::beginFrame()
+{
+    if (isEnabled())
+        m_frameBegin = now();
+}
+
+void Profiler::endFrame()
+{
+    if (!isEnabled() || m_frameBegin < 0)
+        return;
+    const qint64 end = now();
+    record("frame", m_frameBegin, end);
+
+    QMutexLocker locker(&m_mutex);
+    if (m_frames.size() < PROFILE_FRAME_HISTORY)
+        m_frames.push_back(end - m_frameBegin);
+    else
+        m_frames[m_frameCount % PROFILE_FRAME_HISTORY] = end - m_frameBegin;
+    ++m_frameCount;
+    for (int i = 0; i < m_stats.size(); ++i) {
+        m_stats[i].lastFrame = m_stats.at(i).frame;
+        m_stats[i].frame = 0;
+    }
+    m_frameBegin = -1;
+}
+
+double Profiler::frameMs() const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_frames.isEmpty())
+        return 0;
+    return toMs(m_frames.at((m_frameCount - 1) % PROFILE_FRAME_HISTORY));
+}
+
+double Profiler::averageFrameMs() const
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 total = 0;
+    for (int i = 0; i < m_frames.size(); ++i)
+        total += m_frames.at(i);
+    return m_frames.isEmpty() ? 0 : toMs(total) / m_frames.size();
+}
+
+QVector<ProfileStat> Profiler::statistics() const
+{
+    QVector<ProfileStat> stats;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < m_stats.size(); ++i) {
+            const ProfileStat &stat = m_stats.at(i);
+            int same = 0;
+            while (same < stats.size() && strcmp(stats.at(same).name, stat.name) != 0)
+                ++same;
+            if (same == stats.size()) {
+                stats.push_back(stat);
+                continue;
+            }
+            ProfileStat &merged = stats[same];
+            merged.count += stat.count;
+            merged.total += stat.total;
+            merged.max = qMax(merged.max, stat.max);
+            merged.last = stat.last;
+            merged.frame += stat.frame;
+            merged.lastFrame += stat.lastFrame;
+        }
+    }
+    std::stable_sort(stats.begin(), stats.end(), StatSlower());
+    return stats;
+}
+
+QString Profiler::summary(int lines) const
+{
+    QString text = QString("frame %1 ms, average %2 ms\n").arg(frameMs(), 0, 'f', 2).arg(averageFrameMs(), 0, 'f', 2);
+    text += QString("%1 %2 %3 %4 %5\n").arg("", -22).arg("last", 9).arg("frame", 9).arg("max", 9).arg("count", 8);
+    const QVector<ProfileStat> stats = statistics();
+    for (int i = 0; i < stats.size() && i < lines; ++i) {
+        const ProfileStat &stat = stats.at(i);
+        text += QString("%1 %2 %3 %4 %5\n").arg(QString(stat.name).left(22), -22)
+                .arg(toMs(stat.last), 9, 'f', 2).arg(toMs(stat.lastFrame), 9, 'f', 2)
+                .arg(toMs(stat.max), 9, 'f', 2).arg(stat.count, 8);
+    }
+    return text;
+}
+
+// Complete ("X") events in microseconds, one track per thread.
+bool Profiler::exportTrace(const QString &fileName) const
+{
+    std::vector<ProfileEvent> events;
+    {
+        QMutexLocker locker(&m_mutex);
+        events = m_events;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < events.size(); ++i) {
+        const ProfileEvent &event = events[i];
+        json += "{\"name\":" + jsonString(event.name) + ",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                + QByteArray::number(event.thread) + ",\"ts\":" + QByteArray::number(event.begin / 1e3, 'f', 3)
+                + ",\"dur\":" + QByteArray::number(event.duration / 1e3, 'f', 3) + "}";
+        json += i + 1 < events.size() ? ",\n" : "\n";
+        if (json.size() > (1 << 20)) {
+            file.write(json);
+            json.clear();
+        }
+    }
+    json += "]}\n";
+    return file.write(json) == json.size();
+}
+
+void Profiler::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_events.clear();
+    m_stats.clear();
+    m_statIndex.clear();
+    m_frames.clear();
+    m_frameCount = 0;
+}
@@ -0,0 +1,118 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <vector>
+
+// events kept for the trace, later ones only go into the statistics
+const int PROFILE_MAX_EVENTS    = 1 << 20;
+// frames the average frame time is taken over
+const int PROFILE_FRAME_HISTORY = 120;
+
+// one timed scope, times in ns since the profiler was made
+struct ProfileEvent
+{
+    const char *name;   // a string literal, see ProfileScope
+    qint64 begin;
+    qint64 duration;
+    int thread;         // numbered in order of appearance
+};
+
+// the scopes of one name, ns
+struct ProfileStat
+{
+    ProfileStat() : name(0), count(0), total(0), max(0), last(0), frame(0), lastFrame(0) {}
+    const char *name;
+    int    count;
+    qint64 total;
+    qint64 max;
+    qint64 last;        // the latest one, for the load phases
+    qint64 frame;       // sum within the current frame
+    qint64 lastFrame;   // sum within the last complete frame
+};
+
+//! ============= Profiler ===============
+//! Collects the ProfileScope timings of all threads while enabled. Disabled, a scope costs
+//! one relaxed load of a flag. The scopes are summed up by name, overall and per frame
+//! (between beginFrame() and endFrame()), and the events export as a Chrome trace that
+//! chrome://tracing and Perfetto open.
+class Profiler
+{
+public:
+    static Profiler &instance();
+    static bool isEnabled() { return s_enabled.load() != 0; }
+    void   setEnabled(bool enabled);
+
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    void   record(const char *name, qint64 begin, qint64 end);
+
+    // GUI thread, around the drawing of the scene
+    void   beginFrame();
+    void   endFrame();
+    double frameMs() const;          // the last complete frame
+    double averageFrameMs() const;   // over PROFILE_FRAME_HISTORY frames
+
+    // by name, the slowest first
+    QVector<ProfileStat> statistics() const;
+    // a line per name, for the overlay
+    QString summary(int lines) const;
+    bool   exportTrace(const QString &fileName) const;
+    void   clear();
+
+private:
+    Profiler();
+    int threadNumber();
+
+    static QAtomicInt s_enabled;
+    QElapsedTimer m_clock;
+    mutable QMutex m_mutex;
+    std::vector<ProfileEvent> m_events;
+    QVector<ProfileStat> m_stats;
+    QHash<const char *, int> m_statIndex;   // by name pointer, names alike are merged in statistics()
+    QHash<quintptr, int> m_threads;
+    qint64 m_frameBegin;
+    QVector<qint64> m_frames;               // ring of the last frame times
+    int    m_frameCount;
+};
+
+//! Times its own lifetime into the Profiler, use PROFILE_SCOPE("name").
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name)
+        : m_name(name), m_begin(Profiler::isEnabled() ? Profiler::instance().now() : -1) {}
+    ~ProfileScope() {
+        if (m_begin >= 0)
+            Profiler::instance().record(m_name, m_begin, Profiler::instance().now());
+    }
+
+private:
+    const char *m_name;
+    qint64 m_begin;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+
+#endif // PROFILER_H
@@ -0,0 +1,41 @@
+######################################################################
+# Parses small G-code files without drawing them: qmake && make check,
+# or ./tst_gcode -help
+######################################################################
+
+QT += testlib opengl concurrent
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = tst_gcode
+INCLUDEPATH += ../.. ../../gcode
+
+HEADERS += ../../gcode/gcode.h \
+    ../../gpuuploader.h
+SOURCES += tst_gcode.cpp \
+    ../../gcode/gcode.cpp \
+    ../../gcode/bgcode.cpp \
+    ../../gcode/arc.cpp \
+    ../../gcode/simplify.cpp \
+    ../../gcode/segmentgrid.cpp \
+    ../../gcode/feature.cpp \
+    ../../gcode/gcodediff.cpp \
+    ../../gcode/occupancy.cpp \
+    ../../parsenumber.cpp \
+    ../../decompressdevice.cpp \
+    ../../loadprogress.cpp \
+    ../../gpubuffers.cpp \
+    ../../gpuuploader.cpp \
+    ../../compactvertices.cpp \
+    ../../memoryusage.cpp \
+    ../../profiler.cpp
+
+LIBS += -lz
+packagesExist(libzstd) {
+    DEFINES += HAVE_ZSTD
+    LIBS += -lzstd
+}
+linux {
+    LIBS += -lGL
+}
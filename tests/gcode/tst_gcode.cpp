@@ -0,0 +1,86 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include <QtTest>
+#include <QTemporaryFile>
+
+#include "gcode.h"
+
+//! Parses small G-code files the way a load does, without drawing anything.
+
+class TestGCode : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void arcAfterTravel();
+    void partialMoveKeepsPosition();
+
+private:
+    static bool parse(GCode &gcode, const char *text);
+};
+
+bool TestGCode::parse(GCode &gcode, const char *text)
+{
+    QTemporaryFile file;
+    if (!file.open())
+        return false;
+    file.write(text);
+    file.close();
+    return gcode.open(file.fileName().toStdString(), 0, 0, true) >= 0;
+}
+
+// G0 moves the head too, the arc has to start where the travel ended
+void TestGCode::arcAfterTravel()
+{
+    GCode gcode;
+    QVERIFY(parse(gcode,
+                  "G1 X0 Y0 Z0.2 F1200\n"
+                  "G1 X10 Y0 E1\n"
+                  "G0 X20 Y0\n"
+                  "G2 X30 Y0 I5 J0 E2\n"));
+    const vector<GCodeLine> &lines = gcode.getCodeLines();
+    QCOMPARE(int(lines.size()), 4);
+    QVERIFY(!lines[2].hasE);
+    QVERIFY(lines[3].isArc);
+
+    QVector<QVector3D> points;
+    gcode.arcChords(3, points);
+    QVERIFY(points.size() > 1);
+    const QVector3D center(25, 0, 0.2f);
+    for (int i = 0; i < points.size(); ++i)
+        QVERIFY(qAbs((points.at(i) - center).length() - 5) < 1e-3f);
+    QVERIFY((points.last() - QVector3D(30, 0, 0.2f)).length() < 1e-3f);
+}
+
+// omitted axes are where the last move left them
+void TestGCode::partialMoveKeepsPosition()
+{
+    GCode gcode;
+    QVERIFY(parse(gcode,
+                  "G1 X10 Y5 Z0.2\n"
+                  "G1 X20 E1\n"
+                  "G1 Y8 Z0.4 E2\n"));
+    const vector<GCodeLine> &lines = gcode.getCodeLines();
+    QCOMPARE(int(lines.size()), 3);
+    QCOMPARE(lines[1].x, 20.f);
+    QCOMPARE(lines[1].y, 5.f);
+    QCOMPARE(lines[2].x, 20.f);
+    QCOMPARE(lines[2].y, 8.f);
+    QCOMPARE(lines[2].z, 0.4f);
+}
+
+QTEST_APPLESS_MAIN(TestGCode)
+#include "tst_gcode.moc"
@@ -0,0 +1,17 @@
+######################################################################
+# Checks the number parsing of the loaders against the C library and
+# times it: qmake && make check, or ./tst_parsenumber -help
+######################################################################
+
+QT += testlib
+QT -= gui
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = tst_parsenumber
+INCLUDEPATH += ../..
+
+HEADERS += ../../parsenumber.h
+SOURCES += tst_parsenumber.cpp \
+    ../../parsenumber.cpp
@@ -0,0 +1,181 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include <QtTest>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "parsenumber.h"
+
+//! Checks parseFloat() and parseInt() against the C library and times them. The process
+//! keeps the C locale, strtof is the reference. Run a single benchmark again with e.g.
+//!     ./tst_parsenumber benchmarkParseFloat
+
+const int CHECK_NUMBERS = 4000000;
+const int BENCH_NUMBERS = 200000;
+
+// Numbers like slicers and exporters write: coordinates, extrusion, feedrates and a few
+// exponents. The checks add long mantissas, so the slow path is taken too.
+static std::string randomNumber(unsigned int &seed, bool longMantissas)
+{
+    seed = seed * 1103515245u + 12345u;
+    const unsigned int r = seed >> 8;
+    char buffer[64];
+    const char *sign = (r & 3) == 0 ? "-" : ((r & 31) == 1 ? "+" : "");
+    const unsigned int kind = (r >> 2) % (longMantissas ? 16 : 14);
+    seed = seed * 1103515245u + 12345u;
+    const unsigned int a = seed >> 4;
+    seed = seed * 1103515245u + 12345u;
+    const unsigned int b = seed >> 4;
+    if (kind < 10) {        // fixed point, 0 to 5 decimals
+        const int decimals = kind % 6;
+        snprintf(buffer, sizeof(buffer), "%s%u.%0*u", sign, a % 100000, decimals, b % 100000);
+        if (decimals == 0)
+            buffer[strlen(buffer) - 1] = 0;   // "12." is a number as well
+    } else if (kind < 12) { // integers
+        snprintf(buffer, sizeof(buffer), "%s%u", sign, a % 1000000);
+    } else if (kind < 14) { // exponents
+        snprintf(buffer, sizeof(buffer), "%s%u.%ue%d", sign, a % 1000, b % 1000, int(b % 61) - 30);
+    } else {                // long mantissas
+        snprintf(buffer, sizeof(buffer), "%s%u%u.%u%u", sign, a, b, b, a);
+    }
+    return std::string(buffer);
+}
+
+class TestParseNumber : public QObject
+{
+    Q_OBJECT
+
+private:
+    std::vector<std::string> m_numbers;   // for the benchmarks
+
+private slots:
+    void initTestCase();
+    void parseFloatMatchesStrtof();
+    void parseFloatCases_data();
+    void parseFloatCases();
+    void parseIntMatchesStrtol();
+    void benchmarkParseFloat();
+    void benchmarkStrtof();
+};
+
+void TestParseNumber::initTestCase()
+{
+    unsigned int seed = 7;
+    m_numbers.reserve(BENCH_NUMBERS);
+    for (int i = 0; i < BENCH_NUMBERS; ++i)
+        m_numbers.push_back(randomNumber(seed, false));
+}
+
+// same bits and the same end as strtof, on every number
+void TestParseNumber::parseFloatMatchesStrtof()
+{
+    unsigned int seed = 1;
+    for (int i = 0; i < CHECK_NUMBERS; ++i) {
+        const std::string number = randomNumber(seed, true);
+        const char *begin = number.c_str();
+        float value;
+        const char *end = parseFloat(begin, begin + number.size(), value);
+        char *expectedEnd;
+        const float expected = strtof(begin, &expectedEnd);
+        if (memcmp(&value, &expected, sizeof(float)) != 0 || end != expectedEnd)
+            QFAIL(qPrintable(QString("%1: %2 instead of %3").arg(QString::fromStdString(number))
+                             .arg(double(value), 0, 'g', 9).arg(double(expected), 0, 'g', 9)));
+    }
+}
+
+void TestParseNumber::parseFloatCases_data()
+{
+    QTest::addColumn<QByteArray>("number");
+    QTest::newRow("zero") << QByteArray("0");
+    QTest::newRow("negative zero") << QByteArray("-0.000");
+    QTest::newRow("trailing dot") << QByteArray("12.");
+    QTest::newRow("leading dot") << QByteArray(".5");
+    QTest::newRow("word after") << QByteArray("1.5Y2");
+    QTest::newRow("exponent without digits") << QByteArray("3e");
+    QTest::newRow("float midpoint") << QByteArray("16777217");
+    QTest::newRow("above midpoint") << QByteArray("16777217.000000001");
+    QTest::newRow("smallest normal") << QByteArray("1.17549435e-38");
+    QTest::newRow("denormal") << QByteArray("1e-40");
+    QTest::newRow("largest") << QByteArray("3.40282347e38");
+    QTest::newRow("many zeros") << QByteArray("0.00000000000000000000000012345");
+    QTest::newRow("long") << QByteArray("123456789012345678901234567890.5");
+    QTest::newRow("overflow") << QByteArray("1e39");
+    QTest::newRow("negative overflow") << QByteArray("-3.5e38");
+    QTest::newRow("rounds to infinity") << QByteArray("3.40282357e38");
+    QTest::newRow("huge exponent") << QByteArray("1e100000");
+    QTest::newRow("long overflow") << QByteArray("123456789012345678901234567890e20");
+    QTest::newRow("smallest denormal") << QByteArray("1.4e-45");
+    QTest::newRow("underflow") << QByteArray("7e-46");
+    QTest::newRow("negative underflow") << QByteArray("-1e-50");
+    QTest::newRow("tiny exponent") << QByteArray("1e-100000");
+    QTest::newRow("zero huge exponent") << QByteArray("0e999999");
+}
+
+void TestParseNumber::parseFloatCases()
+{
+    QFETCH(QByteArray, number);
+    float value;
+    const char *end = parseFloat(number.constData(), number.constData() + number.size(), value);
+    char *expectedEnd;
+    const float expected = strtof(number.constData(), &expectedEnd);
+    QCOMPARE(memcmp(&value, &expected, sizeof(float)), 0);
+    QCOMPARE(end, (const char *)expectedEnd);
+}
+
+void TestParseNumber::parseIntMatchesStrtol()
+{
+    unsigned int seed = 3;
+    char buffer[32];
+    for (int i = 0; i < CHECK_NUMBERS; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        const int number = int(seed >> 1) % 2000000000 - (seed & 1 ? 1000000000 : 0);
+        const int length = snprintf(buffer, sizeof(buffer), "%d/", number);
+        int value;
+        const char *end = parseInt(buffer, buffer + length, value);
+        if (value != number || end != buffer + length - 1)
+            QFAIL(buffer);
+    }
+}
+
+void TestParseNumber::benchmarkParseFloat()
+{
+    float sum = 0;
+    QBENCHMARK {
+        for (size_t i = 0; i < m_numbers.size(); ++i) {
+            float value;
+            const std::string &number = m_numbers[i];
+            parseFloat(number.c_str(), number.c_str() + number.size(), value);
+            sum += value;
+        }
+    }
+    QVERIFY(sum == sum);   // keeps the loop
+}
+
+void TestParseNumber::benchmarkStrtof()
+{
+    float sum = 0;
+    QBENCHMARK {
+        for (size_t i = 0; i < m_numbers.size(); ++i)
+            sum += strtof(m_numbers[i].c_str(), 0);
+    }
+    QVERIFY(sum == sum);
+}
+
+QTEST_APPLESS_MAIN(TestParseNumber)
+
+#include "tst_parsenumber.moc"
@@ -0,0 +1,326 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#include "thumbnailer.h"
+#include "model.h"
+#include "decompressdevice.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QtOpenGL>
+#include <QDebug>
+#include <cmath>
+#include <cstdio>
+
+const float THUMBNAIL_FOV     = 70.f;   // same camera as OpenGLScene
+const float THUMBNAIL_MARGIN  = 1.1f;   // fitted models keep some space to the border
+const int   THUMBNAIL_SAMPLES = 4;
+
+static Model *loadThumbnailModel(const QString &filePath)
+{
+    return new Model(filePath);
+}
+
+struct ThumbnailImage
+{
+    QImage image;
+    QString fileName;
+};
+
+static bool saveThumbnail(const ThumbnailImage &thumbnail)
+{
+    if (thumbnail.image.save(thumbnail.fileName, "PNG"))
+        return true;
+    qWarning("Thumbnailer: cannot write %s", qPrintable(thumbnail.fileName));
+    return false;
+}
+
+ThumbnailOptions::ThumbnailOptions()
+    : size(256, 256)
+    , yaw(-30)
+    , pitch(30)
+    , distance(0)
+    , firstLayer(-1)
+    , lastLayer(-1)
+    , tubes(false)
+    , motion(false)
+    , modelColor(Qt::darkGray)
+    , backgroundColor(Qt::white)
+{
+}
+
+//! ============= Thumbnailer ===============
+Thumbnailer::Thumbnailer(const ThumbnailOptions &options)
+    : m_options(options)
+    , m_surface(new QOffscreenSurface)
+    , m_context(new QOpenGLContext)
+    , m_fbo(0)
+{
+    // Model::render() uses the fixed function pipeline.
+    QSurfaceFormat format;
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+
+    m_surface->setFormat(format);
+    m_surface->create();
+    m_context->setFormat(format);
+    if (!m_context->create() || !m_context->makeCurrent(m_surface)) {
+        qWarning("Thumbnailer: no OpenGL context available");
+        return;
+    }
+
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setSamples(THUMBNAIL_SAMPLES);
+    m_fbo = new QOpenGLFramebufferObject(options.size, fboFormat);
+    if (!m_fbo->isValid()) {
+        qWarning("Thumbnailer: cannot create a %dx%d framebuffer", options.size.width(), options.size.height());
+        delete m_fbo;
+        m_fbo = 0;
+    }
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    if (m_fbo) {
+        m_context->makeCurrent(m_surface);
+        delete m_fbo;
+    }
+    delete m_context;
+    delete m_surface;
+}
+
+QImage Thumbnailer::render(Model *model)
+{
+    if (!m_fbo || !m_context->makeCurrent(m_surface))
+        return QImage();
+
+    const int width  = m_options.size.width();
+    const int height = m_options.size.height();
+    const float halfFov = THUMBNAIL_FOV * 0.5f * 3.141593f / 180;
+
+    // camera around the center of the model
+    QVector3D min, max;
+    model->bounds(min, max);
+    QVector3D center(0, 0, 0);
+    float radius = 1;
+    if (min.x() <= max.x()) {
+        center = (min + max) * 0.5f;
+        radius = qMax((max - min).length() * 0.5f, 0.001f);
+    }
+    const float aspect = float(width) / height;
+    const float fitFov = aspect < 1 ? atan(tan(halfFov) * aspect) : halfFov;
+    const float distance = m_options.distance > 0 ? m_options.distance
+                                                  : THUMBNAIL_MARGIN * radius / sin(fitFov);
+
+    QMatrix4x4 projection;
+    projection.perspective(THUMBNAIL_FOV, aspect, qMax(distance - radius * 2, distance * 0.001f), distance + radius * 2);
+    QMatrix4x4 view;
+    view.translate(0, 0, -distance);
+    view.rotate(m_options.pitch, 1, 0, 0);
+    view.rotate(m_options.yaw, 0, 1, 0);
+    view.translate(-center);
+
+    if (model->gcodeCount()) {
+        if (m_options.firstLayer >= 0 || m_options.lastLayer >= 0)
+            model->setGCodeLayerRange(qMax(m_options.firstLayer, 0),
+                                      m_options.lastLayer >= 0 ? m_options.lastLayer : model->gcodeLayerCount() - 1);
+        else
+            model->setGCodeLayers(model->gcodeCount());
+        model->setGCodeTolerance(2 * distance * tan(halfFov) / height);
+    }
+    model->setViewProjection(projection * view);
+
+    m_fbo->bind();
+    glViewport(0, 0, width, height);
+
+    glShadeModel(GL_SMOOTH);
+    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glEnable(GL_NORMALIZE);
+    glEnable(GL_LINE_SMOOTH);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+    glEnable(GL_MULTISAMPLE);
+
+    const QColor &background = m_options.backgroundColor;
+    glClearColor(background.redF(), background.greenF(), background.blueF(), 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection.constData());
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    // light from above the camera
+    const float pos[] = { 0.3f, 1.f, 1.f, 0 };
+    glLightfv(GL_LIGHT0, GL_POSITION, pos);
+    glLoadMatrixf(view.constData());
+
+    const QColor &color = m_options.modelColor;
+    glColor4f(color.redF(), color.greenF(), color.blueF(), 1.0f);
+    model->render(false, false, m_options.motion, !m_options.tubes);
+    glFinish();
+
+    m_fbo->release();
+    return m_fbo->toImage();
+}
+
+//! ============= Command line ===============
+static QStringList thumbnailInputs(const QStringList &arguments)
+{
+    QStringList inputs;
+    foreach (const QString &argument, arguments) {
+        const QFileInfo info(argument);
+        if (info.isDir()) {
+            const QDir dir(argument);
+            QStringList filters;
+            foreach (const QString &type, QStringList() << "*.gcode" << "*.bgcode" << "*.stl" << "*.obj")
+                filters << type << type + ".gz" << type + ".zst";
+            foreach (const QString &name, dir.entryList(filters, QDir::Files, QDir::Name))
+                inputs << dir.filePath(name);
+        } else {
+            inputs << argument;
+        }
+    }
+    return inputs;
+}
+
+// part.stl gives part.stl.png, so part.stl and part.gcode next to each other keep their own.
+// A name taken before in this run, e.g. a/part.stl and b/part.stl into one --output, gets a number.
+static QString thumbnailPath(const QDir &dir, const QString &inputName, QSet<QString> &taken)
+{
+    const QString name = uncompressedName(inputName);
+    QString path = dir.filePath(name + ".png");
+    for (int n = 2; taken.contains(QFileInfo(path).absoluteFilePath().toLower()); ++n) {
+        path = dir.filePath(QString("%1-%2.png").arg(name, QString::number(n)));
+        qWarning("Thumbnailer: %s taken, trying %s", qPrintable(name + ".png"), qPrintable(path));
+    }
+    taken.insert(QFileInfo(path).absoluteFilePath().toLower());
+    return path;
+}
+
+int runThumbnails(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders PNG thumbnails of g-code, STL and OBJ files.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("files", "Files or directories to render.", "files...");
+    QCommandLineOption thumbnailsOption("thumbnails", "Batch thumbnail mode.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Output directory (default: next to each file), "
+                                    "part.stl is written as part.stl.png.", "dir");
+    QCommandLineOption sizeOption("size", "Image size (default 256x256).", "WxH", "256x256");
+    QCommandLineOption yawOption("yaw", "Camera angle around the vertical axis in degrees.", "deg", "-30");
+    QCommandLineOption pitchOption("pitch", "Camera angle above the plate in degrees.", "deg", "30");
+    QCommandLineOption distanceOption("distance", "Camera distance (default: fit the model).", "mm", "0");
+    QCommandLineOption layersOption("layers", "G-code layers to show, 0-based and inclusive.", "first:last");
+    QCommandLineOption tubesOption("tubes", "Draw extrusions as tubes instead of lines.");
+    QCommandLineOption motionOption("motion", "Draw travel moves.");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs", "Files loaded in parallel (default: one per core).", "n");
+    QCommandLineOption verboseOption("verbose", "Keep the debug output.");
+    parser.addOption(thumbnailsOption);
+    parser.addOption(outputOption);
+    parser.addOption(sizeOption);
+    parser.addOption(yawOption);
+    parser.addOption(pitchOption);
+    parser.addOption(distanceOption);
+    parser.addOption(layersOption);
+    parser.addOption(tubesOption);
+    parser.addOption(motionOption);
+    parser.addOption(jobsOption);
+    parser.addOption(verboseOption);
+    parser.process(arguments);
+
+    if (!parser.isSet(verboseOption))
+        QLoggingCategory::setFilterRules("*.debug=false");
+
+    ThumbnailOptions options;
+    const QStringList size = parser.value(sizeOption).split('x');
+    if (size.size() == 2)
+        options.size = QSize(size.at(0).toInt(), size.at(1).toInt());
+    options.yaw = parser.value(yawOption).toFloat();
+    options.pitch = parser.value(pitchOption).toFloat();
+    options.distance = parser.value(distanceOption).toFloat();
+    if (parser.isSet(layersOption)) {
+        const QStringList layers = parser.value(layersOption).split(':');
+        options.firstLayer = layers.at(0).isEmpty() ? 0 : layers.at(0).toInt();
+        options.lastLayer = layers.size() > 1 && !layers.at(1).isEmpty() ? layers.at(1).toInt() : -1;
+    }
+    options.tubes = parser.isSet(tubesOption);
+    options.motion = parser.isSet(motionOption);
+    if (options.size.isEmpty()) {
+        qWarning("Thumbnailer: invalid size %s", qPrintable(parser.value(sizeOption)));
+        return 1;
+    }
+
+    const QStringList inputs = thumbnailInputs(parser.positionalArguments());
+    if (inputs.isEmpty())
+        parser.showHelp(1);
+
+    const int jobs = parser.isSet(jobsOption) ? qMax(1, parser.value(jobsOption).toInt())
+                                              : QThread::idealThreadCount();
+    QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+
+    Thumbnailer thumbnailer(options);
+    if (!thumbnailer.isValid())
+        return 1;
+
+    // Parsing dominates, so files are loaded in batches on the thread pool while the
+    // previous batch is rendered (GL stays on this thread) and written in the background.
+    QList<QFuture<bool> > writes;
+    QSet<QString> written;
+    QFuture<Model *> loading = QtConcurrent::mapped(inputs.mid(0, jobs), loadThumbnailModel);
+    int failed = 0;
+    for (int first = 0; first < inputs.size(); first += jobs) {
+        loading.waitForFinished();
+        const QList<Model *> models = loading.results();
+        if (first + jobs < inputs.size())
+            loading = QtConcurrent::mapped(inputs.mid(first + jobs, jobs), loadThumbnailModel);
+
+        for (int i = 0; i < models.size(); ++i) {
+            const QFileInfo input(inputs.at(first + i));
+            Model *model = models.at(i);
+            if (!model->points() && !model->gcodeCount()) {
+                qWarning("Thumbnailer: nothing to render in %s", qPrintable(input.filePath()));
+                ++failed;
+                delete model;
+                continue;
+            }
+
+            ThumbnailImage thumbnail;
+            thumbnail.image = thumbnailer.render(model);
+            delete model;
+            const QDir dir(parser.isSet(outputOption) ? parser.value(outputOption) : input.absolutePath());
+            thumbnail.fileName = thumbnailPath(dir, input.fileName(), written);
+            writes << QtConcurrent::run(saveThumbnail, thumbnail);
+        }
+    }
+
+    for (int i = 0; i < writes.size(); ++i) {
+        if (!writes.at(i).result())
+            ++failed;
+    }
+    printf("%d of %d thumbnails written\n", inputs.size() - failed, inputs.size());
+    return failed ? 1 : 0;
+}
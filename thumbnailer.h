@@ -0,0 +1,70 @@
+/* This proram is part of Qt examples.
+   Copyright 2015-2022 by Chun-Ming Su
+   E-Mail: sokunmin@gmail.com
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QColor>
+#include <QImage>
+#include <QSize>
+#include <QStringList>
+
+QT_BEGIN_NAMESPACE
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+QT_END_NAMESPACE
+
+class Model;
+
+struct ThumbnailOptions
+{
+    ThumbnailOptions();
+
+    QSize size;
+    float yaw;          // degrees around the vertical axis
+    float pitch;        // degrees above the plate
+    float distance;     // camera distance, 0 fits the model into the view
+    int firstLayer;     // g-code layer range, -1 for all
+    int lastLayer;
+    bool tubes;         // extrusion tubes instead of lines
+    bool motion;        // travel moves
+    QColor modelColor;
+    QColor backgroundColor;
+};
+
+//! Renders models into an offscreen framebuffer through Model::render(), no window needed.
+//! Must be created and used on the thread of the QGuiApplication. With QT_QPA_PLATFORM=offscreen
+//! (and LIBGL_ALWAYS_SOFTWARE=1 for Mesa llvmpipe) it also works on machines without a display.
+class Thumbnailer
+{
+public:
+    explicit Thumbnailer(const ThumbnailOptions &options);
+    ~Thumbnailer();
+
+    bool isValid() const { return m_fbo != 0; }
+    QImage render(Model *model);
+
+private:
+    ThumbnailOptions m_options;
+    QOffscreenSurface *m_surface;
+    QOpenGLContext *m_context;
+    QOpenGLFramebufferObject *m_fbo;
+};
+
+//! Command line mode: --thumbnails [options] files... Returns the process exit code.
+int runThumbnails(const QStringList &arguments);
+
+#endif // THUMBNAILER_H